@@ -1,67 +1,103 @@
 #include "analyser.h"
 
 #include <climits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <set>
 
 namespace miniplc0 {
 	std::pair<std::vector<functionBodyTable>, std::optional<CompilationError>> Analyser::Analyse() {
+		TraceScope trace(__func__);
+		AllocationScope allocation(AllocAnalyse);
 		auto err = analyseC0Program();
 		if (err.has_value())
 			return std::make_pair(std::vector<functionBodyTable>(), err);
-		else
-			return std::make_pair(_funInstruction, std::optional<CompilationError>());
+		SampleScope scope("optimize");
+		AllocationScope optimize(AllocOptimize);
+		for (auto& it : _funInstruction)
+			eliminateDeadCode(it._funins, &it._origins);
+		if (_options._inline)
+			inlineFunctions(_funInstruction, _fun, _options._inline_budget);
+		for (std::size_t i = 0; i < _funInstruction.size(); i++)
+			_funInstruction[i]._frame = analyseFrame(_funInstruction[i]._funins, _fun, _fun[i]._params_size, _fun[i]._slots);
+		_startFrame = analyseFrame(_start, _fun, 0, _var.size());
+		_data = evaluateGlobals(_start);
+
+		// 指令的来源换成 token 的起始位置
+		auto& tokens = *_source;
+		auto build = [&tokens](const std::vector<int32_t>& origins) {
+			std::vector<std::optional<LineTable::position>> positions;
+			positions.reserve(origins.size());
+			for (auto origin : origins) {
+				if (origin >= 0 && origin < (int32_t)tokens.size())
+					positions.emplace_back(tokens[origin].GetStartPos());
+				else
+					positions.emplace_back();
+			}
+			return LineTable::Build(positions);
+		};
+		_lines.clear();
+		_lines.emplace_back(build(_startOrigins));
+		for (auto& it : _funInstruction)
+			_lines.emplace_back(build(it._origins));
+		return std::make_pair(_funInstruction, std::optional<CompilationError>());
 	}
 
 	//<C0-program> ::= {<variable-declaration>}{<function-definition>}
 	std::optional<CompilationError> Analyser::analyseC0Program() {
+        SampleScope scope(__func__);
         _indexTable.emplace_back(0);
 
 	    while (true){
-            auto next=nextToken();
-            if (!next.has_value())
+            auto type=peek().GetType();
+            if(type==NULL_TOKEN)
                 return {};
-            if(next.value().GetType()==CONST){//如果读到const，跳转变量声明语句
-                unreadToken();
+            if(type==CONST){//如果读到const，跳转变量声明语句
                 auto err=analyseVariableDeclaration(true);
                 if(err.has_value())
                     return err;
             }
-            else if(next.value().GetType()==INT||next.value().GetType()==VOID){
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=IDENTIFIER){
+            else if(type==INT||type==VOID){
+                //向前看两个 token，标识符之后是 '(' 时为函数定义
+                //出错时把看过的 token 读入再报错，位置和逐个读入时一样
+                if(peek(1).GetType()!=IDENTIFIER){
+                    consume();
+                    consume();
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
                 }
-                next=nextToken();
-                if(!next.has_value()){
+                type=peek(2).GetType();
+                if(type==NULL_TOKEN){
+                    consume();
+                    consume();
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
                 }
-                else if(next.value().GetType()==LEFT_BRACKET){//函数声明
-                    unreadToken();
-                    unreadToken();
-                    unreadToken();
+                else if(type==LEFT_BRACKET)//函数声明
                     break;
-                }
-                else{
-                    unreadToken();
-                    unreadToken();
-                    unreadToken();
-                    auto err=analyseVariableDeclaration(true);
-                    if(err.has_value())
-                        return err;
-                }
+                auto err=analyseVariableDeclaration(true);
+                if(err.has_value())
+                    return err;
             }
             else{
+                consume();
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
             }
 	    }
-	    while(true){
-            auto next=nextToken();
-            if (!next.has_value())
-                break;
-            unreadToken();
+	    //先扫描所有函数头，函数体之后并行分析
+	    //函数头的错误要排在它前面的函数体的错误之后
+	    std::optional<CompilationError> headerErr;
+	    while(peek().GetType()!=NULL_TOKEN){
             auto err=analyseFunctionDefinition();
-            if(err.has_value())
-                return err;
+            if(err.has_value()){
+                headerErr=err;
+                break;
+            }
 	    }
+	    auto err=analyseFunctionBodies();
+	    if(err.has_value())
+	        return err;
+	    if(headerErr.has_value())
+	        return headerErr;
 	    int nf=_fun.size();
 	    for(int i=0;i<nf;i++){
 	        if(_fun[i]._value=="main")
@@ -74,60 +110,38 @@ namespace miniplc0 {
     //<init-declarator-list> ::= <init-declarator>{','<init-declarator>}
     //<init-declarator> ::= <identifier>['='<expression>]
     std::optional<CompilationError> Analyser::analyseVariableDeclaration(bool isGlobal) {
-	    auto next=nextToken();
-	    if(next.value().GetType()==VOID)
+	    SampleScope scope(__func__);
+	    auto type=consume().GetType();
+	    if(type==VOID)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
-        else if(next.value().GetType()==CONST){
-            next=nextToken();
-            if(!next.has_value()||next.value().GetType()!=INT)
+        else if(type==CONST){
+            if(!expect(INT))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
             else{
                 auto err=analyseInitDeclarator(true,isGlobal);
                 if(err.has_value())
                     return err;
-                while(true){
-                    next=nextToken();
-                    if(next.value().GetType()==SEMICOLON){
-                        unreadToken();
-                        break;
-                    }
-                    else if(next.value().GetType()==COMMA){
-                        auto err=analyseInitDeclarator(true, isGlobal);
-                        if(err.has_value())
-                            return err;
-                    }
-                    else{
-                        unreadToken();
-                        break;
-                    }
+                while(peek().GetType()==COMMA){
+                    consume();
+                    auto err=analyseInitDeclarator(true, isGlobal);
+                    if(err.has_value())
+                        return err;
                 }
-                next=nextToken();
-                if(next.value().GetType()!=SEMICOLON)
+                if(!expect(SEMICOLON))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
             }
         }
-        else if(next.value().GetType()==INT){
+        else if(type==INT){
             auto err=analyseInitDeclarator(false, isGlobal);
             if(err.has_value())
                 return err;
-            while(true){
-                next=nextToken();
-                if(next.value().GetType()==SEMICOLON){
-                    unreadToken();
-                    break;
-                }
-                else if(next.value().GetType()==COMMA){
-                    auto err=analyseInitDeclarator(false, isGlobal);
-                    if(err.has_value())
-                        return err;
-                }
-                else{
-                    unreadToken();
-                    break;
-                }
+            while(peek().GetType()==COMMA){
+                consume();
+                auto err=analyseInitDeclarator(false, isGlobal);
+                if(err.has_value())
+                    return err;
             }
-            next=nextToken();
-            if(next.value().GetType()!=SEMICOLON)
+            if(!expect(SEMICOLON))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
         }
         else{
@@ -137,52 +151,51 @@ namespace miniplc0 {
 	}
     //<init-declarator> ::= <identifier>['='<expression>]
     std::optional<CompilationError> Analyser::analyseInitDeclarator(bool isConstant, bool isGlobal) {
-        auto next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=IDENTIFIER)
+        SampleScope scope(__func__);
+        auto& preToken=consume();//标识符
+        if(preToken.GetType()!=IDENTIFIER)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
-        auto preToken=next;//标识符
-        next=nextToken();
         if(isConstant){//是常量
-            if(next.value().GetType()!=ASSIGNMENT_SIGN)//未赋值
+            if(!expect(ASSIGNMENT_SIGN))//未赋值
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrConstantNeedValue);
             else{//要赋值
                 if(isGlobal){//是全局常量
-                    if(isDeclared(preToken.value().GetValueString(),0))
+                    if(isDeclared(preToken.GetValueString(),0))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
 //                    _start.emplace_back(IPUSH,_nextVarAddress-1,0);
                     auto err=analyseExpression();
                     if(err.has_value())
                         return err;
-                    addConstant(preToken.value(),0);
+                    addConstant(preToken,0);
                 }
                 else{//局部常量
-                    if(isDeclared(preToken.value().GetValueString(),1))
+                    if(isDeclared(preToken.GetValueString(),1))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
                     auto err=analyseExpression();
                     if(err.has_value())
                         return err;
-                    addConstant(preToken.value(),1);
+                    addConstant(preToken,1);
                 }
             }
         }
         else{//是变量
-            if(next.value().GetType()==TokenType::COMMA||next.value().GetType()==TokenType::SEMICOLON){//未赋值
-                unreadToken();
+            auto type=peek().GetType();
+            if(type==TokenType::COMMA||type==TokenType::SEMICOLON){//未赋值
                 if(isGlobal){//是全局变量
-                    if(isDeclared(preToken.value().GetValueString(),0))
+                    if(isDeclared(preToken.GetValueString(),0))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
-                    addUninitializedVariable(preToken.value(),0);
+                    addUninitializedVariable(preToken,0);
                     _start.emplace_back(SNEW,1,0);
 //                    auto err=analyseExpression();
 //                    if(err.has_value())
 //                        return err;
                 }
                 else{//是局部变量
-                    if(isDeclared(preToken.value().GetValueString(),1))
+                    if(isDeclared(preToken.GetValueString(),1))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
-                    addUninitializedVariable(preToken.value(),1);
+                    addUninitializedVariable(preToken,1);
                     _funInstruction[_instructionIndex]._funins.emplace_back(SNEW,1,0);
 //                    auto err=analyseExpression();
 //                    if(err.has_value())
@@ -191,20 +204,21 @@ namespace miniplc0 {
                 return {};
             }
             else{//为变量赋值
+                consume();
                 if(isGlobal){//是全局变量
-                    if(isDeclared(preToken.value().GetValueString(),0))
+                    if(isDeclared(preToken.GetValueString(),0))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
                     auto err=analyseExpression();
                     if(err.has_value())
                         return err;
-                    addVariable(preToken.value(),0);
+                    addVariable(preToken,0);
                 }
                 else{//局部变量
-                    if(isDeclared(preToken.value().GetValueString(),1))
+                    if(isDeclared(preToken.GetValueString(),1))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
-                    addUninitializedVariable(preToken.value(),1);//将局部变量先声明为未赋值变量,type=1;
+                    addUninitializedVariable(preToken,1);//将局部变量先声明为未赋值变量,type=1;
                     auto err=analyseExpression();
                     if(err.has_value())
                         return err;
@@ -220,18 +234,21 @@ namespace miniplc0 {
     //<parameter-clause> ::= '(' [<parameter-declaration-list>] ')'
     //<parameter-declaration-list> ::= <parameter-declaration>{','<parameter-declaration>}
     std::optional<CompilationError> Analyser::analyseFunctionDefinition() {
+	    SampleScope scope(__func__);
+	    std::string name;   //读到函数名后才知道
+	    TraceScope trace(__func__, name);
 	    int slot=0;
-	    auto next=nextToken();
-	    auto preNext=next;
-	    if(!next.has_value() || (next.value().GetType()!=TokenType::INT && next.value().GetType()!=TokenType::VOID))
+	    auto returnType=consume().GetType();
+	    if(returnType!=TokenType::INT && returnType!=TokenType::VOID)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-	    next=nextToken();//函数名标识符
-        if(!next.has_value() || next.value().GetType()!=TokenType::IDENTIFIER)
+	    auto& identifier=consume();//函数名标识符
+        if(identifier.GetType()!=TokenType::IDENTIFIER)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-        if(isDeclared(next.value().GetValueString(),0)){
+        name=identifier.GetValueString();
+        if(isDeclared(name,0)){
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
         }
-        addFunction(next.value(),1);
+        addFunction(identifier,1);
 
 //        std::cout<<"???"<<_nextVarAddress<<"???"<<_instructionIndex<<std::endl;
 //        std::cout<<_indexTable.size()<<std::endl;
@@ -239,58 +256,255 @@ namespace miniplc0 {
         int oldAddress=_nextVarAddress;
 
         int tmp=_fun.size();
-        if(preNext.value().GetType()==TokenType::INT){
+        if(returnType==TokenType::INT){
             _fun[tmp-1]._haveReturnValue=1;
         }
         else{
             _fun[tmp-1]._haveReturnValue=0;
         }
 
-        next=nextToken();
-        if(!next.has_value() || next.value().GetType()!=TokenType::LEFT_BRACKET)
+        if(!expect(TokenType::LEFT_BRACKET))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-        next=nextToken();
-        if(!next.has_value())
+        auto type=peek().GetType();
+        if(type==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-        else if(next.value().GetType()==TokenType::RIGHT_BRACKET){//函数参数为0
-            unreadToken();
-        }
-        else{//函数参数有多个
+        else if(type!=TokenType::RIGHT_BRACKET){//函数参数有多个
 //            std::cout<<_nextVarAddress<<"aaaaaaaaaaaaaaaaa"<<std::endl;
-            unreadToken();
             auto err=analyseParameterDeclaration();
             if(err.has_value())
                 return err;
             slot++;
-            while (true){
-                next=nextToken();
-                if(!next.has_value())
+            while (peek().GetType()!=TokenType::RIGHT_BRACKET){
+                if(!expect(TokenType::COMMA))//后面还有参数
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-                if(next.value().GetType()==TokenType::COMMA){//后面还有参数
-                    auto err=analyseParameterDeclaration();
-                    if(err.has_value())
-                        return err;
-                    slot++;
-                }
-                else if(next.value().GetType()==TokenType::RIGHT_BRACKET){
-                    unreadToken();
-                    break;
-                }
-                else{
-                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-                }
+                auto err=analyseParameterDeclaration();
+                if(err.has_value())
+                    return err;
+                slot++;
             }
         }
-        next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+        if(!expect(TokenType::RIGHT_BRACKET))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
 
         int n=_fun.size();
         _fun[n-1]._params_size=slot;
-        _funInstruction.emplace_back(functionBodyTable());
 //        _funInstruction[_instructionIndex]._funins.emplace_back(SNEW,slot,0);
 //        _instructions.emplace_back(SNEW,slot,0);
 
+        //记下参数和函数体的位置，按括号匹配跳过函数体
+        //函数体能通过分析时，分析结束的位置和括号匹配的结果一致；缺少 '{' 时不跳过，留给函数体的分析报错
+        functionSignature signature;
+        signature._params.assign(_var.begin()+oldAddress,_var.end());
+        signature._body=_offset;
+        _signatures.emplace_back(signature);
+        if(peek().GetType()==TokenType::LEFT_BRACE){
+            consume();
+            int depth=1;
+            while(depth>0){
+                auto type=consume().GetType();
+                if(type==NULL_TOKEN)
+                    break;
+                if(type==TokenType::LEFT_BRACE)
+                    depth++;
+                else if(type==TokenType::RIGHT_BRACE)
+                    depth--;
+            }
+        }
+        _signatures.back()._end=_offset;
+
+        int nvar=_var.size();
+        while (nvar>oldAddress){
+            _var.pop_back();
+            nvar=_var.size();
+        }
+        _indexTable[1]=oldAddress;
+        _nextVarAddress=oldAddress;
+        return {};
+    }
+
+    Analyser::Analyser(const Analyser* parent)
+        : _tokens(), _source(parent->_source), _offset(0), _instructions({}), _current_pos(0, 0),
+        _var({}), _start({}), _fun(parent->_fun), _funInstruction(parent->_fun.size()), _indexTable({}),
+        _threads(1), _cache(nullptr), _signatures(parent->_signatures), _visibleFunctions(0), _nextTokenIndex(0), _nextVarAddress(0), _instructionIndex(-1) {}
+
+    std::optional<CompilationError> Analyser::analyseFunctionBodies() {
+	    SampleScope scope(__func__);
+	    int32_t n=_signatures.size();
+	    auto globals=_var;
+	    _funInstruction.assign(n,functionBodyTable());
+
+	    //每个函数体都从声明完的全局变量表开始分析，彼此独立
+	    std::vector<std::optional<CompilationError>> errors(n);
+	    std::vector<int32_t> slots(n,0);
+	    std::vector<std::vector<variableTable>> finals(n);
+
+	    //缓存命中的函数不再分析，直接用缓存的字节码和它对全局变量的赋值
+	    //缓存的结果只取决于键中的内容，键中包括分析时全局变量表中同名变量的状态
+	    std::unordered_multimap<std::string,int32_t> names;
+	    if(_cache!=nullptr){
+	        for(std::size_t g=0;g<globals.size();g++)
+	            names.emplace(globals[g]._name,g);
+	        for(int32_t i=0;i<n;i++)
+	            names.emplace(_fun[i]._value,~i);
+	    }
+	    auto useCached=[&](int32_t i, const std::vector<variableTable>& base){
+	        if(_cache==nullptr)
+	            return false;
+	        auto cached=_cache->Find(functionKey(i,base,names));
+	        if(!cached.has_value())
+	            return false;
+	        _funInstruction[i]._funins=std::move(cached.value()._funins);
+	        _funInstruction[i]._origins=std::move(cached.value()._origins);
+	        for(auto& it : _funInstruction[i]._origins)
+	            it+=_signatures[i]._body;
+	        slots[i]=cached.value()._slots;
+	        finals[i]=base;
+	        for(auto g : cached.value()._assigned)
+	            finals[i][g]._type=2;
+	        return true;
+	    };
+	    auto addToCache=[&](int32_t i, const std::vector<variableTable>& base){
+	        if(_cache==nullptr)
+	            return;
+	        cachedFunction value;
+	        value._funins=_funInstruction[i]._funins;
+	        value._origins=_funInstruction[i]._origins;
+	        for(auto& it : value._origins)
+	            it-=_signatures[i]._body;
+	        value._slots=slots[i];
+	        for(std::size_t g=0;g<base.size();g++)
+	            if(finals[i][g]._type==2&&base[g]._type!=2)
+	                value._assigned.emplace_back(g);
+	        _cache->Insert(functionKey(i,base,names),std::move(value));
+	    };
+	    std::vector<int32_t> pending;
+	    for(int32_t i=0;i<n;i++)
+	        if(!useCached(i,globals))
+	            pending.emplace_back(i);
+
+	    int32_t m=pending.size();
+	    unsigned int threads=_threads!=0?_threads:std::max(1u,std::thread::hardware_concurrency());
+	    threads=std::min<std::size_t>(threads,std::max(m,1));
+	    std::atomic<int32_t> next(0);
+	    auto stack=CurrentSampleStack();
+	    auto phase=CurrentAllocationPhase();
+	    auto worker=[&](){
+	        SampleScope inherited(stack);
+	        AllocationScope allocation(phase);
+	        Analyser analyser(this);
+	        for(int32_t k=next++;k<m;k=next++){
+	            int32_t i=pending[k];
+	            errors[i]=analyser.analyseFunctionBody(i,globals);
+	            _funInstruction[i]._funins=std::move(analyser._funInstruction[i]._funins);
+	            _funInstruction[i]._origins=std::move(analyser._funInstruction[i]._origins);
+	            slots[i]=analyser._fun[i]._slots;
+	            finals[i].assign(analyser._var.begin(),analyser._var.begin()+globals.size());
+	        }
+	    };
+	    std::vector<std::thread> pool;
+	    for(unsigned int i=1;i<threads;i++)
+	        pool.emplace_back(worker);
+	    worker();
+	    for(auto& it : pool)
+	        it.join();
+
+	    //按声明顺序合并
+	    //前面的函数给未初始化的全局变量赋值后，后面的函数才能读它；出错的函数用合并到这里的全局变量表重新分析，
+	    //因此报告的错误和依次分析时完全一样
+	    auto state=globals;
+	    for(auto i : pending){
+	        if(!errors[i].has_value())
+	            addToCache(i,globals);
+	    }
+	    for(int32_t i=0;i<n;i++){
+	        if(errors[i].has_value()&&!useCached(i,state)){
+	            Analyser analyser(this);
+	            auto err=analyser.analyseFunctionBody(i,state);
+	            if(err.has_value())
+	                return err;
+	            _funInstruction[i]._funins=std::move(analyser._funInstruction[i]._funins);
+	            _funInstruction[i]._origins=std::move(analyser._funInstruction[i]._origins);
+	            slots[i]=analyser._fun[i]._slots;
+	            finals[i].assign(analyser._var.begin(),analyser._var.begin()+globals.size());
+	            addToCache(i,state);
+	        }
+	        for(std::size_t g=0;g<globals.size();g++)
+	            if(finals[i][g]._type==2)
+	                state[g]._type=2;
+	        _fun[i]._slots=slots[i];
+	    }
+	    _var=state;
+	    return {};
+    }
+
+    uint64_t Analyser::functionKey(int32_t index, const std::vector<variableTable>& globals,
+            const std::unordered_multimap<std::string, int32_t>& names) const {
+	    fnvHash h;
+	    auto addVariable=[&h](const variableTable& v){
+	        h.add(v._name);
+	        h.add(v._type);
+	        h.add(v._level);
+	        h.add(v._address);
+	    };
+	    auto addFunction=[&h, this](int32_t i){
+	        h.add(i);
+	        h.add(_fun[i]._value);
+	        h.add(_fun[i]._params_size);
+	        h.add(_fun[i]._level);
+	        h.add(_fun[i]._haveReturnValue);
+	    };
+	    addFunction(index);
+	    h.add(globals.size());
+	    for(auto& it : _signatures[index]._params)
+	        addVariable(it);
+
+	    //运算符的值由类型决定，只有标识符和字面量需要把值算进去
+	    std::set<std::string> identifiers;
+	    for(auto i=_signatures[index]._body;i<_signatures[index]._end;i++){
+	        auto& t=(*_source)[i];
+	        h.add((int32_t)t.GetType());
+	        auto value=t.GetValue();
+	        if(auto str=std::any_cast<std::string>(&value)){
+	            h.add(*str);
+	            if(t.GetType()==TokenType::IDENTIFIER)
+	                identifiers.insert(*str);
+	        }
+	    }
+	    //函数体只会用到同名的全局变量和前面声明的函数，局部变量遮住的全局变量也算进去，宁可多失效
+	    for(auto& name : identifiers){
+	        h.add(name);
+	        auto range=names.equal_range(name);
+	        std::vector<int32_t> found;
+	        for(auto it=range.first;it!=range.second;++it)
+	            if(it->second>=0||~it->second<=index)
+	                found.emplace_back(it->second);
+	        std::sort(found.begin(),found.end());
+	        for(auto i : found){
+	            if(i>=0)
+	                addVariable(globals[i]);
+	            else
+	                addFunction(~i);
+	        }
+	    }
+	    return h._value;
+    }
+
+    std::optional<CompilationError> Analyser::analyseFunctionBody(int32_t index, const std::vector<variableTable>& globals) {
+	    SampleScope scope(__func__);
+	    TraceScope trace(__func__, _fun[index]._value);
+	    _var=globals;
+	    for(auto& it : _signatures[index]._params)
+	        _var.emplace_back(it);
+	    int oldAddress=globals.size();
+	    _nextVarAddress=_var.size();
+	    _indexTable={0,oldAddress};
+	    _instructionIndex=index;
+	    _visibleFunctions=index+1;
+	    _offset=_signatures[index]._body;
+	    _jumps.clear();
+	    _funInstruction[_instructionIndex]._funins.clear();
+	    _funInstruction[_instructionIndex]._origins.clear();
+
         auto err=analyseCompoundStatement();
         if(err.has_value())
             return err;
@@ -302,6 +516,8 @@ namespace miniplc0 {
             _funInstruction[_instructionIndex]._funins.emplace_back(IPUSH,0,0);
             _funInstruction[_instructionIndex]._funins.emplace_back(IRET,0,0);
         }
+        markOrigins();
+        _fun[_instructionIndex]._slots=_nextVarAddress-oldAddress;
         int nvar=_var.size();
         while (nvar>oldAddress){
             _var.pop_back();
@@ -313,24 +529,24 @@ namespace miniplc0 {
     }
     //<parameter-declaration> ::= [<const-qualifier>]<type-specifier><identifier>
     std::optional<CompilationError> Analyser::analyseParameterDeclaration(){
-	    auto next=nextToken();
-	    if(!next.has_value())
+	    SampleScope scope(__func__);
+	    auto type=consume().GetType();
+	    if(type==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-	    else if(next.value().GetType()==TokenType::CONST){
-	        next=nextToken();
-	        if(!next.has_value()||next.value().GetType()!=TokenType::INT)
+	    else if(type==TokenType::CONST){
+	        if(!expect(TokenType::INT))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-            next=nextToken();
-            if(!next.has_value()||next.value().GetType()!=TokenType::IDENTIFIER)
+            auto& identifier=consume();
+            if(identifier.GetType()!=TokenType::IDENTIFIER)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
             //
-            addConstant(next.value(),1);
+            addConstant(identifier,1);
 	    }
-	    else if(next.value().GetType()==TokenType::INT){
-            next=nextToken();
-            if(!next.has_value()||next.value().GetType()!=TokenType::IDENTIFIER)
+	    else if(type==TokenType::INT){
+            auto& identifier=consume();
+            if(identifier.GetType()!=TokenType::IDENTIFIER)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
-            addVariable(next.value(),1);
+            addVariable(identifier,1);
 	    }
 	    else{
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
@@ -342,41 +558,32 @@ namespace miniplc0 {
     //<statement> ::= '{' <statement-seq> '}'|<condition-statement>|<loop-statement>|<jump-statement>|<print-statement>
     //    |<scan-statement>|<assignment-expression>';'|<function-call>';'|';'
     std::optional<CompilationError> Analyser::analyseCompoundStatement(){
-	    auto next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACE)
+	    SampleScope scope(__func__);
+        if(!expect(TokenType::LEFT_BRACE))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBrace);
         //<variable-declaration> ::= [<const-qualifier>]<type-specifier><init-declarator-list>';'
         while (true){
-            next=nextToken();
-            if(!next.has_value())
+            auto type=peek().GetType();
+            if(type==NULL_TOKEN)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-            if(next.value().GetType()==TokenType::CONST||next.value().GetType()==TokenType::INT){
-                unreadToken();
-                auto err=analyseVariableDeclaration(false);
-                if(err.has_value())
-                    return err;
-            }
-            else{
-                unreadToken();
+            if(type!=TokenType::CONST&&type!=TokenType::INT)
                 break;
-            }
+            auto err=analyseVariableDeclaration(false);
+            if(err.has_value())
+                return err;
         }
         while (true){
-            next=nextToken();
-            if(!next.has_value())
+            auto type=peek().GetType();
+            if(type==NULL_TOKEN)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-            if(next.value().GetType()==TokenType::RIGHT_BRACE){
-                unreadToken();
+            if(type==TokenType::RIGHT_BRACE)
                 break;
-            }
-            unreadToken();
             auto err=analyseStatementSeq();
             if(err.has_value())
                 return err;
         }
 
-        next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACE)
+        if(!expect(TokenType::RIGHT_BRACE))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBrace);
         return {};
 	}
@@ -384,16 +591,14 @@ namespace miniplc0 {
     //<statement> ::= '{' <statement-seq> '}'|<condition-statement>|<loop-statement>|<jump-statement>|<print-statement>
     //    |<scan-statement>|<assignment-expression>';'|<function-call>';'|';'
     std::optional<CompilationError> Analyser::analyseStatementSeq() {
+	    SampleScope scope(__func__);
 	    while (true){
-            auto next=nextToken();
-            if(!next.has_value()){
+            auto type=peek().GetType();
+            if(type==NULL_TOKEN){
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBrace);
             }
-            if(next.value().GetType()==TokenType::RIGHT_BRACE){
-                unreadToken();
+            if(type==TokenType::RIGHT_BRACE)
                 break;
-            }
-            unreadToken();
             auto err=analyseStatement();
             if(err.has_value())
                 return err;
@@ -401,30 +606,43 @@ namespace miniplc0 {
         return {};
 	}
 
+    // 把条件不成立时跳转的指令换成条件成立时跳转
+    static Operation invertJump(Operation op) {
+        switch (op) {
+            case JE: return JNE;
+            case JNE: return JE;
+            case JL: return JGE;
+            case JGE: return JL;
+            case JG: return JLE;
+            case JLE: return JG;
+            default:
+                DieAndPrint("The condition does not end with a conditional jump.");
+                return op;
+        }
+    }
+
     std::optional<CompilationError> Analyser::analyseStatement(){
-	    auto next=nextToken();
-	    if(!next.has_value())
+	    SampleScope scope(__func__);
+	    auto& next=consume();
+	    if(next.GetType()==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-        switch (next.value().GetType()){
+        switch (next.GetType()){
             case LEFT_BRACE:{//'{' <statement-seq> '}'
                 auto err=analyseStatementSeq();
                 if(err.has_value())
                     return err;
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACE)
+                if(!expect(TokenType::RIGHT_BRACE))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBrace);
                 break;
             }
             case IF:{//<condition-statement>::='if' '(' <condition> ')' <statement> ['else' <statement>]
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET)
+                if(!expect(TokenType::LEFT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
                 auto err=analyseCondition();
                 int index1=_funInstruction[_instructionIndex]._funins.size()-1;
                 if(err.has_value())
                     return err;
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+                if(!expect(TokenType::RIGHT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
                 err=analyseStatement();
                 if(err.has_value())
@@ -440,11 +658,11 @@ namespace miniplc0 {
                 _funInstruction[_instructionIndex]._funins[index1].SetX(off1);
 
 
-                next=nextToken();
-                if(!next.has_value())
+                auto type=peek().GetType();
+                if(type==NULL_TOKEN)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-                if(next.value().GetType()==TokenType::ELSE){
-
+                if(type==TokenType::ELSE){
+                    consume();
                     err=analyseStatement();
                     if(err.has_value())
                         return err;
@@ -453,7 +671,6 @@ namespace miniplc0 {
                 }
                 else{
                     _funInstruction[_instructionIndex]._funins[index2].SetX(index2+1);
-                    unreadToken();
                 }
 
                 break;
@@ -461,19 +678,17 @@ namespace miniplc0 {
             case WHILE:{//<loop-statement>::='while' '(' <condition> ')' <statement>
                 int off1=_funInstruction[_instructionIndex]._funins.size();
 
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET)
+                if(!expect(TokenType::LEFT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
 
                 auto err=analyseCondition();
                 if(err.has_value())
                     return err;
                 int index1=_funInstruction[_instructionIndex]._funins.size()-1;
-                next=nextToken();
-//                std::cout<<next.value().GetValueString()<<std::endl;
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+                if(!expect(TokenType::RIGHT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
 
+                _jumps.push_back({true,{},{}});
                 err=analyseStatement();
                 if(err.has_value())
                     return err;
@@ -481,13 +696,202 @@ namespace miniplc0 {
                 _funInstruction[_instructionIndex]._funins.emplace_back(JMP,off1,0);
                 int off2=_funInstruction[_instructionIndex]._funins.size();
                 _funInstruction[_instructionIndex]._funins[index1].SetX(off2);
+                leaveJumpContext(off2,off1);
+                break;
+            }
+            case DO:{//<loop-statement>::='do' <statement> 'while' '(' <condition> ')' ';'
+                auto& funins=_funInstruction[_instructionIndex]._funins;
+                int32_t body=funins.size();
+                _jumps.push_back({true,{},{}});
+                auto err=analyseStatement();
+                if(err.has_value())
+                    return err;
+                int32_t condition=funins.size();
+                if(!expect(TokenType::WHILE))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
+                if(!expect(TokenType::LEFT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
+                err=analyseCondition();
+                if(err.has_value())
+                    return err;
+                //条件成立时跳回循环体
+                funins.back()=Instruction(invertJump(funins.back().GetOperation()),body,0);
+                if(!expect(TokenType::RIGHT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
+                if(!expect(TokenType::SEMICOLON))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+                leaveJumpContext(funins.size(),condition);
+                break;
+            }
+            case FOR:{//<loop-statement>::='for' '('<for-init-statement> [<condition>]';' [<for-update-expression>]')' <statement>
+                //<for-init-statement> ::= [<assignment-expression>{','<assignment-expression>}]';'
+                //<for-update-expression> ::= (<assignment-expression>|<function-call>){','(<assignment-expression>|<function-call>)}
+                //条件放在循环体之后，先跳到条件，每次循环只执行条件末尾的一次跳转：
+                //  <init>; jmp cond; body: <statement>; continue: <update>; cond: <condition>; 成立时跳到 body
+                //条件按源代码的顺序分析，生成的指令再移到循环体之后，它们中间没有跳转目标；
+                //更新先跳过，分析完循环体再回来分析，它赋值的变量在循环体中不算已初始化
+                auto& body=_funInstruction[_instructionIndex];
+                auto& funins=body._funins;
+                if(!expect(TokenType::LEFT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
+                auto err=analyseAssignmentList(TokenType::SEMICOLON);
+                if(err.has_value())
+                    return err;
+                if(!expect(TokenType::SEMICOLON))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+
+                markOrigins();
+                std::size_t conditionBegin=funins.size();
+                bool hasCondition=peek().GetType()!=TokenType::SEMICOLON;
+                if(hasCondition){
+                    err=analyseCondition(TokenType::SEMICOLON);
+                    if(err.has_value())
+                        return err;
+                }
+                if(!expect(TokenType::SEMICOLON))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+                //读入 ';' 时已经记下了来源，指令和来源一起移走
+                std::vector<Instruction> condition(funins.begin()+conditionBegin,funins.end());
+                std::vector<int32_t> conditionOrigins(body._origins.begin()+conditionBegin,body._origins.end());
+                funins.resize(conditionBegin);
+                body._origins.resize(conditionBegin);
+
+                //跳到和 '(' 匹配的 ')'
+                std::size_t update=_offset;
+                for(int32_t depth=0;;consume()){
+                    auto type=peek().GetType();
+                    if(type==NULL_TOKEN)
+                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
+                    if(type==TokenType::LEFT_BRACKET)
+                        depth++;
+                    else if(type==TokenType::RIGHT_BRACKET&&depth--==0)
+                        break;
+                }
+                consume();
+
+                int32_t entry=funins.size();
+                if(hasCondition)
+                    funins.emplace_back(JMP,0,0);
+                int32_t loop=funins.size();
+                _jumps.push_back({true,{},{}});
+                err=analyseStatement();
+                if(err.has_value())
+                    return err;
+
+                markOrigins();
+                int32_t step=funins.size();
+                std::size_t resume=_offset;
+                _offset=update;
+                err=analyseAssignmentList(TokenType::RIGHT_BRACKET);
+                if(err.has_value())
+                    return err;
+                if(!expect(TokenType::RIGHT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
+                markOrigins();
+                _offset=resume;
+                if(hasCondition){
+                    funins[entry].SetX(funins.size());
+                    funins.insert(funins.end(),condition.begin(),condition.end());
+                    body._origins.insert(body._origins.end(),conditionOrigins.begin(),conditionOrigins.end());
+                    funins.back()=Instruction(invertJump(funins.back().GetOperation()),loop,0);
+                }
+                else
+                    funins.emplace_back(JMP,loop,0);
+                leaveJumpContext(funins.size(),step);
+                break;
+            }
+            case SWITCH:{//<condition-statement>::='switch' '(' <expression> ')' '{' {<labeled-statement>} '}'
+                //<labeled-statement>::='case' ['+'|'-']<integer-literal> ':' <statement-seq>|'default' ':' <statement-seq>
+                //和 C 一样，一个标签后面的语句执行完会落到下一个标签，用 break 跳出 switch
+                if(!expect(TokenType::LEFT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
+                auto err=analyseExpression();
+                if(err.has_value())
+                    return err;
+                if(!expect(TokenType::RIGHT_BRACKET))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
+                if(!expect(TokenType::LEFT_BRACE))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBrace);
+
+                //先扫描出所有标签，把分发代码放在标签的语句之前，不必先跳过语句再回来分发
+                auto labels=scanSwitchLabels();
+                std::map<int32_t,int32_t> values;//case 的值到第一个这个值的标签，重复的值分析到它时报错
+                for(int32_t i=(int32_t)labels.size()-1;i>=0;i--)
+                    if(!labels[i]._default)
+                        values[labels[i]._value]=i;
+                std::vector<std::pair<int32_t,int32_t>> cases(values.begin(),values.end());
+                std::vector<std::pair<int32_t,int32_t>> patches;
+                emitSwitchDispatch(cases,0,cases.size(),patches);
+
+                auto& funins=_funInstruction[_instructionIndex]._funins;
+                std::vector<int32_t> starts(labels.size(),-1);
+                std::set<int32_t> seen;
+                int32_t defaultLabel=-1;
+                std::size_t label=0;
+                _jumps.push_back({false,{},{}});
+                while(true){
+                    auto type=peek().GetType();
+                    if(type==NULL_TOKEN)
+                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBrace);
+                    if(type==TokenType::RIGHT_BRACE)
+                        break;
+                    if(type!=TokenType::CASE&&type!=TokenType::DEFAULT){
+                        err=analyseStatement();
+                        if(err.has_value())
+                            return err;
+                        continue;
+                    }
+                    consume();
+                    int32_t value=0;
+                    if(type==TokenType::CASE){
+                        auto n=peekCaseValue(0,value);
+                        if(n==0)
+                            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidCaseLabel);
+                        while(n-->0)
+                            consume();
+                        if(!seen.insert(value).second)
+                            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateCaseLabel);
+                    }
+                    else if(defaultLabel!=-1)
+                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateCaseLabel);
+                    else
+                        defaultLabel=label;
+                    if(!expect(TokenType::COLON))
+                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoColon);
+                    if(label>=labels.size()||labels[label]._default!=(type==TokenType::DEFAULT)||labels[label]._value!=value)
+                        DieAndPrint("The switch labels differ from the scanned ones.");
+                    starts[label++]=funins.size();
+                }
+                consume();
+
+                int32_t end=funins.size();
+                for(auto& [index,target] : patches)
+                    funins[index].SetX(target==-1?(defaultLabel==-1?end:starts[defaultLabel]):starts[target]);
+                leaveJumpContext(end,-1);
+                break;
+            }
+            case BREAK:
+            case CONTINUE:{//<jump-statement>::='break' ';'|'continue' ';'
+                //break 跳出最内层的循环或 switch，continue 跳到最内层的循环的下一次
+                auto context=_jumps.rbegin();
+                while(next.GetType()==TokenType::CONTINUE&&context!=_jumps.rend()&&!context->_loop)
+                    context++;
+                if(context==_jumps.rend())
+                    return std::make_optional<CompilationError>(_current_pos,
+                        next.GetType()==TokenType::BREAK?ErrorCode::ErrInvalidBreak:ErrorCode::ErrInvalidContinue);
+                auto& funins=_funInstruction[_instructionIndex]._funins;
+                (next.GetType()==TokenType::BREAK?context->_breaks:context->_continues).push_back(funins.size());
+                funins.emplace_back(JMP,0,0);
+                if(!expect(TokenType::SEMICOLON))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
                 break;
             }
             case RETURN:{//<jump-statement>::= 'return' [<expression>] ';'
-                next=nextToken();
-                if(!next.has_value())
+                auto type=peek().GetType();
+                if(type==NULL_TOKEN)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-                if(next.value().GetType()==TokenType::SEMICOLON){
+                if(type==TokenType::SEMICOLON){
+                    consume();
                     if(_fun[_instructionIndex]._haveReturnValue==1){//函数声明时有返回值
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedReturnValue);
                     }
@@ -496,30 +900,44 @@ namespace miniplc0 {
                         break;
                     }
                 }
-                else
-                    unreadToken();
                 auto err=analyseExpression();
                 if(err.has_value())
                     return err;
                 if(_fun[_instructionIndex]._haveReturnValue==0){//函数声明时无返回值
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoNeedReturnValue);
                 }
-                _funInstruction[_instructionIndex]._funins.emplace_back(IRET,0,0);
+                auto& funins=_funInstruction[_instructionIndex]._funins;
+                if(funins.back().GetOperation()==CALL && funins.back().GetX()==_instructionIndex){
+                    //尾递归：表达式的最后一条指令是对自身的调用，此时栈上是 [参数和局部变量, 实参]
+                    //把实参写回参数的位置，弹出实参和局部变量后跳回函数入口，不再新建栈帧
+                    funins.pop_back();
+                    int params=_fun[_instructionIndex]._params_size;
+                    int slots=_nextVarAddress-_indexTable[1];
+                    for(int k=0;k<params;k++){
+                        funins.emplace_back(LOADA,0,k);
+                        funins.emplace_back(LOADA,0,slots+k);
+                        funins.emplace_back(ILOAD,0,0);
+                        funins.emplace_back(ISTORE,0,0);
+                    }
+                    if(slots>0)
+                        funins.emplace_back(POPN,slots,0);
+                    funins.emplace_back(JMP,0,0);
+                }
+                else
+                    funins.emplace_back(IRET,0,0);
 
-                next=nextToken();
-                if(next.value().GetType()!=TokenType::SEMICOLON)
+                if(!expect(TokenType::SEMICOLON))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
                 break;
             }
             case SCAN:{//<scan-statement>::= 'scan' '(' <identifier> ')' ';'
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET)
+                if(!expect(TokenType::LEFT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::IDENTIFIER)
+                auto& identifier=consume();
+                if(identifier.GetType()!=TokenType::IDENTIFIER)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
 
-                auto preTokenStr=next.value().GetValueString();
+                auto preTokenStr=identifier.GetValueString();
                 int n=_var.size();
                 int addr=-1;
                 int index=-1;
@@ -542,11 +960,9 @@ namespace miniplc0 {
 
                 _var[index]._type=2;
 
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+                if(!expect(TokenType::RIGHT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::SEMICOLON)
+                if(!expect(TokenType::SEMICOLON))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrConstantNeedValue);
 
                 break;
@@ -554,22 +970,18 @@ namespace miniplc0 {
             case PRINT:{//<print-statement>::= 'print' '(' [<printable-list>] ')' ';'
                 // <printable-list> ::= <printable> {',' <printable>}
                 // <printable> ::= <expression>
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET)
+                if(!expect(TokenType::LEFT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoLeftBracket);
-                next=nextToken();
-                if(!next.has_value())
+                auto type=peek().GetType();
+                if(type==NULL_TOKEN)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-                else if(next.value().GetType()==TokenType::RIGHT_BRACKET){
+                else if(type==TokenType::RIGHT_BRACKET){
+                    consume();
                     _funInstruction[_instructionIndex]._funins.emplace_back(PRINTL,0,0);
-                    next=nextToken();
-                    if(!next.has_value()||next.value().GetType()!=TokenType::SEMICOLON)
+                    if(!expect(TokenType::SEMICOLON))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
                     break;
                 }
-                else{
-                    unreadToken();
-                }
                 auto err=analyseExpression();
                 if(err.has_value())
                     return err;
@@ -577,14 +989,12 @@ namespace miniplc0 {
                 _funInstruction[_instructionIndex]._funins.emplace_back(IPRINT,0,0);
 
                 while (true){
-                    next=nextToken();
-                    if(!next.has_value())
+                    auto type=peek().GetType();
+                    if(type==NULL_TOKEN)
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-                    if(next.value().GetType()==TokenType::RIGHT_BRACKET){
-                        unreadToken();
+                    if(type==TokenType::RIGHT_BRACKET)
                         break;
-                    }
-                    if(next.value().GetType()!=TokenType::COMMA)
+                    if(!expect(TokenType::COMMA))
                         return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
                     _funInstruction[_instructionIndex]._funins.emplace_back(BIPUSH,32,0);
                     _funInstruction[_instructionIndex]._funins.emplace_back(CPRINT,0,0);
@@ -594,66 +1004,17 @@ namespace miniplc0 {
                     _funInstruction[_instructionIndex]._funins.emplace_back(IPRINT,0,0);
                 }
                 _funInstruction[_instructionIndex]._funins.emplace_back(PRINTL,0,0);
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+                if(!expect(TokenType::RIGHT_BRACKET))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::SEMICOLON)
+                if(!expect(TokenType::SEMICOLON))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
                 break;
             }
             case IDENTIFIER:{//<assignment-expression>';'|<function-call>';'
-                //<assignment-expression> ::=<identifier><assignment-operator><expression>
-                //<function-call> ::=<identifier> '(' [<expression-list>] ')'
-                auto preTokenStr=next.value().GetValueString();
-
-
-                next=nextToken();
-                if(!next.has_value())
-                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-                if(next.value().GetType()==TokenType::ASSIGNMENT_SIGN){
-
-                    int n=_var.size();
-                    int addr=-1;
-                    int index=-1;
-                    for(int i=n-1;i>=0;i--){
-                        if(preTokenStr==_var[i].getName()){
-                            index=i;
-                            break;
-                        }
-                    }
-                    if(index==-1)
-                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
-                    addr=_var[index].getAddress();
-                    if(_var[index]._type==0){
-                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
-                    }
-                    int _offset=0;
-                    int _level_diff=0;
-                    _offset=addr-_indexTable[_var[index].getLevel()];
-                    _level_diff=1-_var[index].getLevel();
-                    _funInstruction[_instructionIndex]._funins.emplace_back(LOADA,_level_diff,_offset);
-
-                    auto err=analyseExpression();
-                    if(err.has_value())
-                        return err;
-                    _funInstruction[_instructionIndex]._funins.emplace_back(ISTORE,0,0);
-                    _var[index]._type=2;
-                }
-                else if(next.value().GetType()==TokenType::LEFT_BRACKET){
-                    unreadToken();
-                    unreadToken();
-                    auto err=analyseFunctionCall();
-                    if(err.has_value())
-                        return err;
-                    _funInstruction[_instructionIndex]._funins.emplace_back(POP,0,0);
-                }
-                else
-                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
-
-                next=nextToken();
-//                std::cout<<next.value().GetValueString()<<std::endl;
-                if(!next.has_value()||next.value().GetType()!=TokenType::SEMICOLON)
+                auto err=analyseAssignmentOrCall(next);
+                if(err.has_value())
+                    return err;
+                if(!expect(TokenType::SEMICOLON))
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
                 break;
             }
@@ -665,21 +1026,188 @@ namespace miniplc0 {
         }
         return {};
 	}
+    //<assignment-expression> ::=<identifier><assignment-operator><expression>
+    //<function-call> ::=<identifier> '(' [<expression-list>] ')'
+    std::optional<CompilationError> Analyser::analyseAssignmentOrCall(const Token& identifier){
+        auto preTokenStr=identifier.GetValueString();
+        auto type=peek().GetType();
+        if(type==NULL_TOKEN)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
+        if(type==TokenType::ASSIGNMENT_SIGN){
+            consume();
+
+            int n=_var.size();
+            int addr=-1;
+            int index=-1;
+            for(int i=n-1;i>=0;i--){
+                if(preTokenStr==_var[i].getName()){
+                    index=i;
+                    break;
+                }
+            }
+            if(index==-1)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
+            addr=_var[index].getAddress();
+            if(_var[index]._type==0){
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
+            }
+            int _offset=0;
+            int _level_diff=0;
+            _offset=addr-_indexTable[_var[index].getLevel()];
+            _level_diff=1-_var[index].getLevel();
+            _funInstruction[_instructionIndex]._funins.emplace_back(LOADA,_level_diff,_offset);
+
+            auto err=analyseExpression();
+            if(err.has_value())
+                return err;
+            _funInstruction[_instructionIndex]._funins.emplace_back(ISTORE,0,0);
+            _var[index]._type=2;
+        }
+        else if(type==TokenType::LEFT_BRACKET){
+            auto err=analyseFunctionCall(identifier);
+            if(err.has_value())
+                return err;
+            //void 函数不会留下返回值
+            auto& call=_funInstruction[_instructionIndex]._funins.back();
+            if(_fun[call.GetX()]._haveReturnValue==1)
+                _funInstruction[_instructionIndex]._funins.emplace_back(POP,0,0);
+        }
+        else
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteStatement);
+
+        return {};
+    }
+
+    std::optional<CompilationError> Analyser::analyseAssignmentList(TokenType end){
+        if(peek().GetType()==end)
+            return {};
+        while(true){
+            auto& identifier=consume();
+            if(identifier.GetType()!=TokenType::IDENTIFIER)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
+            auto err=analyseAssignmentOrCall(identifier);
+            if(err.has_value())
+                return err;
+            if(peek().GetType()!=TokenType::COMMA)
+                return {};
+            consume();
+        }
+    }
+
+    void Analyser::leaveJumpContext(int32_t breakTarget, int32_t continueTarget){
+        auto& funins=_funInstruction[_instructionIndex]._funins;
+        for(auto index : _jumps.back()._breaks)
+            funins[index].SetX(breakTarget);
+        for(auto index : _jumps.back()._continues)
+            funins[index].SetX(continueTarget);
+        _jumps.pop_back();
+    }
+
+    std::vector<switchLabel> Analyser::scanSwitchLabels() {
+        std::vector<switchLabel> labels;
+        int32_t depth=1;
+        for(std::size_t k=0;depth>0;k++){
+            auto type=peek(k).GetType();
+            if(type==NULL_TOKEN)
+                break;
+            if(type==TokenType::LEFT_BRACE)
+                depth++;
+            else if(type==TokenType::RIGHT_BRACE)
+                depth--;
+            else if(depth==1&&type==TokenType::DEFAULT)
+                labels.push_back({true,0});
+            else if(depth==1&&type==TokenType::CASE){
+                int32_t value;
+                if(peekCaseValue(k+1,value)>0)
+                    labels.push_back({false,value});
+            }
+        }
+        return labels;
+    }
+
+    std::size_t Analyser::peekCaseValue(std::size_t k, int32_t& value) {
+        auto sign=peek(k).GetType();
+        std::size_t n=(sign==TokenType::PLUS_SIGN||sign==TokenType::MINUS_SIGN)?1:0;
+        auto& literal=peek(k+n);
+        if(literal.GetType()!=TokenType::INT_LITERAL)
+            return 0;
+        value=atoi(literal.GetValueString().c_str());
+        //和 ineg 一样按 uint32_t 回绕
+        if(sign==TokenType::MINUS_SIGN)
+            value=(int32_t)(0u-(uint32_t)value);
+        return n+1;
+    }
+
+    // 选择 switch 的分发方式：
+    // 一段 case 足够多并且足够密集时用 tableswitch，一次跳转就到达标签，
+    // 否则 case 不多时逐个比较，再多就按中间的值二分，两半再分别选择
+    static const std::size_t SWITCH_TABLE_MIN_CASES = 3;      // 跳转表至少包含的 case 数
+    static const std::int64_t SWITCH_TABLE_MAX_RATIO = 3;     // 跳转表的长度最多是 case 数的这么多倍
+    static const std::size_t SWITCH_CHAIN_MAX_CASES = 3;      // 逐个比较的最多 case 数
+
+    void Analyser::emitSwitchDispatch(const std::vector<std::pair<int32_t, int32_t>>& cases, std::size_t lo, std::size_t hi,
+            std::vector<std::pair<int32_t, int32_t>>& patches) {
+        auto& funins=_funInstruction[_instructionIndex]._funins;
+        auto jump=[&](int32_t label){
+            patches.emplace_back(funins.size(),label);
+            funins.emplace_back(JMP,0,0);
+        };
+        std::size_t n=hi-lo;
+        int64_t range=n==0?0:(int64_t)cases[hi-1].first-cases[lo].first+1;
+        if(n>=SWITCH_TABLE_MIN_CASES&&range<=SWITCH_TABLE_MAX_RATIO*(int64_t)n&&range<=UINT16_MAX){
+            //tableswitch 弹出栈顶，后面是默认分支和每个值的 jmp，没有 case 的值也跳到默认分支
+            funins.emplace_back(TABLESWITCH,cases[lo].first,(int32_t)range);
+            jump(-1);
+            std::size_t i=lo;
+            for(int64_t v=cases[lo].first;v<=cases[hi-1].first;v++)
+                jump(cases[i].first==v?cases[i++].second:-1);
+        }
+        else if(n<=SWITCH_CHAIN_MAX_CASES){
+            //dup; <和 case 比较>; jne 下一个; pop; jmp 标签
+            for(std::size_t i=lo;i<hi;i++){
+                funins.emplace_back(DUP,0,0);
+                if(cases[i].first!=0){
+                    funins.emplace_back(IPUSH,cases[i].first,0);
+                    funins.emplace_back(ICMP,0,0);
+                }
+                funins.emplace_back(JNE,(int32_t)funins.size()+3,0);
+                funins.emplace_back(POP,0,0);
+                jump(cases[i].second);
+            }
+            funins.emplace_back(POP,0,0);
+            jump(-1);
+        }
+        else{
+            //小于中间的值跳到前一半，否则落到后一半
+            auto mid=lo+n/2;
+            funins.emplace_back(DUP,0,0);
+            funins.emplace_back(IPUSH,cases[mid].first,0);
+            funins.emplace_back(ICMP,0,0);
+            auto less=funins.size();
+            funins.emplace_back(JL,0,0);
+            emitSwitchDispatch(cases,mid,hi,patches);
+            funins[less].SetX(funins.size());
+            emitSwitchDispatch(cases,lo,mid,patches);
+        }
+    }
+
 	//<condition> ::= <expression>[<relational-operator><expression>]
 	//<relational-operator> ::= '<' | '<=' | '>' | '>=' | '!=' | '=='
-    std::optional<CompilationError> Analyser::analyseCondition(){//'(' <condition> ')'
+    std::optional<CompilationError> Analyser::analyseCondition(TokenType end){//'(' <condition> ')'
+	    SampleScope scope(__func__);
 	    auto err=analyseExpression();
 	    if(err.has_value())
             return err;
-	    auto next=nextToken();
-	    if(!next.has_value())
+	    auto type=peek().GetType();
+	    if(type==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
-        switch (next.value().GetType()){
-            case RIGHT_BRACKET:{
-                _funInstruction[_instructionIndex]._funins.emplace_back(JE,0,0);
-                unreadToken();
-                break;
-            }
+        //end 留给调用者读入
+        if(type==end){
+            _funInstruction[_instructionIndex]._funins.emplace_back(JE,0,0);
+            return {};
+        }
+        consume();
+        switch (type){
             case LESS_SIGN:{
                 err=analyseExpression();
                 if(err.has_value())
@@ -754,32 +1282,30 @@ namespace miniplc0 {
     //<unary-expression> ::= [<unary-operator>]<primary-expression>
     //<primary-expression> ::= '('<expression>')' |<identifier> |<integer-literal> |<function-call>
     std::optional<CompilationError> Analyser::analyseExpression() {
+        SampleScope scope(__func__);
         auto err=analyseMultiplicativeExpression();
         if(err.has_value())
             return err;
         while (true){
-            auto next=nextToken();
-            if(!next.has_value())
-                return {};
-            if(next.value().GetType()!=TokenType::PLUS_SIGN && next.value().GetType()!=TokenType::MINUS_SIGN){
-                unreadToken();
+            auto type=peek().GetType();
+            if(type!=TokenType::PLUS_SIGN && type!=TokenType::MINUS_SIGN)
                 return {};
-            }
+            consume();
             err=analyseMultiplicativeExpression();
             if(err.has_value())
                 return err;
 
             if(_instructionIndex==-1){
-                if (next.value().GetType() == TokenType::PLUS_SIGN)
+                if (type == TokenType::PLUS_SIGN)
                     _start.emplace_back(Operation::IADD, 0, 0);
-                else if (next.value().GetType() == TokenType::MINUS_SIGN)
+                else if (type == TokenType::MINUS_SIGN)
                     _start.emplace_back(Operation::ISUB, 0, 0);
             }
             else{
-                if (next.value().GetType() == TokenType::PLUS_SIGN)
+                if (type == TokenType::PLUS_SIGN)
                     _funInstruction[_instructionIndex]._funins.emplace_back(IADD,0,0);
 //                    _instructions.emplace_back(Operation::IADD, 0, 0);
-                else if (next.value().GetType() == TokenType::MINUS_SIGN)
+                else if (type == TokenType::MINUS_SIGN)
                     _funInstruction[_instructionIndex]._funins.emplace_back(ISUB,0,0);
 //                    _instructions.emplace_back(Operation::ISUB, 0, 0);
             }
@@ -787,33 +1313,31 @@ namespace miniplc0 {
         return {};
     }
     std::optional<CompilationError> Analyser::analyseMultiplicativeExpression() {
+        SampleScope scope(__func__);
         auto err=analyseUnaryExpression();
         if(err.has_value())
             return err;
         while (true){
-            auto next=nextToken();
-            if(!next.has_value())
-                return {};
-            if(next.value().GetType()!=TokenType::MULTIPLICATION_SIGN && next.value().GetType()!=TokenType::DIVISION_SIGN){
-                unreadToken();
+            auto type=peek().GetType();
+            if(type!=TokenType::MULTIPLICATION_SIGN && type!=TokenType::DIVISION_SIGN)
                 return {};
-            }
+            consume();
             err=analyseUnaryExpression();
             if(err.has_value())
                 return err;
 
             //根据结果生成指令
             if(_instructionIndex==-1){
-                if (next.value().GetType() == TokenType::MULTIPLICATION_SIGN)
+                if (type == TokenType::MULTIPLICATION_SIGN)
                     _start.emplace_back(Operation::IMUL, 0, 0);
-                else if (next.value().GetType() == TokenType::DIVISION_SIGN)
+                else if (type == TokenType::DIVISION_SIGN)
                     _start.emplace_back(Operation::IDIV, 0, 0);
             }
             else{
-                if (next.value().GetType() == TokenType::MULTIPLICATION_SIGN)
+                if (type == TokenType::MULTIPLICATION_SIGN)
                     _funInstruction[_instructionIndex]._funins.emplace_back(IMUL,0,0);
 //                    _instructions.emplace_back(Operation::IMUL, 0, 0);
-                else if (next.value().GetType() == TokenType::DIVISION_SIGN)
+                else if (type == TokenType::DIVISION_SIGN)
                     _funInstruction[_instructionIndex]._funins.emplace_back(IDIV,0,0);
 //                    _instructions.emplace_back(Operation::IDIV, 0, 0);
             }
@@ -822,35 +1346,36 @@ namespace miniplc0 {
     }
     //<unary-expression> ::= [<unary-operator>]'('<expression>')' |<identifier> |<integer-literal> |<function-call>
     std::optional<CompilationError> Analyser::analyseUnaryExpression() {
-        auto next=nextToken();
+        SampleScope scope(__func__);
         auto prefix=1;
-        if(!next.has_value())
+        auto type=peek().GetType();
+        if(type==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteExpression);
-        if(next.value().GetType()==TokenType::PLUS_SIGN)
+        if(type==TokenType::PLUS_SIGN){
             prefix=1;
-        else if (next.value().GetType() == TokenType::MINUS_SIGN) {
+            consume();
+        }
+        else if (type == TokenType::MINUS_SIGN) {
             prefix = -1;
+            consume();
             //_instructions.emplace_back(Operation::NOP, 0);          //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
         }
-        else
-            unreadToken();
-        next=nextToken();
-        if (!next.has_value())
+        auto& next=consume();
+        if (next.GetType()==NULL_TOKEN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteExpression);
-        switch (next.value().GetType()){
+        switch (next.GetType()){
             case LEFT_BRACKET:{
                 auto err=analyseExpression();
                 if(err.has_value()){
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteExpression);
                 }
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET){
+                if(!expect(TokenType::RIGHT_BRACKET)){
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteExpression);
                 }
                 break;
             }
             case INT_LITERAL:{
-                int32_t x=atoi(next.value().GetValueString().c_str());
+                int32_t x=atoi(next.GetValueString().c_str());
                 if(_instructionIndex==-1){
                     _start.emplace_back(IPUSH,x,0);
                 }
@@ -861,11 +1386,8 @@ namespace miniplc0 {
                 break;
             }
             case IDENTIFIER:{
-                auto preToken=next;         //preToken是标识符identifer
-                auto preTokenStr=preToken.value().GetValueString();
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET){//<unary-expression>:=[<unary-operator>]<identifier>
-                    unreadToken();
+                if(peek().GetType()!=TokenType::LEFT_BRACKET){//<unary-expression>:=[<unary-operator>]<identifier>
+                    auto preTokenStr=next.GetValueString();
                     int n=_var.size();
                     int addr=-1;
                     int index=-1;
@@ -905,9 +1427,7 @@ namespace miniplc0 {
                     }
                 }
                 else{//<unary-expression>:=<function-call> ::= <identifier> '(' [<expression-list>] ')'
-                    unreadToken();
-                    unreadToken();
-                    auto err=analyseFunctionCall();
+                    auto err=analyseFunctionCall(next);
                     if(err.has_value())
                         return err;
                 }
@@ -930,65 +1450,56 @@ namespace miniplc0 {
 
     //<function-call> ::= <identifier> '(' [<expression-list>] ')'
     //<expression-list> ::= <expression>{','<expression>}
-    std::optional<CompilationError> Analyser::analyseFunctionCall() {
+    std::optional<CompilationError> Analyser::analyseFunctionCall(const Token& funToken) {
+	    SampleScope scope(__func__);
 	    int params=0;
-        auto next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::IDENTIFIER)
-            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
-        auto funToken=next;
-
+        auto funName=funToken.GetValueString();
+        //调用者已经向前看过 '('，函数名的错误报告在函数名的末尾
+        auto namePos=funToken.GetEndPos();
 
         int n=_var.size();
         int index=-1;
         for(int i=n-1;i>=0;i--){
-            if(funToken.value().GetValueString()==_var[i].getName()){
+            if(funName==_var[i].getName()){
                 index=i;
                 break;
             }
         }
         if(index!=-1)
-            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteFunctionCall);
+            return std::make_optional<CompilationError>(namePos, ErrorCode::ErrIncompleteFunctionCall);
 
-        int nf=_fun.size();
+        int nf=_visibleFunctions;
         bool haveFunction= false;
         for(int i=0;i<nf;i++){
-            if(funToken.value().GetValueString()==_fun[i]._value)
+            if(funName==_fun[i]._value)
                 haveFunction=true;
         }
 
         if(!haveFunction)
-            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteFunctionCall);
+            return std::make_optional<CompilationError>(namePos, ErrorCode::ErrIncompleteFunctionCall);
 
-        next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::LEFT_BRACKET)
+        if(!expect(TokenType::LEFT_BRACKET))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteFunctionCall);
-        next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET){
-            unreadToken();
+        if(peek().GetType()!=TokenType::RIGHT_BRACKET){
             auto err=analyseExpression();
             if(err.has_value())
                 return err;
             params++;
-            while (true){
-                next=nextToken();
-                if(!next.has_value()||next.value().GetType()!=TokenType::COMMA){
-                    unreadToken();
-                    break;
-                }
+            while (peek().GetType()==TokenType::COMMA){
+                consume();
                 err=analyseExpression();
                 if(err.has_value())
                     return err;
                 params++;
             }
         }
-        next=nextToken();
-        if(!next.has_value()||next.value().GetType()!=TokenType::RIGHT_BRACKET)
+        if(!expect(TokenType::RIGHT_BRACKET))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIncompleteFunctionCall);
 
-        nf=_fun.size();
+        nf=_visibleFunctions;
         int tmpIndex=-1;
         for(int i=0;i<nf;i++){
-            if(funToken.value().GetValueString()==_fun[i]._value)
+            if(funName==_fun[i]._value)
                 tmpIndex=i;
         }
 
@@ -1000,20 +1511,48 @@ namespace miniplc0 {
     }
 
 
-	std::optional<Token> Analyser::nextToken() {
-		if (_offset == _tokens.size())
-			return {};
+	// 读到末尾之后返回的哨兵
+	static const Token& endOfTokens() {
+		static const Token end(TokenType::NULL_TOKEN, std::any(), 0, 0, 0, 0);
+		return end;
+	}
+
+	const Token& Analyser::peek(std::size_t k) {
+		auto& tokens = *_source;
+		if (_offset == tokens.size())
+			return endOfTokens();
+		// 和读入再回退一样，当前位置停在下一个 token 的末尾，向前看之后立即报错时位置不变
+		_current_pos = tokens[_offset].GetEndPos();
+		if (_offset + k >= tokens.size())
+			return endOfTokens();
+		return tokens[_offset + k];
+	}
+
+	const Token& Analyser::consume() {
+		markOrigins();
+		auto& tokens = *_source;
+		if (_offset == tokens.size())
+			return endOfTokens();
 		// 考虑到 _tokens[0..._offset-1] 已经被分析过了
 		// 所以我们选择 _tokens[0..._offset-1] 的 EndPos 作为当前位置
-		_current_pos = _tokens[_offset].GetEndPos();
-		return _tokens[_offset++];
+		_current_pos = tokens[_offset].GetEndPos();
+		SetSampleLine(_current_pos.first);
+		return tokens[_offset++];
+	}
+
+	bool Analyser::expect(TokenType type) {
+		return consume().GetType() == type;
 	}
 
-	void Analyser::unreadToken() {
-		if (_offset == 0)
-			DieAndPrint("analyser unreads token from the begining.");
-		_current_pos = _tokens[_offset - 1].GetEndPos();
-		_offset--;
+	void Analyser::markOrigins() {
+		// 上次读 token 之后生成的指令都来自最后读到的 token
+		auto origin = (int32_t)_offset - 1;
+		if (_instructionIndex == -1)
+			_startOrigins.resize(_start.size(), origin);
+		else if (_instructionIndex < (int32_t)_funInstruction.size()) {
+			auto& body = _funInstruction[_instructionIndex];
+			body._origins.resize(body._funins.size(), origin);
+		}
 	}
 
 
@@ -1093,7 +1632,7 @@ namespace miniplc0 {
         return false;
 	}
     bool Analyser::isFunctionName(const std::string&s) {
-        int n=_fun.size();
+        int n=_visibleFunctions;
         for(int i=0;i<n;i++){
             if(s==_fun[i]._value&&_instructionIndex==i)
                 return true;
@@ -1104,6 +1643,15 @@ namespace miniplc0 {
     std::vector<Instruction> Analyser::getStartCode(){
         return _start;
 	}
+    frameInfo Analyser::getStartFrame(){
+        return _startFrame;
+    }
+    globalData Analyser::getGlobalData(){
+        return _data;
+    }
+    std::vector<LineTable> Analyser::getLineTables(){
+        return _lines;
+    }
     std::vector<variableTable> Analyser::getVarTable(){
         return _var;
 	}
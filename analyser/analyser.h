@@ -4,11 +4,18 @@
 #include "instruction/instruction.h"
 #include "tokenizer/token.h"
 #include "systable/systable.h"
+#include "optimizer/optimizer.h"
+#include "cache/cache.h"
+#include "debug/linetable.h"
+#include "profiler/sampler.h"
+#include "profiler/trace.h"
+#include "profiler/allocation.h"
 
 #include <vector>
 #include <optional>
 #include <utility>
 #include <map>
+#include <unordered_map>
 #include <cstdint>
 #include <cstddef> // for std::size_t
 
@@ -34,39 +41,87 @@ namespace miniplc0 {
 //        int32_t operands;       //操作数
 //    };
 
+	// 预扫描得到的函数信息，函数体之后再单独分析
+	class functionSignature {
+	public:
+		std::vector<variableTable> _params;     //参数，地址紧接在全局变量之后
+		std::size_t _body;                      //函数体第一个 token（'{'）的下标
+		std::size_t _end;                       //按括号匹配得到的函数体之后的第一个 token 的下标
+	};
+
+	// 预扫描得到的 switch 的标签
+	class switchLabel {
+	public:
+		bool _default;                          //default，否则是 case
+		std::int32_t _value;                    //case 的值
+	};
+
+	// 正在分析的 switch 或循环，break 和 continue 生成的 jmp 在它结束时回填
+	class jumpContext {
+	public:
+		bool _loop;                             //循环，否则是 switch
+		std::vector<std::int32_t> _breaks;      //break 生成的 jmp 的下标
+		std::vector<std::int32_t> _continues;   //continue 生成的 jmp 的下标，只有循环有
+	};
+
 	class Analyser final {
 	private:
 		using uint64_t = std::uint64_t;
 		using int64_t = std::int64_t;
 		using uint32_t = std::uint32_t;
 		using int32_t = std::int32_t;
+		// 测试直接检查 token 缓冲区的操作
+		friend class AnalyserTest;
 	public:
 		Analyser(std::vector<Token> v)
 			: _tokens(std::move(v)), _offset(0), _instructions({}), _current_pos(0, 0),
-			_var({}),_start({}),_fun({}),_indexTable({}), _nextTokenIndex(0),
-			_nextVarAddress(0),_instructionIndex(-1) {}
+			_var({}),_start({}),_fun({}),_indexTable({}), _threads(0), _cache(nullptr), _visibleFunctions(0), _nextTokenIndex(0),
+			_nextVarAddress(0),_instructionIndex(-1) { _source = &_tokens; }
 		Analyser(Analyser&&) = delete;
 		Analyser(const Analyser&) = delete;
 		Analyser& operator=(Analyser) = delete;
 
 		// 唯一接口
 		std::pair<std::vector<functionBodyTable>, std::optional<CompilationError>> Analyse();
+		// 设置 Analyse 结束后对函数体做的优化
+		void SetOptions(const optimizeOptions& options) { _options = options; }
+		// 并行分析函数体使用的线程数，0 表示使用硬件线程数，结果与线程数无关
+		void SetThreads(unsigned int threads) { _threads = threads; }
+		// 增量编译使用的缓存，签名和函数体都没有变的函数直接使用缓存的字节码，新分析的函数体会加入缓存
+		void SetCache(FunctionCache* cache) { _cache = cache; }
         std::vector<Instruction> getStartCode();
+        frameInfo getStartFrame();
+        // .start 开头能在编译时算出来的全局变量
+        globalData getGlobalData();
+        // 行号表，下标 0 为 .start，i+1 为第 i 个函数，与优化之后的指令对应
+        std::vector<LineTable> getLineTables();
         std::vector<variableTable> getVarTable();
         std::vector<functionsTable> getFunctionTable();
 
 	private:
+		// 并行分析函数体时使用的副本，共享 parent 的 token 和函数表
+		explicit Analyser(const Analyser* parent);
+
 		// 所有的递归子程序
 
         //<C0-program>
         std::optional<CompilationError> analyseC0Program();
         // <变量声明>
         std::optional<CompilationError> analyseVariableDeclaration(bool isGlobal);
-        //<函数定义>
+        //<函数定义>，只分析函数头，跳过函数体
         std::optional<CompilationError> analyseFunctionDefinition();
+        // 分析所有函数体，按声明顺序合并结果，返回声明顺序上的第一个错误
+        std::optional<CompilationError> analyseFunctionBodies();
+        // 以 globals 为全局变量表分析第 index 个函数的函数体
+        std::optional<CompilationError> analyseFunctionBody(int32_t index, const std::vector<variableTable>& globals);
+        // 第 index 个函数在缓存中的键：函数头、函数体的 token，以及函数体中的标识符对应的全局变量和函数
+        // names 为名字到全局变量表下标（非负）和函数下标（按位取反）的映射
+        uint64_t functionKey(int32_t index, const std::vector<variableTable>& globals,
+            const std::unordered_multimap<std::string, int32_t>& names) const;
 		//<init-declarator> ::= <identifier>['='<expression>]
 		std::optional<CompilationError> analyseInitDeclarator(bool isConstant, bool isGlobal);
-        std::optional<CompilationError> analyseFunctionCall();
+        // 函数名 funToken 已经读入
+        std::optional<CompilationError> analyseFunctionCall(const Token& funToken);
 
 		std::optional<CompilationError> analyseExpression();
         std::optional<CompilationError> analyseMultiplicativeExpression();
@@ -79,7 +134,24 @@ namespace miniplc0 {
         std::optional<CompilationError> analyseStatementSeq();
         std::optional<CompilationError> analyseStatement();
 
-        std::optional<CompilationError> analyseCondition();
+        // 条件之后的 end（')'，for 中是 ';'）留给调用者读入
+        std::optional<CompilationError> analyseCondition(TokenType end = TokenType::RIGHT_BRACKET);
+        // 标识符 identifier 已经读入，函数调用的返回值被弹出
+        std::optional<CompilationError> analyseAssignmentOrCall(const Token& identifier);
+        // for 中逗号分隔的 <assignment-expression>|<function-call>，可以为空，end 留给调用者读入
+        std::optional<CompilationError> analyseAssignmentList(TokenType end);
+        // 用 break 和 continue 的目标回填最内层的 switch 或循环，然后退出它
+        void leaveJumpContext(int32_t breakTarget, int32_t continueTarget);
+
+        // switch 的 '{' 已经读入，按出现顺序返回属于这个 switch 的标签，嵌套的 '{' '}' 中的不算
+        // case 后面不是整数字面量的不返回，正式分析到它时报错
+        std::vector<switchLabel> scanSwitchLabels();
+        // 从第 k 个还没有读入的 token 开始的 ['+'|'-']<integer-literal>，返回占用的 token 数，不是时返回 0
+        std::size_t peekCaseValue(std::size_t k, int32_t& value);
+        // 栈顶是 switch 的值，为按值排序的 (值, 标签下标) 中的 [lo, hi) 生成分发代码，弹出栈顶后跳到对应的标签
+        // 跳到标签的 jmp 的下标和标签下标（-1 为 default）记录在 patches 中，分析完 switch 之后回填
+        void emitSwitchDispatch(const std::vector<std::pair<int32_t, int32_t>>& cases, std::size_t lo, std::size_t hi,
+            std::vector<std::pair<int32_t, int32_t>>& patches);
 
 
 
@@ -88,10 +160,16 @@ namespace miniplc0 {
         std::optional<CompilationError> analyseConstantExpression(int32_t& out);
 		// Token 缓冲区相关操作
 
-		// 返回下一个 token
-		std::optional<Token> nextToken();
-		// 回退一个 token
-		void unreadToken();
+		// 返回的都是 token 数组中的引用，不拷贝 token；已经到末尾时返回类型为 NULL_TOKEN 的哨兵
+
+		// 向前看第 k 个还没有读入的 token，不读入
+		const Token& peek(std::size_t k = 0);
+		// 读入下一个 token，已经到末尾时不移动
+		const Token& consume();
+		// 读入下一个 token，返回它是不是 type，不是时调用者用 _current_pos 报错
+		bool expect(TokenType type);
+		// 把当前代码中还没有来源的指令记为来自最后读到的 token，每次读入 token 之前调用
+		void markOrigins();
 
 		// 下面是符号表相关操作
 
@@ -117,18 +195,30 @@ namespace miniplc0 {
 		int32_t getIndex(const std::string&,int32_t level);
 	private:
 		std::vector<Token> _tokens;
+		const std::vector<Token>* _source;      //实际读取的 token，副本指向 parent 的 _tokens
 		std::size_t _offset;
 		std::vector<Instruction> _instructions;
 		std::pair<uint64_t, uint64_t> _current_pos;
 
 		std::vector<variableTable> _var;
 		std::vector<Instruction> _start;
+		std::vector<int32_t> _startOrigins;
+		frameInfo _startFrame;
+		globalData _data;
+		std::vector<LineTable> _lines;
         std::vector<functionsTable> _fun;
         std::vector<std::vector<Instruction>> _fun_body;
         std::vector<functionBodyTable> _funInstruction;
 
 		std::vector<int32_t> _indexTable;
 
+		optimizeOptions _options;
+		unsigned int _threads;
+		FunctionCache* _cache;
+
+		std::vector<functionSignature> _signatures;
+		// 当前函数体中可以调用的函数个数（只能调用声明在前面的函数和自身）
+		int32_t _visibleFunctions;
 
 		// 下一个 token 在栈的偏移
 		int32_t _nextTokenIndex;
@@ -136,5 +226,7 @@ namespace miniplc0 {
 		int32_t _nextVarAddress;
 		//函数指令集的索引，为-1则是全局初始化，否则是对应函数的指令集的索引
 		int32_t _instructionIndex;
+		// 包围当前语句的 switch 和循环，最后一个是最内层的
+		std::vector<jumpContext> _jumps;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "fmt/core.h"
+
+#include "fmts.hpp"
+#include "listing.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 文本汇编输出的吞吐量（行/秒）
+// 用法：cc0-bench-listing [输出文件] [函数个数] [每个函数的指令数]
+// 对比逐行 fmt::format + std::endl 的旧写法和 WriteListing
+
+static std::vector<miniplc0::Instruction> makeCode(int32_t n) {
+	std::vector<miniplc0::Instruction> code;
+	for (int32_t i = 0; i < n; i++) {
+		switch (i % 6) {
+			case 0: code.emplace_back(miniplc0::LOADA, 0, i % 16); break;
+			case 1: code.emplace_back(miniplc0::ILOAD, 0, 0); break;
+			case 2: code.emplace_back(miniplc0::IPUSH, i * 7919, 0); break;
+			case 3: code.emplace_back(miniplc0::IADD, 0, 0); break;
+			case 4: code.emplace_back(miniplc0::JGE, i / 2, 0); break;
+			case 5: code.emplace_back(miniplc0::CALL, i % 100, 0); break;
+		}
+	}
+	return code;
+}
+
+// 改写之前 main.cpp 中 Analyse 的写法
+static void writeNaive(std::ostream& output, const std::vector<miniplc0::constantInfo>& constants,
+		const std::vector<miniplc0::functionInfo>& functions, const std::vector<std::vector<miniplc0::Instruction>>& bodies) {
+	output << ".constants:" << std::endl;
+	for (std::size_t i = 0; i < constants.size(); i++)
+		output << i << "  " << constants[i]._type << "  " << "\"" << constants[i]._value << "\"" << std::endl;
+	output << ".start:" << std::endl;
+	output << ".functions:" << std::endl;
+	for (std::size_t i = 0; i < functions.size(); i++)
+		output << i << "  " << functions[i]._name_index << "  " << functions[i]._params_size << "  " << functions[i]._level << std::endl;
+	for (std::size_t i = 0; i < bodies.size(); i++) {
+		output << ".F" << i << ":" << std::endl;
+		for (std::size_t j = 0; j < bodies[i].size(); j++)
+			output << j << " " << fmt::format("{}", bodies[i][j]) << std::endl;
+	}
+}
+
+template <typename F>
+static double seconds(F f) {
+	auto begin = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char** argv) {
+	std::string path = argc > 1 ? argv[1] : "/dev/null";
+	int32_t functions_count = argc > 2 ? std::stoi(argv[2]) : 1000;
+	int32_t instructions_count = argc > 3 ? std::stoi(argv[3]) : 1000;
+
+	std::vector<miniplc0::constantInfo> constants;
+	std::vector<miniplc0::functionInfo> functions;
+	std::vector<std::vector<miniplc0::Instruction>> bodies;
+	for (int32_t i = 0; i < functions_count; i++) {
+		constants.push_back({ "S", fmt::format("fun{}", i) });
+		functions.push_back({ i, i % 4, 1, instructions_count, 0 });
+		bodies.push_back(makeCode(instructions_count));
+	}
+	std::vector<miniplc0::Instruction> start;
+	double lines = 3.0 + 2.0 * functions_count + (double)functions_count * instructions_count;
+
+	std::ofstream naive(path, std::ios::out | std::ios::trunc);
+	double t1 = seconds([&]() { writeNaive(naive, constants, functions, bodies); });
+	naive.close();
+
+	std::ofstream buffered(path, std::ios::out | std::ios::trunc);
+	double t2 = seconds([&]() {
+		miniplc0::WriteListing(buffered, constants, start, functions,
+			[&bodies](std::size_t i) -> const std::vector<miniplc0::Instruction>& { return bodies[i]; });
+	});
+
+	fmt::print("{} lines\n", (int64_t)lines);
+	fmt::print("std::endl per line: {:.3f}s  {:.0f} lines/s\n", t1, lines / t1);
+	fmt::print("WriteListing:       {:.3f}s  {:.0f} lines/s\n", t2, lines / t2);
+	return 0;
+}
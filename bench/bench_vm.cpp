@@ -0,0 +1,103 @@
+#include "fmt/core.h"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "vm/vm.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 栈顶缓存的解释器和逐条读写内存的 switch 解释器的对比
+// 用法：cc0-bench-vm [循环次数] [表达式个数]
+// 生成以算术表达式为主的 C0 程序，两种解释器分别执行，输出必须一致
+
+// 固定种子的线性同余，保证每次生成同样的程序
+static uint32_t nextRandom(uint32_t& seed) {
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 8;
+}
+
+static std::string makeExpression(uint32_t& seed, int32_t depth) {
+	static const char* leaves[] = { "a", "b", "s", "i" };
+	if (depth == 0 || nextRandom(seed) % 4 == 0) {
+		if (nextRandom(seed) % 3 == 0)
+			return std::to_string(nextRandom(seed) % 97 + 1);
+		return leaves[nextRandom(seed) % 4];
+	}
+	auto lhs = makeExpression(seed, depth - 1);
+	auto rhs = makeExpression(seed, depth - 1);
+	switch (nextRandom(seed) % 4) {
+		case 0: return "(" + lhs + "+" + rhs + ")";
+		case 1: return "(" + lhs + "-" + rhs + ")";
+		case 2: return "(" + lhs + "*" + rhs + ")";
+		// 除数保证不为 0
+		default: return "(" + lhs + "/(" + rhs + "*" + rhs + "+1))";
+	}
+}
+
+static std::string makeSource(int32_t iterations, int32_t expressions) {
+	uint32_t seed = 20191219;
+	std::string source = "int n = " + std::to_string(iterations) + ";\n";
+	source += "int mix(int a, int b) {\n\tint s = a;\n\tint i = b;\n";
+	for (int32_t k = 0; k < expressions; k++)
+		source += "\ts = " + makeExpression(seed, 4) + ";\n";
+	source += "\treturn s;\n}\n";
+	source += "int main() {\n\tint i = 0;\n\tint a = 1;\n\tint b = 2;\n\tint s = 0;\n";
+	source += "\twhile (i < n) {\n";
+	for (int32_t k = 0; k < expressions; k++)
+		source += "\t\t" + std::string(k % 2 ? "a" : "b") + " = " + makeExpression(seed, 4) + ";\n";
+	source += "\t\tif (a > b) s = s + mix(a, b); else s = s - mix(b, a);\n";
+	source += "\t\ti = i + 1;\n\t}\n\tprint(s, a, b);\n\treturn 0;\n}\n";
+	return source;
+}
+
+template <typename F>
+static double seconds(F f) {
+	auto begin = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char** argv) {
+	int32_t iterations = argc > 1 ? std::stoi(argv[1]) : 1000000;
+	int32_t expressions = argc > 2 ? std::stoi(argv[2]) : 8;
+
+	std::stringstream ss(makeSource(iterations, expressions));
+	miniplc0::Tokenizer tkz(ss);
+	auto tks = tkz.AllTokens();
+	if (tks.second.has_value()) {
+		fmt::print("tokenize error\n");
+		return 1;
+	}
+	miniplc0::Analyser analyser(tks.first);
+	auto p = analyser.Analyse();
+	if (p.second.has_value()) {
+		fmt::print("analyse error\n");
+		return 1;
+	}
+
+	std::string outputs[2];
+	double times[2];
+	for (int i = 0; i < 2; i++) {
+		miniplc0::VM vm(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p.first, analyser.getGlobalData());
+		if (!vm.IsVerified() || !vm.IsPreallocated()) {
+			fmt::print("program is not verified\n");
+			return 1;
+		}
+		vm.SetStackCaching(i == 1);
+		std::stringstream in, out;
+		times[i] = seconds([&]() { vm.Run(in, out); });
+		outputs[i] = out.str();
+	}
+	if (outputs[0] != outputs[1]) {
+		fmt::print("outputs differ:\n{}{}", outputs[0], outputs[1]);
+		return 1;
+	}
+
+	fmt::print("{} iterations, {} expressions per loop\n", iterations, expressions);
+	fmt::print("switch:        {:.3f}s\n", times[0]);
+	fmt::print("stack caching: {:.3f}s  {:.2f}x\n", times[1], times[0] / times[1]);
+	return 0;
+}
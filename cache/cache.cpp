@@ -0,0 +1,101 @@
+#include "cache/cache.h"
+#include "instruction/opcode.h"
+
+#include <sstream>
+
+namespace miniplc0 {
+
+	// 缓存文件是文本格式，第一行是版本，之后每行一个函数：
+	// key slots assigned_count assigned... instruction_count { opcode x y }... { origin }...
+	static const char CACHE_HEADER[] = "cc0-function-cache 2";
+
+	bool FunctionCache::Load(std::istream& input) {
+		_entries.clear();
+		std::string line;
+		if (!std::getline(input, line) || line != CACHE_HEADER)
+			return false;
+		while (std::getline(input, line)) {
+			std::istringstream ss(line);
+			uint64_t key;
+			std::size_t count;
+			cachedFunction value;
+			if (!(ss >> std::hex >> key >> std::dec >> value._slots >> count)) {
+				_entries.clear();
+				return false;
+			}
+			value._assigned.resize(count);
+			for (auto& it : value._assigned)
+				ss >> it;
+			ss >> count;
+			for (std::size_t i = 0; i < count && ss; i++) {
+				uint32_t op;
+				int32_t x, y;
+				ss >> op >> x >> y;
+				if (op > 0xff || !opcodeOf(op).isDefined())
+					break;
+				value._funins.emplace_back((Operation)op, x, y);
+			}
+			value._origins.resize(value._funins.size());
+			for (auto& it : value._origins)
+				ss >> it;
+			if (!ss || value._funins.size() != count) {
+				_entries.clear();
+				return false;
+			}
+			_entries[key] = entry{ std::move(value), false };
+		}
+		return true;
+	}
+
+	void FunctionCache::Save(std::ostream& output) const {
+		output << CACHE_HEADER << '\n';
+		for (auto& it : _entries) {
+			if (!it.second._used)
+				continue;
+			auto& value = it.second._value;
+			output << std::hex << it.first << std::dec << ' ' << value._slots << ' ' << value._assigned.size();
+			for (auto g : value._assigned)
+				output << ' ' << g;
+			output << ' ' << value._funins.size();
+			for (auto& ins : value._funins)
+				output << ' ' << (uint32_t)ins.GetOperation() << ' ' << ins.GetX() << ' ' << ins.GetY();
+			for (auto origin : value._origins)
+				output << ' ' << origin;
+			output << '\n';
+		}
+	}
+
+	std::optional<cachedFunction> FunctionCache::Find(uint64_t key) {
+		auto it = _entries.find(key);
+		if (it == _entries.end()) {
+			_misses++;
+			return {};
+		}
+		_hits++;
+		it->second._used = true;
+		return it->second._value;
+	}
+
+	void FunctionCache::Insert(uint64_t key, cachedFunction value) {
+		_entries[key] = entry{ std::move(value), true };
+	}
+
+	void FunctionCache::Prune() {
+		for (auto it = _entries.begin(); it != _entries.end();) {
+			if (it->second._used) {
+				it->second._used = false;
+				++it;
+			}
+			else
+				it = _entries.erase(it);
+		}
+	}
+
+	void fnvHash::add(const void* data, std::size_t size) {
+		auto p = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; i++) {
+			_value ^= p[i];
+			_value *= 1099511628211ull;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <iostream>
+#include <cstdint>
+
+namespace miniplc0 {
+
+	// 一个函数体的分析结果（优化之前的字节码）
+	class cachedFunction {
+	public:
+		std::vector<Instruction> _funins;
+		int32_t _slots;                     //参数和局部变量占用的slot数
+		std::vector<int32_t> _assigned;     //函数体给哪些未初始化的全局变量赋了值
+		std::vector<int32_t> _origins;      //每条指令来自的 token 相对于函数体第一个 token 的下标
+	};
+
+	// 按函数缓存函数体的分析结果，用于增量编译
+	// 键是函数体 token 的哈希，加上函数头和函数体中引用到的全局变量、函数的签名，由分析器计算
+	// 只有通过分析的函数体才会被缓存，所以命中时直接使用缓存的字节码，结果和重新分析完全一样
+	// 保存时只写出本次编译查到或者新加入的项，删掉的函数不会一直留在缓存里
+	class FunctionCache final {
+	private:
+		using uint64_t = std::uint64_t;
+	public:
+		FunctionCache() : _hits(0), _misses(0) {}
+		FunctionCache(const FunctionCache&) = delete;
+		FunctionCache& operator=(const FunctionCache&) = delete;
+
+		// 读入缓存文件，格式不对时返回 false 并清空缓存
+		bool Load(std::istream& input);
+		void Save(std::ostream& output) const;
+
+		std::optional<cachedFunction> Find(uint64_t key);
+		void Insert(uint64_t key, cachedFunction value);
+		// 删掉上次 Prune 之后没有查到也没有加入的项，常驻内存的缓存每次编译之后调用，避免改过的旧版本越积越多
+		void Prune();
+
+		std::size_t GetHits() const { return _hits; }
+		std::size_t GetMisses() const { return _misses; }
+	private:
+		class entry {
+		public:
+			cachedFunction _value;
+			bool _used;
+		};
+		std::unordered_map<uint64_t, entry> _entries;
+		std::size_t _hits;
+		std::size_t _misses;
+	};
+
+	// 64 位 FNV-1a，可以分多次喂入数据
+	class fnvHash {
+	public:
+		fnvHash() : _value(14695981039346656037ull) {}
+
+		void add(const void* data, std::size_t size);
+		void add(const std::string& s) { add(s.size()); add(s.data(), s.size()); }
+		void add(std::int64_t n) { add(&n, sizeof(n)); }
+		void add(std::size_t n) { add((std::int64_t)n); }
+		void add(std::int32_t n) { add((std::int64_t)n); }
+	public:
+		std::uint64_t _value;
+	};
+}
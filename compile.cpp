@@ -0,0 +1,168 @@
+#include "compile.h"
+#include "fmt/core.h"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "object/writer.h"
+#include "profiler/sampler.h"
+#include "fmts.hpp"
+#include "listing.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <sstream>
+#include <chrono>
+
+// 出错时打印错误并返回空
+std::optional<std::vector<miniplc0::Token>> _tokenize(std::istream& input, unsigned int threads) {
+	miniplc0::SampleScope scope("tokenize");
+	miniplc0::Tokenizer tkz(input);
+	auto p = tkz.AllTokensParallel(threads);
+	if (p.second.has_value()) {
+		fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
+		return {};
+	}
+	return p.first;
+}
+
+bool Tokenize(std::istream& input, std::ostream& output, unsigned int threads) {
+	auto v = _tokenize(input, threads);
+	if (!v.has_value())
+		return false;
+	for (auto& it : v.value())
+		output << fmt::format("{}\n", it);
+	return true;
+}
+
+// 出错时打印错误并返回 false
+bool Analyse(std::istream& input, std::ostream& output, const miniplc0::optimizeOptions& options, unsigned int threads, miniplc0::FunctionCache* cache){
+	auto tks = _tokenize(input, threads);
+	if (!tks.has_value())
+		return false;
+	miniplc0::Analyser analyser(tks.value());
+	analyser.SetOptions(options);
+	analyser.SetThreads(threads);
+	analyser.SetCache(cache);
+	std::pair<std::vector<miniplc0::functionBodyTable>, std::optional<miniplc0::CompilationError>> p;
+	{
+		miniplc0::SampleScope scope("analyse");
+		p = analyser.Analyse();
+	}
+	if (p.second.has_value()) {
+		fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
+		return false;
+	}
+
+	miniplc0::SampleScope scope("emit");
+    auto _fu=analyser.getFunctionTable();
+    std::vector<miniplc0::constantInfo> constants;
+    std::vector<miniplc0::functionInfo> functions;
+    for(int i=0;i<(int)_fu.size();i++){
+        constants.push_back({_fu[i]._type,_fu[i]._value});
+        functions.push_back({i,_fu[i]._params_size,_fu[i]._level,(int)p.first[i]._funins.size(),0});
+    }
+    miniplc0::WriteListing(output, constants, analyser.getStartCode(), functions,
+        [&p](std::size_t i) -> const std::vector<miniplc0::Instruction>& { return p.first[i]._funins; });
+
+//    auto _va=analyser.getVarTable();
+//    int nva=_va.size();
+//    for(int i=0;i<nva;i++){
+//        std::cout<<"name:"<<_va[i]._name<<"  ";
+//        std::cout<<"type:"<<_va[i]._type<<"  ";
+//        std::cout<<"level:"<<_va[i]._level<<"  ";
+//        std::cout<<"address:"<<_va[i]._address<<"  "<<std::endl;
+//    }
+
+	return true;
+}
+
+bool AnalyseBinary(std::istream& input, std::ostream& output, const miniplc0::optimizeOptions& options, unsigned int threads, miniplc0::FunctionCache* cache, bool extensions){
+    auto tks = _tokenize(input, threads);
+    if (!tks.has_value())
+        return false;
+    miniplc0::Analyser analyser(tks.value());
+    analyser.SetOptions(options);
+    analyser.SetThreads(threads);
+    analyser.SetCache(cache);
+    std::pair<std::vector<miniplc0::functionBodyTable>, std::optional<miniplc0::CompilationError>> p;
+    {
+        miniplc0::SampleScope scope("analyse");
+        p = analyser.Analyse();
+    }
+    if (p.second.has_value()) {
+        fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
+        return false;
+    }
+
+    miniplc0::SampleScope scope("emit");
+    miniplc0::WriteBinary(output, analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p.first,
+        analyser.getLineTables(), extensions);
+    return true;
+}
+
+// 读入增量编译的缓存，文件不存在或者格式不对时从空缓存开始
+void LoadCache(const std::string& path, miniplc0::FunctionCache& cache) {
+	std::ifstream inf(path, std::ios::in);
+	if (inf)
+		cache.Load(inf);
+}
+
+// 先写到临时文件再改名，中途失败不会留下写了一半的缓存
+void SaveCache(const std::string& path, const miniplc0::FunctionCache& cache) {
+	auto tmp = path + ".tmp";
+	std::ofstream outf(tmp, std::ios::out | std::ios::trunc);
+	if (outf) {
+		cache.Save(outf);
+		outf.close();
+		if (outf && std::rename(tmp.c_str(), path.c_str()) == 0)
+			return;
+	}
+	std::remove(tmp.c_str());
+	fmt::print(stderr, "Fail to write the cache file {}.\n", path);
+}
+
+std::optional<std::string> ReadFile(const std::string& path) {
+	std::ifstream inf(path, std::ios::in | std::ios::binary);
+	if (!inf)
+		return {};
+	std::ostringstream ss;
+	ss << inf.rdbuf();
+	return ss.str();
+}
+
+// 编译 source，先写到临时文件再改名，输出文件要么是上一次的结果，要么是完整的新结果
+bool Rebuild(const std::string& source, const std::string& output_file, bool binary, const miniplc0::optimizeOptions& options,
+		unsigned int threads, miniplc0::FunctionCache* cache, bool extensions) {
+	std::istringstream input(source);
+	auto tmp = output_file + ".tmp";
+	std::ofstream outf(tmp, std::ios::out | std::ios::trunc | (binary ? std::ios::binary : std::ios::openmode()));
+	if (!outf) {
+		fmt::print(stderr, "Fail to open {} for writing.\n", tmp);
+		return false;
+	}
+	bool ok = binary ? AnalyseBinary(input, outf, options, threads, cache, extensions) : Analyse(input, outf, options, threads, cache);
+	outf.close();
+	if (ok && outf && std::rename(tmp.c_str(), output_file.c_str()) == 0)
+		return true;
+	if (ok)
+		fmt::print(stderr, "Fail to write {}.\n", output_file);
+	std::remove(tmp.c_str());
+	return false;
+}
+
+bool WatchRebuild(const std::string& source, const std::string& output_file, bool binary, const miniplc0::optimizeOptions& options,
+		unsigned int threads, miniplc0::FunctionCache& cache, const std::string& cache_file, bool extensions, std::ostream& log) {
+	auto start = std::chrono::steady_clock::now();
+	auto hits = cache.GetHits();
+	bool ok = Rebuild(source, output_file, binary, options, threads, &cache, extensions);
+	auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (ok) {
+		if (!cache_file.empty())
+			SaveCache(cache_file, cache);
+		cache.Prune();
+		log << fmt::format("Rebuilt {} in {:.1f} ms, reused {} functions.\n", output_file, ms, cache.GetHits() - hits);
+	}
+	else
+		log << fmt::format("Build failed in {:.1f} ms, {} is unchanged.\n", ms, output_file);
+	return ok;
+}
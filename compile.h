@@ -0,0 +1,34 @@
+#pragma once
+
+#include "optimizer/optimizer.h"
+#include "cache/cache.h"
+#include "tokenizer/token.h"
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// cc0 的编译流程，出错时把错误打印到 stderr 并返回 false 或者空，由 main 和 --watch 共用
+
+// 出错时打印错误并返回空
+std::optional<std::vector<miniplc0::Token>> _tokenize(std::istream& input, unsigned int threads);
+bool Tokenize(std::istream& input, std::ostream& output, unsigned int threads);
+// 编译成文本汇编
+bool Analyse(std::istream& input, std::ostream& output, const miniplc0::optimizeOptions& options, unsigned int threads, miniplc0::FunctionCache* cache);
+// 编译成 .o0，extensions 为 false 时不写扩展段
+bool AnalyseBinary(std::istream& input, std::ostream& output, const miniplc0::optimizeOptions& options, unsigned int threads, miniplc0::FunctionCache* cache, bool extensions);
+
+// 读入增量编译的缓存，文件不存在或者格式不对时从空缓存开始
+void LoadCache(const std::string& path, miniplc0::FunctionCache& cache);
+// 先写到临时文件再改名，中途失败不会留下写了一半的缓存
+void SaveCache(const std::string& path, const miniplc0::FunctionCache& cache);
+std::optional<std::string> ReadFile(const std::string& path);
+
+// 编译 source，先写到临时文件再改名，输出文件要么是上一次的结果，要么是完整的新结果
+bool Rebuild(const std::string& source, const std::string& output_file, bool binary, const miniplc0::optimizeOptions& options,
+	unsigned int threads, miniplc0::FunctionCache* cache, bool extensions);
+// --watch 中源文件变化之后的一次编译：成功时写回 cache_file（为空时不写）并清理这次没有用到的缓存，
+// 耗时和复用的函数个数写到 log
+bool WatchRebuild(const std::string& source, const std::string& output_file, bool binary, const miniplc0::optimizeOptions& options,
+	unsigned int threads, miniplc0::FunctionCache& cache, const std::string& cache_file, bool extensions, std::ostream& log);
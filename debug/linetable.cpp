@@ -0,0 +1,102 @@
+#include "debug/linetable.h"
+
+#include <algorithm>
+
+namespace miniplc0 {
+
+	static void writeVarint(std::string& out, std::uint64_t n) {
+		while (n >= 0x80) {
+			out.push_back((char)((n & 0x7f) | 0x80));
+			n >>= 7;
+		}
+		out.push_back((char)n);
+	}
+
+	static bool readVarint(const std::string& in, std::size_t& byte, std::uint64_t& n) {
+		n = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (byte >= in.size())
+				return false;
+			auto c = (unsigned char)in[byte++];
+			n |= (std::uint64_t)(c & 0x7f) << shift;
+			if ((c & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	bool LineTable::readRow(const std::string& encoded, std::size_t& byte, int32_t& offset, uint64_t& line, uint64_t& column) {
+		uint64_t delta, zigzag;
+		if (!readVarint(encoded, byte, delta) || !readVarint(encoded, byte, zigzag) || !readVarint(encoded, byte, column))
+			return false;
+		if (delta > (uint64_t)(INT32_MAX - offset))
+			return false;
+		offset += (int32_t)delta;
+		line += (zigzag >> 1) ^ (0 - (zigzag & 1));
+		return true;
+	}
+
+	LineTable LineTable::Build(const std::vector<std::optional<position>>& positions) {
+		LineTable table;
+		std::optional<position> last;
+		int32_t previous = 0, rows = 0;
+		uint64_t line = 0;
+		for (std::size_t i = 0; i < positions.size(); i++) {
+			if (!positions[i].has_value() || positions[i] == last)
+				continue;
+			auto& pos = positions[i].value();
+			if (rows % LINE_CHECKPOINT_INTERVAL == 0)
+				table._checkpoints.push_back(checkpoint{ table._encoded.size(), (int32_t)i, previous, line });
+			auto delta = (std::int64_t)(pos.first - line);
+			writeVarint(table._encoded, i - previous);
+			writeVarint(table._encoded, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+			writeVarint(table._encoded, pos.second);
+			last = pos;
+			previous = i;
+			line = pos.first;
+			rows++;
+		}
+		return table;
+	}
+
+	std::optional<LineTable> LineTable::Decode(const unsigned char* data, std::size_t size) {
+		LineTable table;
+		table._encoded.assign((const char*)data, size);
+		std::size_t byte = 0;
+		int32_t offset = 0, rows = 0;
+		uint64_t line = 0, column;
+		while (byte < size) {
+			auto start = byte;
+			auto previous = offset;
+			auto base = line;
+			if (!readRow(table._encoded, byte, offset, line, column))
+				return {};
+			// 第一行之后下标必须严格递增
+			if (rows > 0 && offset == previous)
+				return {};
+			if (rows % LINE_CHECKPOINT_INTERVAL == 0)
+				table._checkpoints.push_back(checkpoint{ start, offset, previous, base });
+			rows++;
+		}
+		return table;
+	}
+
+	std::optional<LineTable::position> LineTable::Lookup(int32_t offset) const {
+		// 最后一个下标不超过 offset 的检查点，从它开始最多解码 LINE_CHECKPOINT_INTERVAL 行
+		auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), offset,
+			[](int32_t value, const checkpoint& c) { return value < c._offset; });
+		if (it == _checkpoints.begin())
+			return {};
+		--it;
+		std::size_t byte = it->_byte;
+		int32_t rowOffset = it->_previous;
+		uint64_t line = it->_line, column;
+		std::optional<position> result;
+		for (int32_t k = 0; k < LINE_CHECKPOINT_INTERVAL && readRow(_encoded, byte, rowOffset, line, column); k++) {
+			if (rowOffset > offset)
+				break;
+			result = position(line, column);
+		}
+		return result;
+	}
+}
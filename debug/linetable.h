@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	// 一个函数的行号表：指令下标到源代码位置（token 的起始行和列）的映射
+	// 只记录位置发生变化的指令，每一行是三个变长整数：
+	//   下标与上一行的差，行号与上一行的差（zigzag），列号
+	// 每 LINE_CHECKPOINT_INTERVAL 行记一个检查点（不写入文件，解码时重建），
+	// 查找时先二分检查点，再从检查点往后最多解码这么多行，O(log n)
+	class LineTable final {
+	private:
+		using int32_t = std::int32_t;
+		using uint64_t = std::uint64_t;
+	public:
+		using position = std::pair<uint64_t, uint64_t>;
+
+		LineTable() : _encoded(), _checkpoints() {}
+
+		// positions[i] 为第 i 条指令的位置，没有位置的指令（nullopt）沿用上一条的位置
+		static LineTable Build(const std::vector<std::optional<position>>& positions);
+		// 从 .o0 的 LINE 段恢复，编码不合法时返回空
+		static std::optional<LineTable> Decode(const unsigned char* data, std::size_t size);
+
+		// 写入 LINE 段的编码
+		const std::string& GetEncoded() const { return _encoded; }
+		bool IsEmpty() const { return _encoded.empty(); }
+		// 第 offset 条指令的位置，在第一个有位置的指令之前时返回空
+		std::optional<position> Lookup(int32_t offset) const;
+	private:
+		class checkpoint {
+		public:
+			std::size_t _byte;      //这一行在 _encoded 中的偏移
+			int32_t _offset;        //这一行的指令下标
+			int32_t _previous;      //上一行的指令下标和行号，解码这一行时的基准
+			uint64_t _line;
+		};
+		// 从 _encoded 的 byte 处解码一行，失败时返回 false
+		static bool readRow(const std::string& encoded, std::size_t& byte, int32_t& offset, uint64_t& line, uint64_t& column);
+	private:
+		std::string _encoded;
+		std::vector<checkpoint> _checkpoints;
+	};
+
+	const int32_t LINE_CHECKPOINT_INTERVAL = 16;
+}
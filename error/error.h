@@ -49,7 +49,12 @@ namespace miniplc0 {
 		ErrInvalidPrint,
 		ErrInvalidOperator,
 		ErrInvalidIntegerLiteral,
-		ErrAnnotationUnmatched
+		ErrAnnotationUnmatched,
+		ErrNoColon,
+		ErrInvalidCaseLabel,
+		ErrDuplicateCaseLabel,
+		ErrInvalidBreak,
+		ErrInvalidContinue
 	};
 
 	class CompilationError final{
@@ -1,6 +1,10 @@
+#pragma once
+
 #include "fmt/core.h"
 #include "tokenizer/tokenizer.h"
 #include "analyser/analyser.h"
+#include "object/loader.h"
+#include "instruction/opcode.h"
 
 namespace fmt {
 	template<>
@@ -107,6 +111,21 @@ namespace fmt {
                     break;
                 case miniplc0::ErrAnnotationUnmatched:
                     name = "The annotation is unmatched.";
+                    break;
+                case miniplc0::ErrNoColon:
+                    name = "Zai? Wei shen me bu xie mao hao.";
+                    break;
+                case miniplc0::ErrInvalidCaseLabel:
+                    name = "The case label must be an integer-literal.";
+                    break;
+                case miniplc0::ErrDuplicateCaseLabel:
+                    name = "The case label or default has appeared in this switch.";
+                    break;
+                case miniplc0::ErrInvalidBreak:
+                    name = "The break statement is not in a loop or switch.";
+                    break;
+                case miniplc0::ErrInvalidContinue:
+                    name = "The continue statement is not in a loop.";
                     break;
 			}
 			return format_to(ctx.out(), name);
@@ -123,6 +142,44 @@ namespace fmt {
 			return format_to(ctx.out(), "Line: {} Column: {} Error: {}", p.GetPos().first, p.GetPos().second, p.GetCode());
 		}
 	};
+
+	template<>
+	struct formatter<miniplc0::LoadError> {
+		template <typename ParseContext>
+		constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+		template <typename FormatContext>
+		auto format(const miniplc0::LoadError &p, FormatContext &ctx) {
+			std::string name;
+			switch (p.GetCode()) {
+				case miniplc0::ErrOpenFile:
+					name = "Fail to open the file.";
+					break;
+				case miniplc0::ErrMapFile:
+					name = "Fail to map the file into memory.";
+					break;
+				case miniplc0::ErrBadMagic:
+					name = "Not a .o0 file.";
+					break;
+				case miniplc0::ErrBadVersion:
+					name = "Unsupported version.";
+					break;
+				case miniplc0::ErrTruncated:
+					name = "The file is truncated.";
+					break;
+				case miniplc0::ErrBadConstant:
+					name = "Unknown constant type.";
+					break;
+				case miniplc0::ErrBadInstruction:
+					name = "Unknown instruction.";
+					break;
+				case miniplc0::ErrBadExtension:
+					name = "The extension section is invalid.";
+					break;
+			}
+			return format_to(ctx.out(), "Offset: {:#x} Error: {}", p.GetOffset(), name);
+		}
+	};
 }
 
 namespace fmt {
@@ -255,6 +312,9 @@ namespace fmt {
                 case miniplc0::RIGHT_BRACE:
                     name = "RightBrace";
                     break;
+                case miniplc0::COLON:
+                    name = "Colon";
+                    break;
                 case miniplc0::ASSIGNMENT_SIGN:
                     name = "AssignSign";
                     break;
@@ -290,188 +350,9 @@ namespace fmt {
 
 		template <typename FormatContext>
 		auto format(const miniplc0::Operation &p, FormatContext &ctx) {
-			std::string name;
-			switch (p) {
-                case miniplc0::NOP:
-                    name = "nop";
-                    break;
-                case miniplc0::BIPUSH:
-                    name = "bipush";
-                    break;
-                case miniplc0::IPUSH:
-                    name = "ipush";
-                    break;
-                case miniplc0::POP:
-                    name = "pop";
-                    break;
-                case miniplc0::POP2:
-                    name = "pop2";
-                    break;
-                case miniplc0::POPN:
-                    name = "popn";
-                    break;
-                case miniplc0::DUP:
-                    name = "dup";
-                    break;
-                case miniplc0::DUP2:
-                    name = "dup2";
-                    break;
-                case miniplc0::LOADC:
-                    name = "loadc";
-                    break;
-                case miniplc0::LOADA:
-                    name = "loada";
-                    break;
-                case miniplc0::NEW:
-                    name = "new";
-                    break;
-                case miniplc0::SNEW:
-                    name = "snew";
-                    break;
-                case miniplc0::ILOAD:
-                    name = "iload";
-                    break;
-                case miniplc0::DLOAD:
-                    name = "dload";
-                    break;
-                case miniplc0::ALOAD:
-                    name = "aload";
-                    break;
-                case miniplc0::IALOAD:
-                    name = "iaload";
-                    break;
-                case miniplc0::DALOAD:
-                    name = "daload";
-                    break;
-                case miniplc0::AALOAD:
-                    name = "aaloada";
-                    break;
-                case miniplc0::ISTORE:
-                    name = "istore";
-                    break;
-                case miniplc0::DSTORE:
-                    name = "dstore";
-                    break;
-                case miniplc0::ASTORE:
-                    name = "astore";
-                    break;
-                case miniplc0::IASTORE:
-                    name = "iastore";
-                    break;
-                case miniplc0::DASTORE:
-                    name = "dastore";
-                    break;
-                case miniplc0::AASTORE:
-                    name = "aastore";
-                    break;
-                case miniplc0::IADD:
-                    name = "iadd";
-                    break;
-                case miniplc0::DADD:
-                    name = "dadd";
-                    break;
-                case miniplc0::ISUB:
-                    name = "isub";
-                    break;
-                case miniplc0::DSUB:
-                    name = "dsub";
-                    break;
-                case miniplc0::IMUL:
-                    name = "imul";
-                    break;
-                case miniplc0::DMUL:
-                    name = "dmul";
-                    break;
-                case miniplc0::IDIV:
-                    name = "idiv";
-                    break;
-                case miniplc0::DDIV:
-                    name = "ddiv";
-                    break;
-                case miniplc0::INEG:
-                    name = "ineg";
-                    break;
-                case miniplc0::DNEG:
-                    name = "dneg";
-                    break;
-                case miniplc0::ICMP:
-                    name = "icmp";
-                    break;
-                case miniplc0::DCMP:
-                    name = "dcmp";
-                    break;
-                case miniplc0::I2D:
-                    name = "i2d";
-                    break;
-                case miniplc0::D2I:
-                    name = "d2i";
-                    break;
-                case miniplc0::I2C:
-                    name = "i2c";
-                    break;
-                case miniplc0::JMP:
-                    name = "jmp";
-                    break;
-                case miniplc0::JE:
-                    name = "je";
-                    break;
-                case miniplc0::JNE:
-                    name = "jne";
-                    break;
-                case miniplc0::JL:
-                    name = "jl";
-                    break;
-                case miniplc0::JGE:
-                    name = "jge";
-                    break;
-                case miniplc0::JG:
-                    name = "jg";
-                    break;
-                case miniplc0::JLE:
-                    name = "jle";
-                    break;
-                case miniplc0::CALL:
-                    name = "call";
-                    break;
-                case miniplc0::RET:
-                    name = "ret";
-                    break;
-                case miniplc0::IRET:
-                    name = "iret";
-                    break;
-                case miniplc0::DRET:
-                    name = "dret";
-                    break;
-                case miniplc0::ARET:
-                    name = "aret";
-                    break;
-                case miniplc0::IPRINT:
-                    name = "iprint";
-                    break;
-                case miniplc0::DPRINT:
-                    name = "dprint";
-                    break;
-                case miniplc0::CPRINT:
-                    name = "cprint";
-                    break;
-                case miniplc0::SPRINT:
-                    name = "sprint";
-                    break;
-                case miniplc0::PRINTL:
-                    name = "printl";
-                    break;
-                case miniplc0::ISCAN:
-                    name = "iscan";
-                    break;
-                case miniplc0::DSCAN:
-                    name = "dscan";
-                    break;
-                case miniplc0::CSCAN:
-                    name = "cscan";
-                    break;
-			}
-
-			return format_to(ctx.out(), name);
+			// 每条指令都要格式化一次，不构造临时的 std::string
+			auto& info = miniplc0::opcodeOf(p);
+			return format_to(ctx.out(), "{}", info.isDefined() ? info._mnemonic : "");
 		}
 	};
 	template<>
@@ -481,73 +362,14 @@ namespace fmt {
 
 		template <typename FormatContext>
 		auto format(const miniplc0::Instruction &p, FormatContext &ctx) {
-			std::string name;
-			switch (p.GetOperation())
-			{
-			    case miniplc0::NOP:
-                case miniplc0::POP:
-                case miniplc0::POP2:
-                case miniplc0::DUP:
-                case miniplc0::DUP2:
-                case miniplc0::NEW:
-                case miniplc0::ILOAD:
-                case miniplc0::DLOAD:
-                case miniplc0::ALOAD:
-                case miniplc0::IALOAD:
-                case miniplc0::DALOAD:
-                case miniplc0::AALOAD:
-                case miniplc0::ISTORE:
-                case miniplc0::DSTORE:
-                case miniplc0::ASTORE:
-                case miniplc0::IASTORE:
-                case miniplc0::DASTORE:
-                case miniplc0::AASTORE:
-                case miniplc0::IADD:
-                case miniplc0::DADD:
-                case miniplc0::ISUB:
-                case miniplc0::DSUB:
-                case miniplc0::IMUL:
-                case miniplc0::DMUL:
-                case miniplc0::IDIV:
-                case miniplc0::DDIV:
-                case miniplc0::INEG:
-                case miniplc0::DNEG:
-                case miniplc0::ICMP:
-                case miniplc0::DCMP:
-                case miniplc0::I2D:
-                case miniplc0::D2I:
-                case miniplc0::I2C:
-                case miniplc0::RET:
-                case miniplc0::IRET:
-                case miniplc0::DRET:
-                case miniplc0::ARET:
-                case miniplc0::IPRINT:
-                case miniplc0::DPRINT:
-                case miniplc0::CPRINT:
-                case miniplc0::SPRINT:
-                case miniplc0::PRINTL:
-                case miniplc0::ISCAN:
-                case miniplc0::DSCAN:
-                case miniplc0::CSCAN:
-                    return format_to(ctx.out(), "{}", p.GetOperation());
-                case miniplc0::BIPUSH:
-                case miniplc0::IPUSH:
-                case miniplc0::POPN:
-                case miniplc0::LOADC:
-                case miniplc0::SNEW:
-                case miniplc0::JMP:
-                case miniplc0::JE:
-                case miniplc0::JNE:
-                case miniplc0::JL:
-                case miniplc0::JGE:
-                case miniplc0::JG:
-                case miniplc0::JLE:
-                case miniplc0::CALL:
-                    return format_to(ctx.out(), "{} {}", p.GetOperation(), p.GetX());
-                case miniplc0::LOADA:
-                    return format_to(ctx.out(), "{} {}, {}", p.GetOperation(), p.GetX(), p.GetY());
-			}
-			return format_to(ctx.out(), "NOP");
+			auto& info = miniplc0::opcodeOf(p.GetOperation());
+			if (!info.isDefined())
+				return format_to(ctx.out(), "NOP");
+			if (info._y_width != 0)
+				return format_to(ctx.out(), "{} {}, {}", info._mnemonic, p.GetX(), p.GetY());
+			if (info._x_width != 0)
+				return format_to(ctx.out(), "{} {}", info._mnemonic, p.GetX());
+			return format_to(ctx.out(), "{}", info._mnemonic);
 		}
 	};
 }
\ No newline at end of file
@@ -52,6 +52,7 @@ namespace miniplc0 {
         JGE,
         JG,
         JLE,
+        TABLESWITCH,
         CALL=0x80,
         RET=0x88,
         IRET,
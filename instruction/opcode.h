@@ -0,0 +1,123 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <array>
+#include <cstdint>
+
+namespace miniplc0 {
+
+	// 弹出/压入的 slot 数取决于操作数或被调用的函数
+	const std::int8_t VARIABLE_EFFECT = -1;
+
+	// 操作码的描述，编码器、加载器、文本输出、栈分析、校验器和虚拟机都从这里取信息
+	class opcodeInfo final {
+	public:
+		const char* _mnemonic;      //助记符，nullptr 表示没有定义的操作码
+		std::uint8_t _x_width;      //第一个操作数的字节数
+		std::uint8_t _y_width;      //第二个操作数的字节数
+		std::int8_t _pop;           //弹出的 slot 数
+		std::int8_t _push;          //压入的 slot 数
+		bool _branch;               //操作数 x 是跳转目标
+		bool _terminator;           //执行后不会落到下一条指令
+		bool _supported;            //虚拟机实现了的指令（整数子集）
+
+		constexpr bool isDefined() const { return _mnemonic != nullptr; }
+		// 写进文件时跟在操作码后面的字节数
+		constexpr std::uint32_t operandBytes() const { return _x_width + _y_width; }
+		constexpr bool isReturn() const { return _terminator && !_branch; }
+	};
+
+	namespace detail {
+		constexpr std::array<opcodeInfo, 256> makeOpcodeTable() {
+			std::array<opcodeInfo, 256> t{};
+			for (auto& it : t)
+				it = opcodeInfo{ nullptr, 0, 0, 0, 0, false, false, false };
+			const std::int8_t V = VARIABLE_EFFECT;
+			//                   助记符      x  y  pop push 跳转 终止 虚拟机
+			t[NOP]      = { "nop",      0, 0, 0, 0, false, false, true };
+			t[BIPUSH]   = { "bipush",   1, 0, 0, 1, false, false, true };
+			t[IPUSH]    = { "ipush",    4, 0, 0, 1, false, false, true };
+			t[POP]      = { "pop",      0, 0, 1, 0, false, false, true };
+			t[POP2]     = { "pop2",     0, 0, 2, 0, false, false, true };
+			t[POPN]     = { "popn",     4, 0, V, 0, false, false, true };
+			t[DUP]      = { "dup",      0, 0, 1, 2, false, false, true };
+			t[DUP2]     = { "dup2",     0, 0, 2, 4, false, false, true };
+			t[LOADC]    = { "loadc",    2, 0, 0, 1, false, false, false };
+			t[LOADA]    = { "loada",    2, 4, 0, 1, false, false, true };
+			t[NEW]      = { "new",      0, 0, 1, 1, false, false, false };
+			t[SNEW]     = { "snew",     4, 0, 0, V, false, false, true };
+			t[ILOAD]    = { "iload",    0, 0, 1, 1, false, false, true };
+			t[DLOAD]    = { "dload",    0, 0, 1, 2, false, false, false };
+			t[ALOAD]    = { "aload",    0, 0, 1, 1, false, false, false };
+			t[IALOAD]   = { "iaload",   0, 0, 2, 1, false, false, false };
+			t[DALOAD]   = { "daload",   0, 0, 2, 2, false, false, false };
+			t[AALOAD]   = { "aaload",   0, 0, 2, 1, false, false, false };
+			t[ISTORE]   = { "istore",   0, 0, 2, 0, false, false, true };
+			t[DSTORE]   = { "dstore",   0, 0, 3, 0, false, false, false };
+			t[ASTORE]   = { "astore",   0, 0, 2, 0, false, false, false };
+			t[IASTORE]  = { "iastore",  0, 0, 3, 0, false, false, false };
+			t[DASTORE]  = { "dastore",  0, 0, 4, 0, false, false, false };
+			t[AASTORE]  = { "aastore",  0, 0, 3, 0, false, false, false };
+			t[IADD]     = { "iadd",     0, 0, 2, 1, false, false, true };
+			t[DADD]     = { "dadd",     0, 0, 4, 2, false, false, false };
+			t[ISUB]     = { "isub",     0, 0, 2, 1, false, false, true };
+			t[DSUB]     = { "dsub",     0, 0, 4, 2, false, false, false };
+			t[IMUL]     = { "imul",     0, 0, 2, 1, false, false, true };
+			t[DMUL]     = { "dmul",     0, 0, 4, 2, false, false, false };
+			t[IDIV]     = { "idiv",     0, 0, 2, 1, false, false, true };
+			t[DDIV]     = { "ddiv",     0, 0, 4, 2, false, false, false };
+			t[INEG]     = { "ineg",     0, 0, 1, 1, false, false, true };
+			t[DNEG]     = { "dneg",     0, 0, 2, 2, false, false, false };
+			t[ICMP]     = { "icmp",     0, 0, 2, 1, false, false, true };
+			t[DCMP]     = { "dcmp",     0, 0, 4, 1, false, false, false };
+			t[I2D]      = { "i2d",      0, 0, 1, 2, false, false, false };
+			t[D2I]      = { "d2i",      0, 0, 2, 1, false, false, false };
+			t[I2C]      = { "i2c",      0, 0, 1, 1, false, false, true };
+			t[JMP]      = { "jmp",      2, 0, 0, 0, true,  true,  true };
+			t[JE]       = { "je",       2, 0, 1, 0, true,  false, true };
+			t[JNE]      = { "jne",      2, 0, 1, 0, true,  false, true };
+			t[JL]       = { "jl",       2, 0, 1, 0, true,  false, true };
+			t[JGE]      = { "jge",      2, 0, 1, 0, true,  false, true };
+			t[JG]       = { "jg",       2, 0, 1, 0, true,  false, true };
+			t[JLE]      = { "jle",      2, 0, 1, 0, true,  false, true };
+			t[TABLESWITCH] = { "tableswitch", 4, 2, 1, 0, false, false, true };
+			t[CALL]     = { "call",     2, 0, V, V, false, false, true };
+			t[RET]      = { "ret",      0, 0, 0, 0, false, true,  true };
+			t[IRET]     = { "iret",     0, 0, 1, 0, false, true,  true };
+			t[DRET]     = { "dret",     0, 0, 2, 0, false, true,  false };
+			t[ARET]     = { "aret",     0, 0, 1, 0, false, true,  false };
+			t[IPRINT]   = { "iprint",   0, 0, 1, 0, false, false, true };
+			t[DPRINT]   = { "dprint",   0, 0, 2, 0, false, false, false };
+			t[CPRINT]   = { "cprint",   0, 0, 1, 0, false, false, true };
+			t[SPRINT]   = { "sprint",   0, 0, 1, 0, false, false, false };
+			t[PRINTL]   = { "printl",   0, 0, 0, 0, false, false, true };
+			t[ISCAN]    = { "iscan",    0, 0, 0, 1, false, false, true };
+			t[DSCAN]    = { "dscan",    0, 0, 0, 2, false, false, false };
+			t[CSCAN]    = { "cscan",    0, 0, 0, 1, false, false, true };
+			return t;
+		}
+	}
+
+	// 以 Operation 为下标
+	constexpr std::array<opcodeInfo, 256> OPCODES = detail::makeOpcodeTable();
+
+	constexpr const opcodeInfo& opcodeOf(Operation op) {
+		return OPCODES[(std::uint32_t)op & 0xff];
+	}
+	constexpr const opcodeInfo& opcodeOf(std::uint32_t op) {
+		return OPCODES[op & 0xff];
+	}
+
+	// tableswitch low, count 后面紧跟 count + 1 条 jmp 组成的跳转表，第一条是默认分支
+	// 弹出 v，low <= v < low + count 时执行第 v - low + 1 条 jmp，否则落到默认分支
+	// 返回跳转表中 case 的条数，也就是除了下一条指令之外的后继个数，其他指令为 0
+	inline std::int32_t switchCases(const Instruction& ins) {
+		return ins.GetOperation() == TABLESWITCH ? ins.GetY() : 0;
+	}
+
+	static_assert(opcodeOf(LOADA).operandBytes() == 6, "loada is u2 level_diff, u4 offset");
+	static_assert(opcodeOf(JMP)._branch && opcodeOf(JMP)._terminator, "jmp never falls through");
+	static_assert(opcodeOf(IRET).isReturn() && !opcodeOf(JE).isReturn(), "only ret family returns");
+	static_assert(!opcodeOf(0x03).isDefined(), "0x03 is not an opcode");
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "fmts.hpp"
+#include "instruction/opcode.h"
+#include "profiler/trace.h"
+#include "profiler/allocation.h"
+#include "fmt/format.h"
+#include "fmt/compile.h"
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace miniplc0 {
+
+	// 攒够这么多字节才写一次输出流
+	const std::size_t LISTING_CHUNK_SIZE = 1 << 20;
+
+	// 文本汇编的格式，cc0 -s 和 cc0-objdump 共用
+	// .constants:   下标  类型  "值"
+	// .start:       下标 指令
+	// .functions:   下标  name_index  params_size  level
+	// .F<n>:        下标 指令
+	// code(i) 返回第 i 个函数的指令
+	// 所有内容先格式化到 fmt::memory_buffer 中，按 LISTING_CHUNK_SIZE 分块写出
+	template <typename Code>
+	void WriteListing(std::ostream& output, const std::vector<constantInfo>& constants, const std::vector<Instruction>& start,
+			const std::vector<functionInfo>& functions, Code code) {
+		TraceScope trace(__func__);
+		AllocationScope allocation(AllocEmit);
+		static const auto constantLine = fmt::compile<std::size_t, std::string, std::string>(FMT_STRING("{}  {}  \"{}\"\n"));
+		// fmt 5.3 的 compile 不支持自定义 formatter（parse 拿到的是空的格式串），指令按操作数个数分开格式化
+		static const auto instructionLine0 = fmt::compile<std::size_t, const char*>(FMT_STRING("{} {}\n"));
+		static const auto instructionLine1 = fmt::compile<std::size_t, const char*, int32_t>(FMT_STRING("{} {} {}\n"));
+		static const auto instructionLine2 = fmt::compile<std::size_t, const char*, int32_t, int32_t>(FMT_STRING("{} {} {}, {}\n"));
+		static const auto functionLine = fmt::compile<std::size_t, int32_t, int32_t, int32_t>(FMT_STRING("{}  {}  {}  {}\n"));
+		static const auto functionLabel = fmt::compile<std::size_t>(FMT_STRING(".F{}:\n"));
+
+		fmt::memory_buffer buffer;
+		auto flush = [&output, &buffer](bool force) {
+			if (force || buffer.size() >= LISTING_CHUNK_SIZE) {
+				output.write(buffer.data(), buffer.size());
+				buffer.clear();
+			}
+		};
+		auto append = [&buffer](const char* s) {
+			buffer.append(s, s + std::char_traits<char>::length(s));
+		};
+		// 与 formatter<Instruction> 的输出相同
+		auto instructionLine = [&buffer](std::size_t i, const Instruction& ins) {
+			auto& info = opcodeOf(ins.GetOperation());
+			if (!info.isDefined())
+				instructionLine0.format_to(buffer, i, "NOP");
+			else if (info._y_width != 0)
+				instructionLine2.format_to(buffer, i, info._mnemonic, ins.GetX(), ins.GetY());
+			else if (info._x_width != 0)
+				instructionLine1.format_to(buffer, i, info._mnemonic, ins.GetX());
+			else
+				instructionLine0.format_to(buffer, i, info._mnemonic);
+		};
+
+		append(".constants:\n");
+		for (std::size_t i = 0; i < constants.size(); i++)
+			constantLine.format_to(buffer, i, constants[i]._type, constants[i]._value);
+
+		append(".start:\n");
+		for (std::size_t i = 0; i < start.size(); i++)
+			instructionLine(i, start[i]);
+		flush(false);
+
+		append(".functions:\n");
+		for (std::size_t i = 0; i < functions.size(); i++)
+			functionLine.format_to(buffer, i, functions[i]._name_index, functions[i]._params_size, functions[i]._level);
+
+		for (std::size_t i = 0; i < functions.size(); i++) {
+			functionLabel.format_to(buffer, i);
+			auto& ins = code(i);
+			for (std::size_t j = 0; j < ins.size(); j++)
+				instructionLine(j, ins[j]);
+			flush(false);
+		}
+		flush(true);
+		output << std::flush;
+	}
+}
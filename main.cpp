@@ -1,300 +1,72 @@
 #include "argparse.hpp"
 #include "fmt/core.h"
 
-#include "tokenizer/tokenizer.h"
-#include "analyser/analyser.h"
-#include "fmts.hpp"
+#include "compile.h"
+#include "cache/cache.h"
+#include "profiler/sampler.h"
+#include "profiler/trace.h"
+#include "profiler/allocation.h"
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
-unsigned int u2ChangeToBigEnd(unsigned int n){//uint16_t
-    auto *p=(unsigned char*)&n;
-    return (((unsigned int)*p<<8)+((unsigned int)*(p+1)));
-}
-unsigned int u4ChangeToBigEnd(unsigned int n){//uint16_t
-    auto *p=(unsigned char*)&n;
-    return (((unsigned int)*p<<24) + ((unsigned int)*(p+1)<<16) + ((unsigned int)*(p+2)<<8) + ((unsigned int)*(p+3)));
-}
-unsigned int opCount(miniplc0::Instruction &p){
-    switch (p.GetOperation())
-    {
-        case miniplc0::NOP:
-        case miniplc0::POP:
-        case miniplc0::POP2:
-        case miniplc0::DUP:
-        case miniplc0::DUP2:
-        case miniplc0::NEW:
-        case miniplc0::ILOAD:
-        case miniplc0::DLOAD:
-        case miniplc0::ALOAD:
-        case miniplc0::IALOAD:
-        case miniplc0::DALOAD:
-        case miniplc0::AALOAD:
-        case miniplc0::ISTORE:
-        case miniplc0::DSTORE:
-        case miniplc0::ASTORE:
-        case miniplc0::IASTORE:
-        case miniplc0::DASTORE:
-        case miniplc0::AASTORE:
-        case miniplc0::IADD:
-        case miniplc0::DADD:
-        case miniplc0::ISUB:
-        case miniplc0::DSUB:
-        case miniplc0::IMUL:
-        case miniplc0::DMUL:
-        case miniplc0::IDIV:
-        case miniplc0::DDIV:
-        case miniplc0::INEG:
-        case miniplc0::DNEG:
-        case miniplc0::ICMP:
-        case miniplc0::DCMP:
-        case miniplc0::I2D:
-        case miniplc0::D2I:
-        case miniplc0::I2C:
-        case miniplc0::RET:
-        case miniplc0::IRET:
-        case miniplc0::DRET:
-        case miniplc0::ARET:
-        case miniplc0::IPRINT:
-        case miniplc0::DPRINT:
-        case miniplc0::CPRINT:
-        case miniplc0::SPRINT:
-        case miniplc0::PRINTL:
-        case miniplc0::ISCAN:
-        case miniplc0::DSCAN:
-        case miniplc0::CSCAN:
-            return 0;
-        case miniplc0::BIPUSH:
-            return 0x10;
-        case miniplc0::IPUSH:
-        case miniplc0::POPN:
-            return 0x40;
-        case miniplc0::LOADC:
-            return 0x20;
-        case miniplc0::SNEW:
-            return 0x40;
-        case miniplc0::JMP:
-        case miniplc0::JE:
-        case miniplc0::JNE:
-        case miniplc0::JL:
-        case miniplc0::JGE:
-        case miniplc0::JG:
-        case miniplc0::JLE:
-        case miniplc0::CALL:
-            return 0x20;
-        case miniplc0::LOADA:
-            return 0x24;
-    }
-    return -1;
-}
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
-std::vector<miniplc0::Token> _tokenize(std::istream& input) {
-	miniplc0::Tokenizer tkz(input);
-	auto p = tkz.AllTokens();
-	if (p.second.has_value()) {
-		fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
-		exit(2);
+// 监视 input_file，内容变化时重新编译，两次编译之间缓存常驻内存，没有变的函数直接使用缓存的字节码
+// 监视的是文件所在的目录，编辑器先写临时文件再改名的保存方式也能察觉
+int Watch(const std::string& input_file, const std::string& output_file, bool binary, const miniplc0::optimizeOptions& options,
+		unsigned int threads, miniplc0::FunctionCache& cache, const std::string& cache_file, bool extensions) {
+#ifdef __linux__
+	auto slash = input_file.rfind('/');
+	auto dir = slash == std::string::npos ? std::string(".") : input_file.substr(0, slash + 1);
+	auto name = slash == std::string::npos ? input_file : input_file.substr(slash + 1);
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+		fmt::print(stderr, "Fail to watch {}.\n", dir);
+		return 2;
 	}
-	return p.first;
-}
 
-void Tokenize(std::istream& input, std::ostream& output) {
-	auto v = _tokenize(input);
-	for (auto& it : v)
-		output << fmt::format("{}\n", it);
-	return;
-}
+	std::optional<std::string> previous;
+	while (true) {
+		// 内容没有变化（比如只是 touch）时不重新编译
+		auto source = ReadFile(input_file);
+		if (source.has_value() && source != previous) {
+			previous = std::move(source);
+			WatchRebuild(previous.value(), output_file, binary, options, threads, cache, cache_file, extensions, std::cerr);
+		}
 
-void Analyse(std::istream& input, std::ostream& output){
-	auto tks = _tokenize(input);
-	miniplc0::Analyser analyser(tks);
-	auto p = analyser.Analyse();
-	if (p.second.has_value()) {
-		fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
-		exit(2);
+		// 等到 input_file 被改动，再把同一次保存在 50ms 内产生的其他事件读掉
+		alignas(inotify_event) char buffer[4096];
+		bool changed = false;
+		int timeout = -1;
+		while (true) {
+			pollfd p = { fd, POLLIN, 0 };
+			int ready = poll(&p, 1, timeout);
+			if (ready == 0)
+				break;
+			if (ready < 0)
+				continue;
+			auto n = read(fd, buffer, sizeof(buffer));
+			for (decltype(n) i = 0; i < n; ) {
+				auto event = reinterpret_cast<const inotify_event*>(buffer + i);
+				if (event->len != 0 && name == event->name)
+					changed = true;
+				i += sizeof(inotify_event) + event->len;
+			}
+			if (changed)
+				timeout = 50;
+		}
 	}
-
-    output<<".constants:"<<std::endl;
-    auto _fu=analyser.getFunctionTable();
-    int nfu=_fu.size();
-    for(int i=0;i<nfu;i++){
-        output<<i<<"  ";
-        output<<_fu[i]._type<<"  ";
-        output<<"\""<<_fu[i]._value<<"\""<<std::endl;
-    }
-
-    output<<".start:"<<std::endl;
-	auto _st=analyser.getStartCode();
-	unsigned int ti=0;
-    for (auto& it : _st){
-        output <<ti<<" "<< fmt::format("{}", it)<<std::endl;
-        ti++;
-    }
-
-    output<<".functions:"<<std::endl;
-    _fu=analyser.getFunctionTable();
-    nfu=_fu.size();
-    for(int i=0;i<nfu;i++){
-        output<<i<<"  ";
-        output<<i<<"  ";
-        output<<_fu[i]._params_size<<"  ";
-        output<<_fu[i]._level<<std::endl;
-    }
-
-    auto v = p.first;
-    int nv=v.size();
-    for(int i=0;i<nv;i++){
-        output << ".F" <<i<<":"<<std::endl;
-        int j=0;
-        for (auto& it : v[i]._funins){
-            output <<j<<" "<<fmt::format("{}", it)<<std::endl;
-            j++;
-        }
-    }
-
-//    auto _va=analyser.getVarTable();
-//    int nva=_va.size();
-//    for(int i=0;i<nva;i++){
-//        std::cout<<"name:"<<_va[i]._name<<"  ";
-//        std::cout<<"type:"<<_va[i]._type<<"  ";
-//        std::cout<<"level:"<<_va[i]._level<<"  ";
-//        std::cout<<"address:"<<_va[i]._address<<"  "<<std::endl;
-//    }
-
-	return;
-}
-
-void AnalyseBinary(std::istream& input, std::ostream& output){
-    auto tks = _tokenize(input);
-    miniplc0::Analyser analyser(tks);
-    auto p = analyser.Analyse();
-    if (p.second.has_value()) {
-        fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
-        exit(2);
-    }
-
-
-    auto _fun=analyser.getFunctionTable();
-    auto _st=analyser.getStartCode();
-    //u4 magic;             must be 0x43303A29
-    unsigned int magic=0x43303A29;
-    magic=u4ChangeToBigEnd(magic);
-    output.write((char*)&magic,sizeof(int32_t));
-    //u4 version;
-    unsigned int version=1;
-    version=u4ChangeToBigEnd(version);
-    output.write((char*)&version,sizeof(int32_t));
-    //u2 constants_count;
-    unsigned int constants_count=_fun.size();
-    constants_count=u2ChangeToBigEnd(constants_count);
-    output.write((char*)&constants_count,sizeof(int16_t));
-    output<<std::flush;
-    //Constant_info constants[constants_count];
-    for(unsigned int i=0;i<_fun.size();i++){
-        //u1 type;u2 length;u1 value[length];
-        unsigned int type=0;
-        output.write((char *)&type, sizeof(int8_t));
-        unsigned int length=_fun[i]._value.length();
-        length=u2ChangeToBigEnd(length);
-        output.write((char*)&length,sizeof(int16_t));
-        output<<_fun[i]._value<<std::flush;
-    }
-    //Start_code_info start_code;
-    //u2 instructions_count;
-    unsigned int instructions_count_start=_st.size();
-    instructions_count_start=u2ChangeToBigEnd(instructions_count_start);
-    output.write((char *)&instructions_count_start, sizeof(int16_t));
-    output<<std::flush;
-    //Instruction instructions[instructions_count];
-    for(unsigned int i=0;i<_st.size();i++){
-        unsigned opcode=_st[i].GetOperation();
-        output.write((char *)&opcode, sizeof(int8_t));
-        if(opCount(_st[i])==0){
-        }
-        else if(opCount(_st[i])==0x10){
-            unsigned oprands=_st[i].GetX();
-            output.write((char *)&oprands, sizeof(int8_t));
-        }
-        else if(opCount(_st[i])==0x20){
-            unsigned oprands=_st[i].GetX();
-            oprands=u2ChangeToBigEnd(oprands);
-            output.write((char *)&oprands, sizeof(int16_t));
-        }
-        else if(opCount(_st[i])==0x40){
-            unsigned oprands=_st[i].GetX();
-            oprands=u4ChangeToBigEnd(oprands);
-            output.write((char *)&oprands, sizeof(int32_t));
-        }
-        else if(opCount(_st[i])==0x24){
-            unsigned oprands=_st[i].GetX();
-            oprands=u2ChangeToBigEnd(oprands);
-            output.write((char *)&oprands, sizeof(int16_t));
-            oprands=_st[i].GetY();
-            oprands=u4ChangeToBigEnd(oprands);
-            output.write((char *)&oprands, sizeof(int32_t));
-        }
-        output<<std::flush;
-    }
-    //u2 functions_count;
-    unsigned int functions_count=_fun.size();
-    functions_count=u2ChangeToBigEnd(functions_count);
-    output.write((char *)&functions_count, sizeof(int16_t));
-    output<<std::flush;
-
-
-    auto _fun_body = p.first;
-    //Function_info functions[functions_count];
-    //u2 name_index; // name: CO_binary_file.strings[name_index]
-    //u2 params_size;
-    //u2 level;
-    //u2 instructions_count;
-    //Instruction instructions[instructions_count];
-    for(unsigned int i=0;i<_fun.size();i++){
-        unsigned int name_index=i;
-        name_index=u2ChangeToBigEnd(name_index);
-        output.write((char *)&name_index, sizeof(int16_t));
-        unsigned int param_size=_fun[i]._params_size;
-        param_size=u2ChangeToBigEnd(param_size);
-        output.write((char *)&param_size, sizeof(int16_t));
-        unsigned int level=_fun[i]._level;
-        level=u2ChangeToBigEnd(level);
-        output.write((char *)&level, sizeof(int16_t));
-        unsigned int instructions_count=_fun_body[i]._funins.size();
-        instructions_count=u2ChangeToBigEnd(instructions_count);
-        output.write((char *)&instructions_count, sizeof(int16_t));
-        for(unsigned int j=0;j<_fun_body[i]._funins.size();j++){
-            unsigned opcode=_fun_body[i]._funins[j].GetOperation();
-            output.write((char *)&opcode, sizeof(int8_t));
-            if(opCount(_fun_body[i]._funins[j])==0){
-            }
-            else if(opCount(_fun_body[i]._funins[j])==0x10){
-                unsigned oprands=_fun_body[i]._funins[j].GetX();
-                output.write((char *)&oprands, sizeof(int8_t));
-            }
-            else if(opCount(_fun_body[i]._funins[j])==0x20){
-                unsigned oprands=_fun_body[i]._funins[j].GetX();
-                oprands=u2ChangeToBigEnd(oprands);
-                output.write((char *)&oprands, sizeof(int16_t));
-            }
-            else if(opCount(_fun_body[i]._funins[j])==0x40){
-                unsigned oprands=_fun_body[i]._funins[j].GetX();
-                oprands=u4ChangeToBigEnd(oprands);
-                output.write((char *)&oprands, sizeof(int32_t));
-            }
-            else if(opCount(_fun_body[i]._funins[j])==0x24){
-                unsigned oprands=_fun_body[i]._funins[j].GetX();
-                output.write((char *)&oprands, sizeof(int16_t));
-                oprands=u2ChangeToBigEnd(oprands);
-                oprands=_fun_body[i]._funins[j].GetY();
-                oprands=u4ChangeToBigEnd(oprands);
-                output.write((char *)&oprands, sizeof(int32_t));
-            }
-            output<<std::flush;
-        }
-    }
-
-    return;
+#else
+	(void)input_file; (void)output_file; (void)binary; (void)options; (void)threads; (void)cache; (void)cache_file; (void)extensions;
+	fmt::print(stderr, "--watch is only supported on Linux.\n");
+	return 2;
+#endif
 }
 
 int main(int argc, char** argv) {
@@ -321,9 +93,54 @@ int main(int argc, char** argv) {
 		.required()
 		.default_value(std::string("-"))
 		.help("specify the output file.");
+    program.add_argument("--no-extensions")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Do not append the optional extension sections to the binary target file.");
+    program.add_argument("--no-inline")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Do not inline small functions at their call sites.");
+    program.add_argument("--inline-budget")
+            .default_value(miniplc0::optimizeOptions()._inline_budget)
+            .action([](const std::string& value) { return std::stoi(value); })
+            .help("Maximum number of instructions of a function to be inlined.");
+    program.add_argument("-j", "--threads")
+            .default_value(0)
+            .action([](const std::string& value) { return std::stoi(value); })
+            .help("Number of threads used to tokenize the source and analyse function bodies, 0 means one per hardware thread.");
+    program.add_argument("--watch")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Keep running and rebuild the output file whenever the input file changes.");
+    program.add_argument("--cache")
+            .default_value(std::string(""))
+            .help("Reuse the bytecode of unchanged functions from this file and update it after a successful compilation.");
+    program.add_argument("--profile")
+            .default_value(std::string(""))
+            .help("Sample the compiler with SIGPROF and write folded stacks (compiler phase, analyser routine, source line) to this file.");
+    program.add_argument("--trace")
+            .default_value(std::string(""))
+            .help("Record when each thread tokenizes, analyses every function and emits the output, and write a Chrome trace (JSON) to this file.");
+    program.add_argument("--alloc-stats")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Print heap allocations per compiler phase to stderr (needs a build with CC0_ALLOCATION_HOOKS).");
 
+	// argparse 不认识 --option=value，先拆成两个参数
+	std::vector<std::string> arguments;
+	for (int i = 0; i < argc; i++) {
+		std::string arg = argv[i];
+		auto eq = arg.find('=');
+		if (i > 0 && arg.size() > 2 && arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+			arguments.emplace_back(arg.substr(0, eq));
+			arguments.emplace_back(arg.substr(eq + 1));
+		}
+		else
+			arguments.emplace_back(std::move(arg));
+	}
 	try {
-		program.parse_args(argc, argv);
+		program.parse_args(arguments);
 	}
 	catch (const std::runtime_error& err) {
 		fmt::print(stderr, "{}\n\n", err.what());
@@ -331,6 +148,51 @@ int main(int argc, char** argv) {
 		exit(2);
 	}
 
+	miniplc0::optimizeOptions options;
+	options._inline = program["--no-inline"] == false;
+	options._inline_budget = program.get<int>("--inline-budget");
+	int threads = std::max(program.get<int>("--threads"), 0);
+	auto cache_file = program.get<std::string>("--cache");
+	miniplc0::FunctionCache cache;
+	if (!cache_file.empty())
+		LoadCache(cache_file, cache);
+	auto cachePtr = cache_file.empty() ? nullptr : &cache;
+	auto profile_file = program.get<std::string>("--profile");
+	auto trace_file = program.get<std::string>("--trace");
+	// 编译结束后（不论成功与否）写出采样结果和时间线再退出
+	bool alloc_stats = program["--alloc-stats"] == true;
+	if (alloc_stats && !miniplc0::AllocationTracker::IsInstalled()) {
+		fmt::print(stderr, "--alloc-stats needs cc0 built with CC0_ALLOCATION_HOOKS.");
+		exit(2);
+	}
+	auto finish = [&profile_file, &trace_file, alloc_stats](int status) {
+		if (!profile_file.empty()) {
+			miniplc0::Sampler::Stop();
+			std::ofstream outf(profile_file, std::ios::out | std::ios::trunc);
+			miniplc0::Sampler::WriteFolded(outf, "cc0");
+			if (!outf)
+				fmt::print(stderr, "Fail to write {}.\n", profile_file);
+			if (miniplc0::Sampler::GetDropped() != 0)
+				fmt::print(stderr, "The profiler dropped {} samples.\n", miniplc0::Sampler::GetDropped());
+		}
+		if (!trace_file.empty()) {
+			miniplc0::Tracer::Stop();
+			std::ofstream outf(trace_file, std::ios::out | std::ios::trunc);
+			miniplc0::Tracer::WriteChrome(outf);
+			if (!outf)
+				fmt::print(stderr, "Fail to write {}.\n", trace_file);
+		}
+		if (alloc_stats) {
+			for (int i = 0; i < miniplc0::ALLOCATION_PHASES; i++) {
+				auto phase = (miniplc0::AllocationPhase)i;
+				auto stats = miniplc0::AllocationTracker::Get(phase);
+				fmt::print(stderr, "{:<10}{:>12} allocations{:>12} deallocations{:>14} bytes\n", miniplc0::AllocationTracker::GetPhaseName(phase),
+					stats._allocations, stats._deallocations, stats._bytes);
+			}
+		}
+		exit(status);
+	};
+
 	auto input_file = program.get<std::string>("input");
 	auto output_file = program.get<std::string>("--output");
 	std::istream* input;
@@ -374,6 +236,24 @@ int main(int argc, char** argv) {
         fmt::print(stderr, "You can only perform -s or -c at one time.");
         exit(2);
     }
+    if (program["--watch"] == true) {
+        if (input_file == "-" || (program["-s"] == false && program["-c"] == false)) {
+            fmt::print(stderr, "--watch needs an input file and -s or -c.");
+            exit(2);
+        }
+        if (!profile_file.empty() || !trace_file.empty() || alloc_stats) {
+            fmt::print(stderr, "--profile, --trace and --alloc-stats can not be used with --watch.");
+            exit(2);
+        }
+        exit(Watch(input_file, output_file != "-" ? output_file : "out", program["-c"] == true, options, threads,
+            cache, cache_file, program["--no-extensions"] == false));
+    }
+    if (!profile_file.empty() && !miniplc0::Sampler::Start()) {
+        fmt::print(stderr, "Fail to start the sampling profiler.");
+        exit(2);
+    }
+    if (!trace_file.empty())
+        miniplc0::Tracer::Start();
     if (program["-s"] == true) {
         if(output_file!="-"){
             outf.open(output_file, std::ios::out | std::ios::trunc);
@@ -391,7 +271,8 @@ int main(int argc, char** argv) {
             }
             output = &outf;
         }
-        Analyse(*input, *output);
+        if (!Analyse(*input, *output, options, threads, cachePtr))
+            finish(2);
     }
     else if (program["-c"] == true) {
         if(output_file!="-"){
@@ -410,11 +291,14 @@ int main(int argc, char** argv) {
             }
             output = &outf;
         }
-        AnalyseBinary(*input, *output);
+        if (!AnalyseBinary(*input, *output, options, threads, cachePtr, program["--no-extensions"] == false))
+            finish(2);
     }
 	else {
 		fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
 		exit(2);
 	}
-	exit(0);
+	if (cachePtr != nullptr)
+		SaveCache(cache_file, cache);
+	finish(0);
 }
\ No newline at end of file
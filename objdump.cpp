@@ -0,0 +1,79 @@
+#include "argparse.hpp"
+#include "fmt/core.h"
+
+#include "object/loader.h"
+#include "fmts.hpp"
+#include "listing.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+
+// 输出缓冲区的大小，几兆的文件几次 write 就能写完
+const std::size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+int main(int argc, char** argv) {
+	argparse::ArgumentParser program("cc0-objdump");
+	program.add_argument("input")
+		.help("specify the .o0 file to be disassembled.");
+	program.add_argument("-o", "--output")
+		.required()
+		.default_value(std::string("-"))
+		.help("specify the output file.");
+	program.add_argument("-j", "--threads")
+		.default_value(0)
+		.action([](const std::string& value) { return std::stoi(value); })
+		.help("number of threads used to decode functions, 0 means one per hardware thread.");
+
+	try {
+		program.parse_args(argc, argv);
+	}
+	catch (const std::runtime_error& err) {
+		fmt::print(stderr, "{}\n\n", err.what());
+		program.print_help();
+		exit(2);
+	}
+
+	auto input_file = program.get<std::string>("input");
+	auto output_file = program.get<std::string>("--output");
+	int threads = program.get<int>("--threads");
+
+	miniplc0::Loader loader;
+	auto err = loader.Load(input_file);
+	if (err.has_value()) {
+		fmt::print(stderr, "Fail to load {}: {}\n", input_file, err.value());
+		exit(2);
+	}
+	err = loader.DecodeAll(threads < 0 ? 0 : threads);
+	if (err.has_value()) {
+		fmt::print(stderr, "Fail to decode {}: {}\n", input_file, err.value());
+		exit(2);
+	}
+
+	// 缓冲区必须在第一次输出之前设置
+	std::unique_ptr<char[]> buffer(new char[OUTPUT_BUFFER_SIZE]);
+	std::ostream* output;
+	std::ofstream outf;
+	if (output_file != "-") {
+		outf.rdbuf()->pubsetbuf(buffer.get(), OUTPUT_BUFFER_SIZE);
+		outf.open(output_file, std::ios::out | std::ios::trunc);
+		if (!outf) {
+			fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
+			exit(2);
+		}
+		output = &outf;
+	}
+	else {
+		std::ios::sync_with_stdio(false);
+		std::cout.rdbuf()->pubsetbuf(buffer.get(), OUTPUT_BUFFER_SIZE);
+		output = &std::cout;
+	}
+
+	miniplc0::WriteListing(*output, loader.GetConstants(), loader.GetStartCode(), loader.GetFunctions(),
+		[&loader](std::size_t i) -> const std::vector<miniplc0::Instruction>& { return loader.GetFunction(i); });
+	if (!*output) {
+		fmt::print(stderr, "Fail to write {}.\n", output_file);
+		exit(2);
+	}
+	exit(0);
+}
@@ -0,0 +1,445 @@
+#include "object/loader.h"
+#include "instruction/opcode.h"
+
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+	// 带越界检查的大端序读取
+	class byteReader {
+	public:
+		byteReader(const unsigned char* data, std::size_t size, std::size_t pos) : _data(data), _size(size), _pos(pos) {}
+
+		bool has(std::size_t n) const { return _pos <= _size && _size - _pos >= n; }
+		uint32_t u1() { return _data[_pos++]; }
+		uint32_t u2() { uint32_t n = ((uint32_t)_data[_pos] << 8) | _data[_pos + 1]; _pos += 2; return n; }
+		uint32_t u4() { uint32_t n = ((uint32_t)u2() << 16); return n | u2(); }
+		void skip(std::size_t n) { _pos += n; }
+	public:
+		const unsigned char* _data;
+		std::size_t _size;
+		std::size_t _pos;
+	};
+
+	// 操作数占用的字节数，不认识的操作码返回 -1
+	static int32_t operandBytes(uint32_t opcode) {
+		auto& info = opcodeOf(opcode);
+		return info.isDefined() ? (int32_t)info.operandBytes() : -1;
+	}
+
+	// 按字节数读出一个操作数，u4 按 int32_t 解释
+	static int32_t readOperand(byteReader& r, uint32_t width) {
+		switch (width) {
+			case 1:
+				return r.u1();
+			case 2:
+				return r.u2();
+			case 4:
+				return (int32_t)r.u4();
+		}
+		return 0;
+	}
+
+	Loader::Loader() : _data(nullptr), _size(0), _mapped(nullptr), _indexed(false) {}
+
+	Loader::~Loader() {
+		close();
+	}
+
+	void Loader::close() {
+#ifndef _WIN32
+		if (_mapped != nullptr)
+			munmap(_mapped, _size);
+#endif
+		_mapped = nullptr;
+		_data = nullptr;
+		_size = 0;
+		_buffer.clear();
+	}
+
+	std::optional<LoadError> Loader::Load(const std::string& path) {
+		close();
+#ifndef _WIN32
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return LoadError(0, ErrOpenFile);
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return LoadError(0, ErrOpenFile);
+		}
+		if (st.st_size == 0) {
+			::close(fd);
+			return LoadError(0, ErrTruncated);
+		}
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return LoadError(0, ErrMapFile);
+		_mapped = p;
+		_data = (const unsigned char*)p;
+		_size = st.st_size;
+#else
+		std::ifstream inf(path, std::ios::in | std::ios::binary);
+		if (!inf)
+			return LoadError(0, ErrOpenFile);
+		_buffer.assign(std::istreambuf_iterator<char>(inf), std::istreambuf_iterator<char>());
+		_data = _buffer.data();
+		_size = _buffer.size();
+#endif
+		return index();
+	}
+
+	std::optional<LoadError> Loader::LoadFromMemory(const unsigned char* data, std::size_t size) {
+		close();
+		_data = data;
+		_size = size;
+		return index();
+	}
+
+	std::optional<LoadError> Loader::index() {
+		_constants.clear();
+		_functions.clear();
+		_frames.clear();
+		_globals = globalData();
+		_lines.clear();
+		byteReader r(_data, _size, 0);
+
+		// 跳过 count 条指令，只检查操作码是否合法
+		auto skipInstructions = [&r](int32_t count) -> std::optional<LoadError> {
+			for (int32_t i = 0; i < count; i++) {
+				if (!r.has(1))
+					return LoadError(r._pos, ErrTruncated);
+				int32_t bytes = operandBytes(r._data[r._pos]);
+				if (bytes < 0)
+					return LoadError(r._pos, ErrBadInstruction);
+				if (!r.has(1 + bytes))
+					return LoadError(r._pos, ErrTruncated);
+				r.skip(1 + bytes);
+			}
+			return {};
+		};
+
+		if (!r.has(8))
+			return LoadError(0, ErrTruncated);
+		if (r.u4() != O0_MAGIC)
+			return LoadError(0, ErrBadMagic);
+		if (r.u4() != O0_VERSION)
+			return LoadError(4, ErrBadVersion);
+
+		if (!r.has(2))
+			return LoadError(r._pos, ErrTruncated);
+		int32_t constants_count = r.u2();
+		for (int32_t i = 0; i < constants_count; i++) {
+			if (!r.has(1))
+				return LoadError(r._pos, ErrTruncated);
+			std::size_t pos = r._pos;
+			constantInfo c;
+			switch (r.u1()) {
+				case 0: {   //u2 length; u1 value[length];
+					if (!r.has(2))
+						return LoadError(r._pos, ErrTruncated);
+					std::size_t length = r.u2();
+					if (!r.has(length))
+						return LoadError(r._pos, ErrTruncated);
+					c._type = "S";
+					c._value.assign((const char*)_data + r._pos, length);
+					r.skip(length);
+					break;
+				}
+				case 1: {   //int32_t value;
+					if (!r.has(4))
+						return LoadError(r._pos, ErrTruncated);
+					c._type = "I";
+					c._value = std::to_string((int32_t)r.u4());
+					break;
+				}
+				case 2: {   //double value;
+					if (!r.has(8))
+						return LoadError(r._pos, ErrTruncated);
+					uint64_t bits = ((uint64_t)r.u4() << 32);
+					bits |= r.u4();
+					double value;
+					std::memcpy(&value, &bits, sizeof(value));
+					std::ostringstream ss;
+					ss.precision(17);
+					ss << value;
+					c._type = "D";
+					c._value = ss.str();
+					break;
+				}
+				default:
+					return LoadError(pos, ErrBadConstant);
+			}
+			_constants.emplace_back(c);
+		}
+
+		auto extensions = locateIndex(r._pos);
+		_indexed = extensions.has_value();
+		if (_indexed)
+			r._pos = extensions.value();
+		else {
+			if (!r.has(2))
+				return LoadError(r._pos, ErrTruncated);
+			_start = functionInfo{ -1, 0, 0, (int32_t)r.u2(), 0 };
+			_start._offset = r._pos;
+			auto err = skipInstructions(_start._instructions_count);
+			if (err.has_value())
+				return err;
+
+			if (!r.has(2))
+				return LoadError(r._pos, ErrTruncated);
+			int32_t functions_count = r.u2();
+			for (int32_t i = 0; i < functions_count; i++) {
+				if (!r.has(8))
+					return LoadError(r._pos, ErrTruncated);
+				functionInfo f;
+				f._name_index = r.u2();
+				f._params_size = r.u2();
+				f._level = r.u2();
+				f._instructions_count = r.u2();
+				f._offset = r._pos;
+				err = skipInstructions(f._instructions_count);
+				if (err.has_value())
+					return err;
+				_functions.emplace_back(f);
+			}
+		}
+
+		// 扩展段，不认识的直接跳过
+		std::vector<uint32_t> seen;
+		while (r._pos < _size) {
+			if (!r.has(8))
+				return LoadError(r._pos, ErrTruncated);
+			std::size_t pos = r._pos;
+			uint32_t tag = r.u4();
+			std::size_t length = r.u4();
+			if (!r.has(length))
+				return LoadError(r._pos, ErrTruncated);
+			byteReader section(_data, r._pos + length, r._pos);
+			r.skip(length);
+			// 认识的段只能出现一次，重复的段会接在前一个后面，下标全部错开
+			if (tag == EXT_FRAME || tag == EXT_DATA || tag == EXT_LINE) {
+				if (std::find(seen.begin(), seen.end(), tag) != seen.end())
+					return LoadError(pos, ErrBadExtension);
+				seen.push_back(tag);
+			}
+			if (tag == EXT_FRAME) {
+				if (length != 4 * (_functions.size() + 1))
+					return LoadError(pos, ErrBadExtension);
+				for (std::size_t i = 0; i <= _functions.size(); i++) {
+					int32_t max_stack = section.u2();
+					int32_t locals = section.u2();
+					// 0xffff 是写出时的 -1
+					if (max_stack == 0xffff || locals == 0xffff)
+						_frames.emplace_back();
+					else
+						_frames.emplace_back(max_stack, locals);
+				}
+			}
+			else if (tag == EXT_DATA) {
+				if (length < 8)
+					return LoadError(pos, ErrBadExtension);
+				int32_t resume = section.u4();
+				std::size_t count = section.u4();
+				if (resume < 0 || resume > _start._instructions_count || length != 8 + 4 * count)
+					return LoadError(pos, ErrBadExtension);
+				std::vector<int32_t> values(count);
+				for (auto& it : values)
+					it = (int32_t)section.u4();
+				_globals = globalData(resume, std::move(values));
+			}
+			else if (tag == EXT_LINE) {
+				if (!section.has(4) || section.u4() != _functions.size() + 1)
+					return LoadError(pos, ErrBadExtension);
+				for (std::size_t i = 0; i <= _functions.size(); i++) {
+					if (!section.has(4))
+						return LoadError(pos, ErrBadExtension);
+					std::size_t size = section.u4();
+					if (!section.has(size))
+						return LoadError(pos, ErrBadExtension);
+					auto table = LineTable::Decode(_data + section._pos, size);
+					if (!table.has_value())
+						return LoadError(pos, ErrBadExtension);
+					_lines.emplace_back(std::move(table.value()));
+					section.skip(size);
+				}
+			}
+		}
+
+		_once.reset(new std::once_flag[_functions.size() + 1]);
+		_code.assign(_functions.size() + 1, std::vector<Instruction>());
+		_errors.assign(_functions.size() + 1, std::nullopt);
+		return {};
+	}
+
+	std::optional<std::size_t> Loader::locateIndex(std::size_t constantsEnd) {
+		// 尾部：u4 index_offset; u4 tag;
+		if (_size < constantsEnd + 8)
+			return {};
+		byteReader footer(_data, _size, _size - 8);
+		std::size_t offset = footer.u4();
+		if (footer.u4() != EXT_INDEX || offset < constantsEnd || offset > _size - 8)
+			return {};
+		byteReader r(_data, _size, offset);
+		if (!r.has(8) || r.u4() != EXT_INDEX)
+			return {};
+		std::size_t length = r.u4();
+		// 至少有 start_offset、extensions_offset 和尾部
+		if (length != _size - offset - 8 || length % 4 != 0 || length < 16)
+			return {};
+		std::size_t functions_count = length / 4 - 4;
+
+		std::size_t start = r.u4();
+		std::vector<functionInfo> functions;
+		for (std::size_t i = 0; i < functions_count; i++) {
+			byteReader header(_data, offset, r.u4());
+			if (!header.has(8))
+				return {};
+			functionInfo f;
+			f._name_index = header.u2();
+			f._params_size = header.u2();
+			f._level = header.u2();
+			f._instructions_count = header.u2();
+			f._offset = header._pos;
+			functions.emplace_back(f);
+		}
+		std::size_t extensions = r.u4();
+		byteReader code(_data, offset, start);
+		if (start < constantsEnd || !code.has(2) || extensions > offset)
+			return {};
+		_start = functionInfo{ -1, 0, 0, (int32_t)code.u2(), code._pos };
+		_functions = std::move(functions);
+		return extensions;
+	}
+
+	std::vector<Instruction> Loader::decode(const functionInfo& f, std::optional<LoadError>& err) const {
+		std::vector<Instruction> result;
+		result.reserve(f._instructions_count);
+		byteReader r(_data, _size, f._offset);
+		for (int32_t i = 0; i < f._instructions_count; i++) {
+			if (!r.has(1)) {
+				err = LoadError(r._pos, ErrTruncated);
+				break;
+			}
+			auto op = (Operation)r._data[r._pos];
+			int32_t bytes = operandBytes(op);
+			if (bytes < 0) {
+				err = LoadError(r._pos, ErrBadInstruction);
+				break;
+			}
+			if (!r.has(1 + bytes)) {
+				err = LoadError(r._pos, ErrTruncated);
+				break;
+			}
+			r.skip(1);
+			auto& info = opcodeOf(op);
+			int32_t x = readOperand(r, info._x_width);
+			int32_t y = readOperand(r, info._y_width);
+			result.emplace_back(op, x, y);
+		}
+		return result;
+	}
+
+	const std::vector<Instruction>& Loader::code(std::size_t index) {
+		std::call_once(_once[index], [this, index]() {
+			_code[index] = decode(index == 0 ? _start : _functions[index - 1], _errors[index]);
+		});
+		return _code[index];
+	}
+
+	std::optional<LoadError> Loader::DecodeAll(unsigned int threads) {
+		std::size_t n = _functions.size() + 1;
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = std::min<std::size_t>(threads, n);
+
+		std::atomic<std::size_t> next(0);
+		auto worker = [this, n, &next]() {
+			for (std::size_t i = next++; i < n; i = next++)
+				code(i);
+		};
+		std::vector<std::thread> pool;
+		for (unsigned int i = 1; i < threads; i++)
+			pool.emplace_back(worker);
+		worker();
+		for (auto& it : pool)
+			it.join();
+
+		for (auto& it : _errors)
+			if (it.has_value())
+				return it;
+		return {};
+	}
+
+	const std::vector<Instruction>& Loader::GetStartCode() {
+		return code(0);
+	}
+
+	const std::vector<Instruction>& Loader::GetFunction(int32_t index) {
+		static const std::vector<Instruction> empty;
+		if (index < 0 || (std::size_t)index >= _functions.size() || (std::size_t)index + 1 >= _code.size())
+			return empty;
+		return code(index + 1);
+	}
+
+	const LineTable& Loader::GetLineTable(int32_t index) const {
+		static const LineTable empty;
+		return index + 1 >= 0 && (std::size_t)(index + 1) < _lines.size() ? _lines[index + 1] : empty;
+	}
+
+	std::vector<LineTable> Loader::GetLineTables() const {
+		return _lines;
+	}
+
+	frameInfo Loader::GetStartFrame() const {
+		return _frames.empty() ? frameInfo() : _frames[0];
+	}
+
+	frameInfo Loader::GetFrame(int32_t index) const {
+		return index + 1 >= 0 && (std::size_t)(index + 1) < _frames.size() ? _frames[index + 1] : frameInfo();
+	}
+
+	std::vector<functionsTable> Loader::GetFunctionTable() {
+		std::vector<functionsTable> result;
+		for (std::size_t i = 0; i < _functions.size(); i++) {
+			auto& f = _functions[i];
+			string name = f._name_index < (int32_t)_constants.size() ? _constants[f._name_index]._value : "";
+			functionsTable t("S", f._params_size, f._level, name);
+			// 没有返回指令的函数不会返回，当作 void
+			t._haveReturnValue = 0;
+			for (auto& it : GetFunction(i)) {
+				if (it.GetOperation() == IRET || it.GetOperation() == RET) {
+					t._haveReturnValue = it.GetOperation() == IRET ? 1 : 0;
+					break;
+				}
+			}
+			auto frame = GetFrame(i);
+			t._slots = frame.isKnown() ? frame._locals : 0;
+			result.emplace_back(t);
+		}
+		return result;
+	}
+
+	std::vector<functionBodyTable> Loader::GetFunctionBodies() {
+		std::vector<functionBodyTable> result(_functions.size());
+		for (std::size_t i = 0; i < _functions.size(); i++) {
+			result[i]._funins = GetFunction(i);
+			result[i]._frame = GetFrame(i);
+		}
+		return result;
+	}
+}
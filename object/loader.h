@@ -0,0 +1,129 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "systable/systable.h"
+#include "object/object.h"
+#include "debug/linetable.h"
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	enum LoadErrorCode {
+		ErrOpenFile,
+		ErrMapFile,
+		ErrBadMagic,
+		ErrBadVersion,
+		ErrTruncated,           // 文件在某个结构的中间结束了
+		ErrBadConstant,
+		ErrBadInstruction,      // 不认识的操作码
+		ErrBadExtension         // 扩展段的内容和基础部分对不上
+	};
+
+	class LoadError final {
+	public:
+		LoadError(std::size_t offset, LoadErrorCode err) : _offset(offset), _err(err) {}
+
+		// 出错位置在文件中的字节偏移
+		std::size_t GetOffset() const { return _offset; }
+		LoadErrorCode GetCode() const { return _err; }
+	private:
+		std::size_t _offset;
+		LoadErrorCode _err;
+	};
+
+	class constantInfo {
+	public:
+		string _type;       //S 字符串，I 整数，D 浮点数
+		string _value;
+	};
+
+	class functionInfo {
+	public:
+		int32_t _name_index;
+		int32_t _params_size;
+		int32_t _level;
+		int32_t _instructions_count;
+		std::size_t _offset;        //第一条指令在文件中的字节偏移
+	};
+
+	// .o0 加载器
+	// Load 时把整个文件映射进内存，记下常量、.start、每个函数的头部和扩展段的位置，不解码任何指令
+	// 文件末尾有 INDX 扩展段时直接按偏移定位，否则扫描一遍指令（同时检查操作码）
+	// 函数的指令在第一次被用到时才解码，之后缓存起来
+	// 解码是线程安全的，不同的函数可以在不同的线程上同时解码
+	class Loader final {
+	private:
+		using int32_t = std::int32_t;
+	public:
+		Loader();
+		~Loader();
+		Loader(const Loader&) = delete;
+		Loader(Loader&&) = delete;
+		Loader& operator=(Loader) = delete;
+
+		std::optional<LoadError> Load(const std::string& path);
+		// 从内存加载，不拷贝数据，调用者需要保证 data 在 Loader 销毁之前一直有效
+		std::optional<LoadError> LoadFromMemory(const unsigned char* data, std::size_t size);
+
+		const std::vector<constantInfo>& GetConstants() const { return _constants; }
+		const std::vector<functionInfo>& GetFunctions() const { return _functions; }
+		std::size_t GetStartOffset() const { return _start._offset; }
+		// 是否通过 INDX 扩展段定位，此时指令的合法性要到解码时才检查
+		bool HasIndex() const { return _indexed; }
+
+		// 用 threads 个线程解码所有函数，0 表示使用硬件线程数
+		// 返回 .start 和函数中按顺序的第一个错误
+		std::optional<LoadError> DecodeAll(unsigned int threads = 0);
+
+		// 懒解码的指令，解码出错时只包含出错之前的指令，错误由 DecodeAll 报告；index 越界时为空
+		const std::vector<Instruction>& GetStartCode();
+		const std::vector<Instruction>& GetFunction(int32_t index);
+
+		// 虚拟机和校验器使用的函数表，函数是否有返回值由函数体中的返回指令推断
+		std::vector<functionsTable> GetFunctionTable();
+		// 解码所有函数，附带栈帧信息
+		std::vector<functionBodyTable> GetFunctionBodies();
+		// 栈帧信息，没有 FRAM 扩展段或者 index 越界时为未知
+		frameInfo GetStartFrame() const;
+		frameInfo GetFrame(int32_t index) const;
+		// DATA 段，没有时为未知
+		const globalData& GetGlobalData() const { return _globals; }
+		// LINE 段，index 为 -1 时是 .start，没有 LINE 段或者 index 越界时返回空表
+		const LineTable& GetLineTable(int32_t index) const;
+		// 所有行号表，下标 0 为 .start，没有 LINE 段时为空
+		std::vector<LineTable> GetLineTables() const;
+	private:
+		void close();
+		std::optional<LoadError> index();
+		// 通过文件末尾的 INDX 扩展段定位 .start 和每个函数，成功时返回第一个扩展段的偏移
+		std::optional<std::size_t> locateIndex(std::size_t constantsEnd);
+		std::vector<Instruction> decode(const functionInfo& f, std::optional<LoadError>& err) const;
+		const std::vector<Instruction>& code(std::size_t index);
+	private:
+		// 映射的内存，不支持 mmap 的平台上是读进来的 _buffer
+		const unsigned char* _data;
+		std::size_t _size;
+		void* _mapped;
+		std::vector<unsigned char> _buffer;
+
+		std::vector<constantInfo> _constants;
+		functionInfo _start;
+		std::vector<functionInfo> _functions;
+		std::vector<frameInfo> _frames;     //FRAM 段，下标 0 为 .start
+		globalData _globals;                //DATA 段
+		std::vector<LineTable> _lines;      //LINE 段，下标 0 为 .start
+		bool _indexed;
+
+		// 下标 0 为 .start，i+1 为第 i 个函数
+		std::unique_ptr<std::once_flag[]> _once;
+		std::vector<std::vector<Instruction>> _code;
+		std::vector<std::optional<LoadError>> _errors;
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+namespace miniplc0 {
+
+	// .o0 目标文件格式
+	//
+	// u4 magic;                            must be 0x43303A29
+	// u4 version;
+	// u2 constants_count;
+	// Constant_info constants[constants_count];
+	// Start_code_info start_code;
+	// u2 functions_count;
+	// Function_info functions[functions_count];
+	//
+	// 之后是若干可选的扩展段，只认识基础格式的加载器读完函数后就停止了，因此不受影响
+	// Extension_info {
+	//     u4 tag;
+	//     u4 length;
+	//     u1 data[length];
+	// }
+	// 不认识的扩展段可以按 length 直接跳过
+	const std::uint32_t O0_MAGIC = 0x43303A29;
+	const std::uint32_t O0_VERSION = 1;
+
+	enum ExtensionTag : std::uint32_t {
+		// 栈帧信息
+		// u2 max_stack; u2 locals;        .start
+		// { u2 max_stack; u2 locals; } [functions_count]
+		EXT_FRAME = 0x4652414D, // "FRAM"
+		// 编译时算好的全局变量，.start 仍然完整保留，不认识的加载器照常从头执行
+		// u4 resume;                       执行完 .start 的前 resume 条指令后
+		// u4 count;
+		// u4 values[count];                栈上恰好是这些 slot
+		// 加载器可以直接把 values 复制到栈上，从 .start 的第 resume 条指令开始执行
+		EXT_DATA = 0x44415441,  // "DATA"
+		// 行号表，只用于调试和剖析，编码见 LineTable
+		// u4 count;                        functions_count + 1
+		// { u4 length; u1 table[length]; } [count]      第一个是 .start
+		EXT_LINE = 0x4C494E45,  // "LINE"
+		// 字节偏移索引，必须是最后一个扩展段，这样文件的最后 8 个字节就是固定的尾部
+		// u4 start_offset;                 .start 的 instructions_count 的偏移
+		// u4 function_offsets[functions_count];   每个 Function_info 的 name_index 的偏移
+		// u4 extensions_offset;            第一个扩展段的偏移
+		// u4 index_offset;                 本扩展段 tag 的偏移
+		// u4 tag;                          再写一遍 "INDX"
+		// 加载器先读最后 8 个字节，找到索引后不必扫描指令就能定位每个函数
+		EXT_INDEX = 0x494E4458, // "INDX"
+	};
+}
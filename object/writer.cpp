@@ -0,0 +1,177 @@
+#include "object/writer.h"
+#include "profiler/trace.h"
+#include "profiler/allocation.h"
+
+#include <sstream>
+
+namespace miniplc0 {
+
+	static unsigned int u2ChangeToBigEnd(unsigned int n){//uint16_t
+		auto *p=(unsigned char*)&n;
+		return (((unsigned int)*p<<8)+((unsigned int)*(p+1)));
+	}
+	static unsigned int u4ChangeToBigEnd(unsigned int n){//uint32_t
+		auto *p=(unsigned char*)&n;
+		return (((unsigned int)*p<<24) + ((unsigned int)*(p+1)<<16) + ((unsigned int)*(p+2)<<8) + ((unsigned int)*(p+3)));
+	}
+	unsigned int opCount(const Instruction &p){
+		auto& info=opcodeOf(p.GetOperation());
+		if(!info.isDefined())
+			return -1;
+		return (info._x_width<<4)|info._y_width;
+	}
+
+	unsigned int instructionSize(const Instruction& ins){
+		return 1+opcodeOf(ins.GetOperation()).operandBytes();
+	}
+
+	void writeU1(std::ostream& output, unsigned int n){
+		output.write((char*)&n,sizeof(int8_t));
+	}
+	void writeU2(std::ostream& output, unsigned int n){
+		n=u2ChangeToBigEnd(n);
+		output.write((char*)&n,sizeof(int16_t));
+	}
+	void writeU4(std::ostream& output, unsigned int n){
+		n=u4ChangeToBigEnd(n);
+		output.write((char*)&n,sizeof(int32_t));
+	}
+	void writeExtension(std::ostream& output, ExtensionTag tag, const std::string& data){
+		writeU4(output,tag);
+		writeU4(output,data.size());
+		output.write(data.data(),data.size());
+	}
+
+	//FRAM 中的一项：u2 max_stack; u2 locals;
+	//未知或者放不进 u2 的栈帧整项写成 0xffff，加载器把它当作未知，不能截断成一个偏小的值
+	static void writeFrame(std::ostream& output, const frameInfo& frame){
+		if(!frame.isKnown() || frame._max_stack>=0xffff || frame._locals>=0xffff){
+			writeU2(output,0xffff);
+			writeU2(output,0xffff);
+			return;
+		}
+		writeU2(output,frame._max_stack);
+		writeU2(output,frame._locals);
+	}
+
+	//按字节数写入一个操作数
+	static void writeOperand(std::ostream& output, unsigned int width, unsigned int n){
+		switch(width){
+			case 1:
+				writeU1(output,n);
+				break;
+			case 2:
+				writeU2(output,n);
+				break;
+			case 4:
+				writeU4(output,n);
+				break;
+		}
+	}
+
+	void writeInstruction(std::ostream& output, const Instruction& ins){
+		auto& info=opcodeOf(ins.GetOperation());
+		writeU1(output,ins.GetOperation());
+		writeOperand(output,info._x_width,ins.GetX());
+		writeOperand(output,info._y_width,ins.GetY());
+	}
+
+	void WriteBinary(std::ostream& output, const std::vector<functionsTable>& _fun, const std::vector<Instruction>& _st,
+			const frameInfo& startFrame, const globalData& data, const std::vector<functionBodyTable>& _fun_body,
+			const std::vector<LineTable>& lines, bool extensions){
+		TraceScope trace(__func__);
+		AllocationScope allocation(AllocEmit);
+		//记下每一段的字节偏移，写 INDX 时使用
+		uint32_t pos=0;
+		std::vector<uint32_t> offsets;
+		//u4 magic;
+		writeU4(output,O0_MAGIC);
+		//u4 version;
+		writeU4(output,O0_VERSION);
+		//u2 constants_count;
+		writeU2(output,_fun.size());
+		pos+=10;
+		//Constant_info constants[constants_count];
+		for(unsigned int i=0;i<_fun.size();i++){
+			//u1 type;u2 length;u1 value[length];
+			writeU1(output,0);
+			writeU2(output,_fun[i]._value.length());
+			output<<_fun[i]._value;
+			pos+=3+_fun[i]._value.length();
+		}
+		//Start_code_info start_code;
+		//u2 instructions_count;
+		//Instruction instructions[instructions_count];
+		offsets.push_back(pos);
+		writeU2(output,_st.size());
+		pos+=2;
+		for(auto& it : _st){
+			writeInstruction(output,it);
+			pos+=instructionSize(it);
+		}
+		//u2 functions_count;
+		writeU2(output,_fun.size());
+		pos+=2;
+		//Function_info functions[functions_count];
+		//u2 name_index; // name: CO_binary_file.strings[name_index]
+		//u2 params_size;
+		//u2 level;
+		//u2 instructions_count;
+		//Instruction instructions[instructions_count];
+		for(unsigned int i=0;i<_fun.size();i++){
+			offsets.push_back(pos);
+			writeU2(output,i);
+			writeU2(output,_fun[i]._params_size);
+			writeU2(output,_fun[i]._level);
+			writeU2(output,_fun_body[i]._funins.size());
+			pos+=8;
+			for(auto& it : _fun_body[i]._funins){
+				writeInstruction(output,it);
+				pos+=instructionSize(it);
+			}
+		}
+
+		if(extensions){
+			offsets.push_back(pos);
+			//FRAM: 栈帧信息，加载器据此可以一次分配好整个栈帧
+			std::ostringstream frame;
+			writeFrame(frame,startFrame);
+			for(unsigned int i=0;i<_fun.size();i++)
+				writeFrame(frame,_fun_body[i]._frame);
+			writeExtension(output,EXT_FRAME,frame.str());
+			pos+=8+frame.str().size();
+
+			//DATA: 编译时算好的全局变量，加载器可以跳过 .start 的前 resume 条指令
+			if(data.isKnown()){
+				std::ostringstream values;
+				writeU4(values,data._resume);
+				writeU4(values,data._values.size());
+				for(auto value : data._values)
+					writeU4(values,(uint32_t)value);
+				writeExtension(output,EXT_DATA,values.str());
+				pos+=8+values.str().size();
+			}
+
+			//LINE: 行号表，下标 0 为 .start
+			if(lines.size()==_fun.size()+1){
+				std::ostringstream table;
+				writeU4(table,lines.size());
+				for(auto& it : lines){
+					writeU4(table,it.GetEncoded().size());
+					table<<it.GetEncoded();
+				}
+				writeExtension(output,EXT_LINE,table.str());
+				pos+=8+table.str().size();
+			}
+
+			//INDX: 必须放在最后
+			std::ostringstream index;
+			for(auto offset : offsets)
+				writeU4(index,offset);
+			writeU4(index,pos);
+			writeU4(index,EXT_INDEX);
+			writeExtension(output,EXT_INDEX,index.str());
+		}
+		output<<std::flush;
+	}
+}
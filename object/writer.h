@@ -0,0 +1,35 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "instruction/opcode.h"
+#include "systable/systable.h"
+#include "object/object.h"
+#include "debug/linetable.h"
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace miniplc0 {
+
+	// 操作数的宽度：0 没有操作数，0x10 为 u1，0x20 为 u2，0x40 为 u4，0x24 为 u2 加 u4，不认识的指令返回 -1
+	unsigned int opCount(const Instruction &p);
+
+	// 指令编码后的字节数
+	unsigned int instructionSize(const Instruction& ins);
+
+	// 大端序写入
+	void writeU1(std::ostream& output, unsigned int n);
+	void writeU2(std::ostream& output, unsigned int n);
+	void writeU4(std::ostream& output, unsigned int n);
+	// u4 tag; u4 length; u1 data[length];
+	void writeExtension(std::ostream& output, ExtensionTag tag, const std::string& data);
+	// u1 opcode; 以及按操作数宽度写入的操作数
+	void writeInstruction(std::ostream& output, const Instruction& ins);
+
+	// 写出 .o0 目标文件，函数下标和常量下标一一对应
+	// extensions 为 false 时不写任何扩展段，data 未知时不写 DATA 段，lines 为空时不写 LINE 段
+	void WriteBinary(std::ostream& output, const std::vector<functionsTable>& fun, const std::vector<Instruction>& start,
+		const frameInfo& startFrame, const globalData& data, const std::vector<functionBodyTable>& bodies,
+		const std::vector<LineTable>& lines, bool extensions);
+}
@@ -0,0 +1,382 @@
+#include "optimizer/optimizer.h"
+
+#include <algorithm>
+
+namespace miniplc0 {
+
+	bool isJump(Operation op) {
+		return opcodeOf(op)._branch;
+	}
+
+	bool isReturn(Operation op) {
+		return opcodeOf(op).isReturn();
+	}
+
+	void stackEffect(const Instruction& ins, const std::vector<functionsTable>& fun, int32_t& pop, int32_t& push) {
+		auto& info = opcodeOf(ins.GetOperation());
+		pop = info._pop;
+		push = info._push;
+		switch (ins.GetOperation()) {
+			case POPN:
+				pop = ins.GetX();
+				break;
+			case SNEW:
+				push = ins.GetX();
+				break;
+			case CALL: {
+				int32_t index = ins.GetX();
+				pop = 0;
+				push = 0;
+				if (index >= 0 && index < (int32_t)fun.size()) {
+					pop = fun[index]._params_size;
+					push = fun[index]._haveReturnValue == 1 ? 1 : 0;
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	std::vector<int32_t> stackHeights(const std::vector<Instruction>& ins, const std::vector<functionsTable>& fun, int32_t params) {
+		int32_t n = ins.size();
+		std::vector<int32_t> heights(n, -1);
+		std::vector<std::pair<int32_t, int32_t>> work = { { 0, params } };
+		while (!work.empty()) {
+			auto [pc, height] = work.back();
+			work.pop_back();
+			// 合流点的栈高度以第一次到达时为准
+			while (pc >= 0 && pc < n && heights[pc] == -1) {
+				heights[pc] = height;
+				int32_t pop, push;
+				stackEffect(ins[pc], fun, pop, push);
+				height = height - pop + push;
+				auto op = ins[pc].GetOperation();
+				if (isJump(op))
+					work.emplace_back(ins[pc].GetX(), height);
+				for (int32_t k = 1; k <= switchCases(ins[pc]); k++)
+					work.emplace_back(pc + 1 + k, height);
+				if (opcodeOf(op)._terminator)
+					break;
+				pc++;
+			}
+		}
+		return heights;
+	}
+
+	frameInfo analyseFrame(const std::vector<Instruction>& ins, const std::vector<functionsTable>& fun, int32_t params, int32_t locals) {
+		auto heights = stackHeights(ins, fun, params);
+		int32_t maxHeight = locals;
+		for (std::size_t i = 0; i < ins.size(); i++) {
+			if (heights[i] < 0)
+				continue;
+			int32_t pop, push;
+			stackEffect(ins[i], fun, pop, push);
+			maxHeight = std::max(maxHeight, std::max(heights[i], heights[i] - pop + push));
+		}
+		return frameInfo(maxHeight - locals, locals);
+	}
+
+	void eliminateDeadCode(std::vector<Instruction>& ins, std::vector<int32_t>* origins) {
+		int32_t n = ins.size();
+		if (n == 0)
+			return;
+
+		// 可达性分析
+		std::vector<bool> keep(n, false);
+		std::vector<int32_t> work = { 0 };
+		while (!work.empty()) {
+			int32_t pc = work.back();
+			work.pop_back();
+			if (pc < 0 || pc >= n || keep[pc])
+				continue;
+			keep[pc] = true;
+			auto op = ins[pc].GetOperation();
+			if (isJump(op))
+				work.emplace_back(ins[pc].GetX());
+			for (int32_t k = 1; k <= switchCases(ins[pc]); k++)
+				work.emplace_back(pc + 1 + k);
+			if (!opcodeOf(op)._terminator)
+				work.emplace_back(pc + 1);
+		}
+
+		// 跳转表中的 jmp 靠位置区分 case，即使跳到下一条指令也不能删
+		std::vector<bool> inTable(n, false);
+		for (int32_t i = 0; i < n; i++) {
+			if (ins[i].GetOperation() != TABLESWITCH)
+				continue;
+			for (int32_t k = 0; k <= switchCases(ins[i]) && i + 1 + k < n; k++)
+				inTable[i + 1 + k] = true;
+		}
+
+		// 从后往前，nextKept[i] 是 i 及其之后第一条被保留的指令
+		// 如果 jmp 的目标和它的下一条保留指令相同，那么这条 jmp 没有意义
+		std::vector<int32_t> nextKept(n + 1, n);
+		for (int32_t i = n - 1; i >= 0; i--) {
+			if (keep[i] && ins[i].GetOperation() == JMP && !inTable[i]) {
+				int32_t target = ins[i].GetX();
+				if (target > i && target <= n && nextKept[target] == nextKept[i + 1])
+					keep[i] = false;
+			}
+			nextKept[i] = keep[i] ? i : nextKept[i + 1];
+		}
+
+		// 新下标，newIndex[n] 指向函数末尾
+		std::vector<int32_t> newIndex(n + 1, 0);
+		for (int32_t i = 0; i < n; i++)
+			newIndex[i + 1] = newIndex[i] + (keep[i] ? 1 : 0);
+
+		std::vector<Instruction> result;
+		std::vector<int32_t> resultOrigins;
+		bool withOrigins = origins != nullptr && (int32_t)origins->size() == n;
+		result.reserve(newIndex[n]);
+		for (int32_t i = 0; i < n; i++) {
+			if (!keep[i])
+				continue;
+			result.emplace_back(ins[i]);
+			if (withOrigins)
+				resultOrigins.emplace_back((*origins)[i]);
+			int32_t target = ins[i].GetX();
+			if (isJump(ins[i].GetOperation()) && target >= 0 && target <= n)
+				result.back().SetX(newIndex[nextKept[target]]);
+		}
+		ins = std::move(result);
+		if (withOrigins)
+			*origins = std::move(resultOrigins);
+	}
+
+	// 是否可以被内联：
+	// 有返回值，指令数不超过预算，只有末尾一条 iret，没有跳转和调用，
+	// 只访问参数和全局变量，并且 iret 之前栈上除了参数只有返回值（即没有局部变量）
+	static bool isInlinable(const std::vector<Instruction>& body, const functionsTable& f,
+			const std::vector<functionsTable>& fun, int32_t budget) {
+		int32_t n = body.size();
+		if (f._haveReturnValue != 1 || n == 0 || n - 1 > budget)
+			return false;
+		if (body[n - 1].GetOperation() != IRET)
+			return false;
+		for (int32_t i = 0; i < n - 1; i++) {
+			auto op = body[i].GetOperation();
+			if (isJump(op) || isReturn(op) || op == CALL)
+				return false;
+			if (op == LOADA && body[i].GetX() == 0 && (body[i].GetY() < 0 || body[i].GetY() >= f._params_size))
+				return false;
+			if (op == LOADA && body[i].GetX() != 0 && body[i].GetX() != 1)
+				return false;
+		}
+		auto heights = stackHeights(body, fun, f._params_size);
+		return heights[n - 1] == f._params_size + 1;
+	}
+
+	globalData evaluateGlobals(const std::vector<Instruction>& start) {
+		using u = uint32_t;
+		// slot 的值，以及它是不是 loada 得到的地址（.start 中 loada 0 的地址就是 slot 的下标）
+		std::vector<int32_t> stack;
+		std::vector<bool> address;
+		int32_t addresses = 0;
+		auto push = [&](int32_t value, bool isAddress) {
+			stack.push_back(value);
+			address.push_back(isAddress);
+			addresses += isAddress;
+		};
+		auto pop = [&](int32_t n) {
+			for (int32_t i = 0; i < n; i++) {
+				addresses -= address.back();
+				stack.pop_back();
+				address.pop_back();
+			}
+		};
+		auto isInt = [&](int32_t n) {
+			int32_t size = stack.size();
+			if (size < n)
+				return false;
+			for (int32_t i = size - n; i < size; i++)
+				if (address[i])
+					return false;
+			return true;
+		};
+
+		// 执行前 limit 条指令中能算出来的部分，返回最后一个栈上没有地址的位置
+		auto run = [&](int32_t limit) {
+			stack.clear();
+			address.clear();
+			addresses = 0;
+			int32_t resume = 0;
+			for (int32_t pc = 0; pc < limit; pc++) {
+				auto& it = start[pc];
+				int32_t x = it.GetX();
+				int32_t size = stack.size();
+				bool ok = true;
+				switch (it.GetOperation()) {
+					case NOP:
+						break;
+					case BIPUSH:
+					case IPUSH:
+						push(x, false);
+						break;
+					case SNEW:
+						ok = x >= 0;
+						for (int32_t i = 0; ok && i < x; i++)
+							push(0, false);
+						break;
+					case POP:
+					case POP2:
+					case POPN: {
+						int32_t n = it.GetOperation() == POP ? 1 : (it.GetOperation() == POP2 ? 2 : x);
+						ok = n >= 0 && size >= n;
+						if (ok)
+							pop(n);
+						break;
+					}
+					case DUP:
+						ok = size >= 1;
+						if (ok)
+							push(stack[size - 1], address[size - 1]);
+						break;
+					case DUP2:
+						ok = size >= 2;
+						if (ok) {
+							push(stack[size - 2], address[size - 2]);
+							push(stack[size - 1], address[size - 1]);
+						}
+						break;
+					case LOADA:
+						ok = x == 0 && it.GetY() >= 0;
+						if (ok)
+							push(it.GetY(), true);
+						break;
+					case ILOAD: {
+						ok = size >= 1 && address[size - 1] && stack[size - 1] < size - 1;
+						if (ok) {
+							int32_t value = stack[stack[size - 1]];
+							pop(1);
+							push(value, false);
+						}
+						break;
+					}
+					case ISTORE: {
+						ok = size >= 2 && address[size - 2] && stack[size - 2] < size - 2 && !address[size - 1];
+						if (ok) {
+							int32_t target = stack[size - 2];
+							addresses -= address[target];
+							stack[target] = stack[size - 1];
+							address[target] = false;
+							pop(2);
+						}
+						break;
+					}
+					case IADD:
+					case ISUB:
+					case IMUL:
+					case IDIV:
+					case ICMP: {
+						ok = isInt(2);
+						if (!ok)
+							break;
+						int32_t lhs = stack[size - 2], rhs = stack[size - 1], value = 0;
+						switch (it.GetOperation()) {
+							case IADD: value = (int32_t)((u)lhs + (u)rhs); break;
+							case ISUB: value = (int32_t)((u)lhs - (u)rhs); break;
+							case IMUL: value = (int32_t)((u)lhs * (u)rhs); break;
+							case ICMP: value = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0); break;
+							default:
+								// 除零留到运行时报错，INT_MIN / -1 和虚拟机一样得到 INT_MIN
+								ok = rhs != 0;
+								value = rhs == -1 ? (int32_t)(0u - (u)lhs) : (ok ? lhs / rhs : 0);
+								break;
+						}
+						if (ok) {
+							pop(2);
+							push(value, false);
+						}
+						break;
+					}
+					case INEG:
+						ok = isInt(1);
+						if (ok)
+							stack[size - 1] = (int32_t)(0u - (u)stack[size - 1]);
+						break;
+					default:
+						ok = false;
+						break;
+				}
+				if (!ok)
+					break;
+				if (addresses == 0)
+					resume = pc + 1;
+			}
+			return resume;
+		};
+
+		// 先找到停下的位置，再重新执行到那里取出栈上的值
+		int32_t resume = run(start.size());
+		if (resume == 0)
+			return globalData();
+		run(resume);
+		return globalData(resume, std::move(stack));
+	}
+
+	void inlineFunctions(std::vector<functionBodyTable>& bodies, const std::vector<functionsTable>& fun, int32_t budget) {
+		int32_t nf = bodies.size();
+		std::vector<bool> inlinable(nf, false);
+		for (int32_t caller = 0; caller < nf; caller++) {
+			auto& ins = bodies[caller]._funins;
+			auto& origins = bodies[caller]._origins;
+			int32_t n = ins.size();
+			auto heights = stackHeights(ins, fun, fun[caller]._params_size);
+			bool withOrigins = (int32_t)origins.size() == n;
+
+			std::vector<Instruction> result;
+			std::vector<int32_t> resultOrigins;
+			// 给新加入 result 的指令补上来源
+			auto mark = [&](int32_t origin) {
+				if (withOrigins)
+					resultOrigins.resize(result.size(), origin);
+			};
+			std::vector<int32_t> newIndex(n + 1, 0);
+			bool changed = false;
+			for (int32_t i = 0; i < n; i++) {
+				newIndex[i] = result.size();
+				int32_t callee = ins[i].GetX();
+				if (ins[i].GetOperation() != CALL || callee < 0 || callee >= caller || !inlinable[callee] || heights[i] < 0) {
+					result.emplace_back(ins[i]);
+					mark(withOrigins ? origins[i] : -1);
+					continue;
+				}
+				int32_t origin = withOrigins ? origins[i] : -1;
+				// 实参已经在栈上，位于 base 到 base+params-1
+				// 被调用者的 loada 0, k 改写为 loada 0, base+k，最后把返回值存入 base 处并弹出其余实参
+				int32_t params = fun[callee]._params_size;
+				int32_t base = heights[i] - params;
+				auto& body = bodies[callee]._funins;
+				auto& bodyOrigins = bodies[callee]._origins;
+				if (params > 0)
+					result.emplace_back(LOADA, 0, base);
+				mark(origin);
+				for (std::size_t j = 0; j + 1 < body.size(); j++) {
+					result.emplace_back(body[j]);
+					if (body[j].GetOperation() == LOADA && body[j].GetX() == 0)
+						result.back().SetY(base + body[j].GetY());
+					mark(bodyOrigins.size() == body.size() ? bodyOrigins[j] : origin);
+				}
+				if (params > 0)
+					result.emplace_back(ISTORE, 0, 0);
+				if (params > 1)
+					result.emplace_back(POPN, params - 1, 0);
+				mark(origin);
+				changed = true;
+			}
+			newIndex[n] = result.size();
+			if (changed) {
+				for (auto& it : result) {
+					if (isJump(it.GetOperation()) && it.GetX() >= 0 && it.GetX() <= n)
+						it.SetX(newIndex[it.GetX()]);
+				}
+				ins = std::move(result);
+				if (withOrigins)
+					origins = std::move(resultOrigins);
+			}
+			inlinable[caller] = isInlinable(ins, fun[caller], fun, budget);
+		}
+	}
+}
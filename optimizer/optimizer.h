@@ -0,0 +1,51 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "instruction/opcode.h"
+#include "systable/systable.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace miniplc0 {
+
+	// 优化选项
+	class optimizeOptions {
+	public:
+		bool _inline = true;            //是否内联小函数
+		int32_t _inline_budget = 12;    //可被内联的函数体的最大指令数（不含 iret）
+	};
+
+	// 是否是跳转指令（jmp 以及各条件跳转）
+	bool isJump(Operation op);
+	// 是否是函数返回指令
+	bool isReturn(Operation op);
+
+	// 指令对操作数栈的影响，以 slot 为单位
+	// pop 为弹出的 slot 数，push 为压入的 slot 数，取自 OPCODES，popn/snew 取决于操作数
+	// call 的影响取决于被调用的函数，因此需要函数表
+	void stackEffect(const Instruction& ins, const std::vector<functionsTable>& fun, int32_t& pop, int32_t& push);
+	// 每条指令执行前栈的高度（相对于栈帧起点，参数占据开头的 slot），不可达的指令为 -1
+	std::vector<int32_t> stackHeights(const std::vector<Instruction>& ins, const std::vector<functionsTable>& fun, int32_t params);
+
+	// 栈帧分析：locals 为参数和局部变量占用的 slot 数，返回操作数栈的最大深度
+	frameInfo analyseFrame(const std::vector<Instruction>& ins, const std::vector<functionsTable>& fun, int32_t params, int32_t locals);
+
+	// 死代码消除：
+	// 1.从第 0 条指令出发做可达性分析，删除所有不可达指令
+	// 2.删除跳转目标恰好是下一条（保留下来的）指令的 jmp
+	// 3.按照删除后的下标重定位所有跳转目标
+	// origins 不为空时和指令一一对应，一起删除
+	void eliminateDeadCode(std::vector<Instruction>& ins, std::vector<int32_t>* origins = nullptr);
+
+	// 全局变量初始化的编译时求值：
+	// 从 .start 的开头执行只涉及常量、算术和已经算好的全局变量的指令，遇到 call、输入输出、跳转、除零等就停下
+	// 返回停下之前最后一个栈上没有地址的位置，以及此时栈上的 slot；一条也算不出来时返回未知
+	globalData evaluateGlobals(const std::vector<Instruction>& start);
+
+	// 函数内联：
+	// 把没有跳转、没有调用、不使用局部变量、只在末尾 iret 一次的小函数展开到调用处
+	// 按函数表顺序处理，被调用者总是先于调用者处理完毕
+	// 展开的指令保留被调用者的 _origins，为传参和返回值生成的指令使用 call 的 _origins
+	void inlineFunctions(std::vector<functionBodyTable>& bodies, const std::vector<functionsTable>& fun, int32_t budget);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "fmts.hpp"
+#include "vm/profile.h"
+#include "debug/linetable.h"
+#include "fmt/format.h"
+
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+
+namespace miniplc0 {
+
+	// 执行剖析的报告，cc0-run --profile 使用
+	// .opcodes:     助记符  执行次数  占比，按次数从多到少
+	// .functions:   下标  函数名  调用次数  指令数  包含时间(ms)  排除时间(ms)，按排除时间从多到少，.start 的下标为 -1
+	// .start:       下标 指令  执行次数  [行:列]
+	// .F<n>:        下标 指令  执行次数  [行:列]
+	// 后两部分只列出执行过的指令，每行的开头和 cc0 -s 的文本汇编中 .F<n> 下的同一行相同
+	// lines 为行号表（下标 0 为 .start），为空时不输出源代码位置
+	inline void WriteProfileReport(std::ostream& output, const ExecutionProfile& profile, const std::vector<functionsTable>& fun,
+			const std::vector<Instruction>& start, const std::vector<functionBodyTable>& bodies, const std::vector<LineTable>& lines) {
+		fmt::memory_buffer buffer;
+		auto total = profile.GetTotalInstructions();
+		auto ms = [](std::int64_t ns) { return ns / 1e6; };
+
+		fmt::format_to(buffer, ".opcodes:\n");
+		std::vector<int32_t> ops(256);
+		std::iota(ops.begin(), ops.end(), 0);
+		std::stable_sort(ops.begin(), ops.end(), [&profile](int32_t a, int32_t b) {
+			return profile.GetOpcodeCount((Operation)a) > profile.GetOpcodeCount((Operation)b);
+		});
+		for (auto op : ops) {
+			auto count = profile.GetOpcodeCount((Operation)op);
+			if (count == 0)
+				break;
+			auto& info = opcodeOf((uint32_t)op);
+			fmt::format_to(buffer, "{}  {}  {:.2f}%\n", info.isDefined() ? info._mnemonic : "NOP", count, 100.0 * count / total);
+		}
+
+		fmt::format_to(buffer, ".functions:\n");
+		std::vector<int32_t> order(profile.GetFunctionsCount() + 1);
+		std::iota(order.begin(), order.end(), -1);
+		std::stable_sort(order.begin(), order.end(), [&profile](int32_t a, int32_t b) {
+			return profile.GetFunction(a)._exclusive > profile.GetFunction(b)._exclusive;
+		});
+		for (auto i : order) {
+			auto& f = profile.GetFunction(i);
+			if (f._calls == 0)
+				continue;
+			fmt::format_to(buffer, "{}  {}  {}  {}  {:.3f}  {:.3f}\n", i, i == -1 ? std::string(".start") : fun[i]._value,
+				f._calls, f._instructions, ms(f._inclusive), ms(f._exclusive));
+		}
+
+		auto listing = [&buffer, &lines](int32_t index, const std::vector<Instruction>& code, const functionProfile& f) {
+			for (std::size_t j = 0; j < code.size() && j < f._counts.size(); j++) {
+				if (f._counts[j] == 0)
+					continue;
+				fmt::format_to(buffer, "{} {}  {}", j, code[j], f._counts[j]);
+				auto pos = index + 1 < (int32_t)lines.size() ? lines[index + 1].Lookup(j) : std::nullopt;
+				if (pos.has_value())
+					fmt::format_to(buffer, "  {}:{}", pos.value().first, pos.value().second);
+				buffer.push_back('\n');
+			}
+		};
+		fmt::format_to(buffer, ".start:\n");
+		listing(-1, start, profile.GetFunction(-1));
+		for (std::size_t i = 0; i < profile.GetFunctionsCount() && i < bodies.size(); i++) {
+			auto& f = profile.GetFunction(i);
+			if (f._instructions == 0)
+				continue;
+			fmt::format_to(buffer, ".F{}:\n", i);
+			listing(i, bodies[i]._funins, f);
+		}
+		output.write(buffer.data(), buffer.size());
+		output << std::flush;
+	}
+}
@@ -0,0 +1,58 @@
+#include "profiler/allocation.h"
+
+namespace miniplc0 {
+
+	std::atomic<bool> AllocationTracker::_installed(false);
+
+	// 零初始化，operator new 中访问时不会触发动态初始化
+	static thread_local AllocationPhase tlsPhase;
+
+	class phaseCounters {
+	public:
+		std::atomic<std::uint64_t> _allocations;
+		std::atomic<std::uint64_t> _deallocations;
+		std::atomic<std::uint64_t> _bytes;
+	};
+	static phaseCounters counters[ALLOCATION_PHASES];
+
+	AllocationScope::AllocationScope(AllocationPhase phase) : _previous(tlsPhase) {
+		tlsPhase = phase;
+	}
+
+	AllocationScope::~AllocationScope() {
+		tlsPhase = _previous;
+	}
+
+	AllocationPhase CurrentAllocationPhase() {
+		return tlsPhase;
+	}
+
+	allocationStats AllocationTracker::Get(AllocationPhase phase) {
+		auto& it = counters[phase];
+		return { it._allocations.load(), it._deallocations.load(), it._bytes.load() };
+	}
+
+	void AllocationTracker::Reset() {
+		for (auto& it : counters) {
+			it._allocations = 0;
+			it._deallocations = 0;
+			it._bytes = 0;
+		}
+	}
+
+	const char* AllocationTracker::GetPhaseName(AllocationPhase phase) {
+		static const char* const names[ALLOCATION_PHASES] = { "other", "tokenize", "analyse", "optimize", "emit" };
+		return names[phase];
+	}
+
+	void AllocationTracker::OnAllocate(std::size_t size) {
+		auto& it = counters[tlsPhase];
+		it._allocations.fetch_add(1, std::memory_order_relaxed);
+		it._bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	// 释放记在释放时所处的阶段，前一个阶段的结果在后一个阶段释放是正常的
+	void AllocationTracker::OnDeallocate() {
+		counters[tlsPhase]._deallocations.fetch_add(1, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	// 按编译阶段统计堆分配
+	// 计数由替换全局 operator new/delete 的 profiler/allocation_hooks.cpp 完成，它不在库里，
+	// 只有链接了它的程序（cc0-alloc-test，或者打开 CC0_ALLOCATION_HOOKS 编译的 cc0）才会计数，其余程序不受影响
+	// 当前阶段是线程局部的，AllocationScope 设置，工作线程开始时从创建它的线程继承
+
+	enum AllocationPhase {
+		AllocOther,
+		AllocTokenize,
+		AllocAnalyse,
+		AllocOptimize,
+		AllocEmit,
+		ALLOCATION_PHASES
+	};
+
+	class allocationStats {
+	public:
+		std::uint64_t _allocations;
+		std::uint64_t _deallocations;
+		std::uint64_t _bytes;           //申请的字节数之和
+	};
+
+	class AllocationScope final {
+	public:
+		explicit AllocationScope(AllocationPhase phase);
+		~AllocationScope();
+		AllocationScope(const AllocationScope&) = delete;
+		AllocationScope& operator=(const AllocationScope&) = delete;
+	private:
+		AllocationPhase _previous;
+	};
+
+	AllocationPhase CurrentAllocationPhase();
+
+	class AllocationTracker final {
+	public:
+		// 是否链接了 allocation_hooks.cpp
+		static bool IsInstalled() { return _installed.load(std::memory_order_relaxed); }
+		static allocationStats Get(AllocationPhase phase);
+		static void Reset();
+		static const char* GetPhaseName(AllocationPhase phase);
+
+		// 以下只由 allocation_hooks.cpp 调用，不能分配内存
+		static void Install() { _installed.store(true, std::memory_order_relaxed); }
+		static void OnAllocate(std::size_t size);
+		static void OnDeallocate();
+	private:
+		static std::atomic<bool> _installed;
+	};
+}
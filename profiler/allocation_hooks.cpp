@@ -0,0 +1,74 @@
+#include "profiler/allocation.h"
+
+#include <new>
+#include <cstdlib>
+
+// 替换全局的 operator new/delete，统计到 AllocationTracker 中
+// 只能链接进可执行文件一次，不要放进库里
+// 对齐的版本不替换，也不计数，它们的分配和释放仍然是配对的
+
+namespace {
+	// 静态初始化时标记已安装
+	const bool installed = (miniplc0::AllocationTracker::Install(), true);
+
+	void* tryAllocate(std::size_t size) noexcept {
+		auto p = std::malloc(size == 0 ? 1 : size);
+		if (p != nullptr)
+			miniplc0::AllocationTracker::OnAllocate(size);
+		return p;
+	}
+
+	void* allocate(std::size_t size) {
+		auto p = tryAllocate(size);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	void deallocate(void* p) noexcept {
+		if (p == nullptr)
+			return;
+		miniplc0::AllocationTracker::OnDeallocate();
+		std::free(p);
+	}
+}
+
+void* operator new(std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return tryAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return tryAllocate(size);
+}
+
+void operator delete(void* p) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p) noexcept {
+	deallocate(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	deallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	deallocate(p);
+}
@@ -0,0 +1,127 @@
+#include "profiler/sampler.h"
+
+#include <map>
+#include <string>
+#include <memory>
+#include <algorithm>
+
+#ifdef __linux__
+#include <csignal>
+#include <sys/time.h>
+#endif
+
+namespace miniplc0 {
+
+	// 零初始化，没有构造函数，第一次访问时不需要分配内存
+	static thread_local sampleStack tlsStack;
+
+	sampleStack& currentSampleStack() {
+		return tlsStack;
+	}
+
+	SampleScope::SampleScope(const std::vector<const char*>& names) : _stack(currentSampleStack()), _count(names.size()),
+			_line(_stack._line.load(std::memory_order_relaxed)) {
+		for (auto name : names)
+			push(name);
+	}
+
+	std::vector<const char*> CurrentSampleStack() {
+		auto& stack = currentSampleStack();
+		auto depth = std::min(stack._depth.load(std::memory_order_relaxed), SAMPLE_STACK_DEPTH);
+		return std::vector<const char*>(stack._names, stack._names + depth);
+	}
+
+	// 样本依次存放在 samples 中：深度、行号、名字...
+	// 信号处理函数用 fetch_add 预留空间，不加锁也不分配内存
+	// 第一个放不下的样本在它的位置写 SAMPLE_END，之后的样本都放不下
+	static std::unique_ptr<std::uintptr_t[]> samples;
+	static std::size_t capacity = 0;
+	static std::atomic<std::size_t> used(0);
+	static std::atomic<std::size_t> count(0);
+	static std::atomic<std::size_t> dropped(0);
+	static const std::uintptr_t SAMPLE_END = ~(std::uintptr_t)0;
+
+#ifdef __linux__
+	static void onSignal(int) {
+		auto& stack = currentSampleStack();
+		auto depth = std::min(stack._depth.load(std::memory_order_relaxed), SAMPLE_STACK_DEPTH);
+		std::atomic_signal_fence(std::memory_order_acquire);
+		auto begin = used.fetch_add(depth + 2, std::memory_order_relaxed);
+		if (begin + depth + 2 > capacity) {
+			if (begin < capacity)
+				samples[begin] = SAMPLE_END;
+			dropped++;
+			return;
+		}
+		samples[begin] = depth;
+		samples[begin + 1] = stack._line.load(std::memory_order_relaxed);
+		for (std::size_t i = 0; i < depth; i++)
+			samples[begin + 2 + i] = reinterpret_cast<std::uintptr_t>(stack._names[i]);
+		count++;
+	}
+#endif
+
+	bool Sampler::Start(unsigned int frequency, std::size_t size) {
+#ifdef __linux__
+		if (frequency == 0 || frequency > 1000000)
+			return false;
+		samples.reset(new std::uintptr_t[size]);
+		capacity = size;
+		used = 0;
+		count = 0;
+		dropped = 0;
+		struct sigaction action = {};
+		action.sa_handler = onSignal;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		if (sigaction(SIGPROF, &action, nullptr) != 0)
+			return false;
+		itimerval timer = {};
+		auto period = 1000000 / frequency;
+		timer.it_interval.tv_sec = period / 1000000;
+		timer.it_interval.tv_usec = period % 1000000;
+		timer.it_value = timer.it_interval;
+		return setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+#else
+		(void)frequency;
+		(void)size;
+		return false;
+#endif
+	}
+
+	void Sampler::Stop() {
+#ifdef __linux__
+		itimerval timer = {};
+		setitimer(ITIMER_PROF, &timer, nullptr);
+		signal(SIGPROF, SIG_IGN);
+#endif
+	}
+
+	void Sampler::WriteFolded(std::ostream& output, const char* root) {
+		std::map<std::string, std::size_t> folded;
+		std::size_t end = std::min(used.load(), capacity);
+		for (std::size_t pos = 0; pos < end && samples[pos] != SAMPLE_END;) {
+			std::size_t depth = samples[pos];
+			std::string key = root;
+			for (std::size_t i = 0; i < depth; i++) {
+				key += ';';
+				key += reinterpret_cast<const char*>(samples[pos + 2 + i]);
+			}
+			if (samples[pos + 1] != 0)
+				key += ";line " + std::to_string(samples[pos + 1] - 1);
+			folded[key]++;
+			pos += 2 + depth;
+		}
+		for (auto& it : folded)
+			output << it.first << ' ' << it.second << '\n';
+		output << std::flush;
+	}
+
+	std::size_t Sampler::GetSamples() {
+		return count;
+	}
+
+	std::size_t Sampler::GetDropped() {
+		return dropped;
+	}
+}
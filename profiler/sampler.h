@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	// 编译器自身的采样剖析
+	// 每个线程维护一个影子栈：编译阶段和分析器的递归子程序进入时压入名字，退出时弹出，另外记下正在分析的源代码行
+	// Sampler::Start 之后 SIGPROF 定时器每隔一段 CPU 时间打断一个正在运行的线程，信号处理函数把它的影子栈复制到预先分配的缓冲区里
+	// 结束后按 flamegraph 工具使用的 folded 格式输出：阶段;子程序;...;line N 次数
+	// 名字必须是静态存储期的字符串（字面量或 __func__），影子栈不拷贝字符串
+
+	const std::size_t SAMPLE_STACK_DEPTH = 64;
+
+	class sampleStack {
+	public:
+		const char* _names[SAMPLE_STACK_DEPTH];
+		std::atomic<std::size_t> _depth;    //可能超过 SAMPLE_STACK_DEPTH，超出的部分不记录名字
+		std::atomic<std::uint64_t> _line;   //正在分析的行号加一，0 表示未知
+	};
+
+	// 当前线程的影子栈，只包含平凡的成员，信号处理函数中可以直接访问
+	sampleStack& currentSampleStack();
+
+	// 在作用域内把 name 压入当前线程的影子栈
+	class SampleScope final {
+	public:
+		explicit SampleScope(const char* name) : _stack(currentSampleStack()), _count(1),
+			_line(_stack._line.load(std::memory_order_relaxed)) { push(name); }
+		// 新线程开始工作时压入创建它的线程的影子栈，采样结果能看出是在哪个阶段
+		explicit SampleScope(const std::vector<const char*>& names);
+		// 退出时恢复进入时的行号，阶段结束后不会沿用最后一个 token 的行号
+		~SampleScope() {
+			_stack._line.store(_line, std::memory_order_relaxed);
+			_stack._depth.fetch_sub(_count, std::memory_order_relaxed);
+		}
+		SampleScope(const SampleScope&) = delete;
+		SampleScope& operator=(const SampleScope&) = delete;
+	private:
+		void push(const char* name) {
+			auto depth = _stack._depth.load(std::memory_order_relaxed);
+			if (depth < SAMPLE_STACK_DEPTH)
+				_stack._names[depth] = name;
+			// 先写名字再增加深度，信号处理函数看到的总是完整的栈
+			std::atomic_signal_fence(std::memory_order_release);
+			_stack._depth.store(depth + 1, std::memory_order_relaxed);
+		}
+	private:
+		sampleStack& _stack;
+		std::size_t _count;
+		std::uint64_t _line;
+	};
+
+	// 当前线程的影子栈中的名字，交给新线程的 SampleScope
+	std::vector<const char*> CurrentSampleStack();
+	// 记下当前线程正在分析的源代码行
+	inline void SetSampleLine(std::uint64_t line) {
+		currentSampleStack()._line.store(line + 1, std::memory_order_relaxed);
+	}
+
+	class Sampler final {
+	public:
+		// 开始采样，每秒 CPU 时间采样 frequency 次，capacity 为缓冲区的大小（指针个数），失败时返回 false
+		static bool Start(unsigned int frequency = 1000, std::size_t capacity = 1 << 21);
+		// 停止采样，之后才能读取结果
+		static void Stop();
+		// 按 folded 格式输出，root 为每个栈最外层的名字
+		static void WriteFolded(std::ostream& output, const char* root);
+		static std::size_t GetSamples();
+		// 缓冲区满了之后丢掉的样本数
+		static std::size_t GetDropped();
+	};
+}
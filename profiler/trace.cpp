@@ -0,0 +1,123 @@
+#include "profiler/trace.h"
+
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace miniplc0 {
+
+	std::atomic<bool> Tracer::_enabled(false);
+
+	// 所有线程的缓冲区，只增加不删除，线程结束后事件仍然可以导出
+	static std::atomic<traceBuffer*> buffers(nullptr);
+	static std::atomic<std::uint32_t> threadCount(0);
+	static std::chrono::steady_clock::time_point epoch;
+	static thread_local traceBuffer* tlsBuffer = nullptr;
+
+	static std::uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	static traceBuffer& currentBuffer() {
+		if (tlsBuffer == nullptr) {
+			auto buffer = new traceBuffer;
+			buffer->_head.store(0, std::memory_order_relaxed);
+			buffer->_tid = ++threadCount;
+			buffer->_next = buffers.load(std::memory_order_relaxed);
+			while (!buffers.compare_exchange_weak(buffer->_next, buffer, std::memory_order_release, std::memory_order_relaxed))
+				;
+			tlsBuffer = buffer;
+		}
+		return *tlsBuffer;
+	}
+
+	TraceScope::TraceScope(const char* name) : _name(name), _detail(nullptr), _begin(0), _active(Tracer::IsEnabled()) {
+		if (_active)
+			_begin = now();
+	}
+
+	TraceScope::TraceScope(const char* name, const std::string& detail) : _name(name), _detail(&detail), _begin(0), _active(Tracer::IsEnabled()) {
+		if (_active)
+			_begin = now();
+	}
+
+	TraceScope::~TraceScope() {
+		if (!_active)
+			return;
+		auto end = now();
+		auto& buffer = currentBuffer();
+		auto head = buffer._head.load(std::memory_order_relaxed);
+		auto& event = buffer._events[head % TRACE_BUFFER_SIZE];
+		event._name = _name;
+		std::size_t n = _detail == nullptr ? 0 : std::min(_detail->size(), TRACE_DETAIL_SIZE - 1);
+		if (n != 0)
+			std::memcpy(event._detail, _detail->data(), n);
+		event._detail[n] = '\0';
+		event._begin = _begin;
+		event._end = end;
+		buffer._head.store(head + 1, std::memory_order_release);
+	}
+
+	void Tracer::Start() {
+		for (auto it = buffers.load(std::memory_order_acquire); it != nullptr; it = it->_next)
+			it->_head.store(0, std::memory_order_relaxed);
+		epoch = std::chrono::steady_clock::now();
+		_enabled.store(true, std::memory_order_release);
+	}
+
+	void Tracer::Stop() {
+		_enabled.store(false, std::memory_order_release);
+	}
+
+	// 纳秒转成 Chrome trace 使用的微秒，保留三位小数
+	static void writeMicroseconds(std::ostream& output, std::uint64_t ns) {
+		output << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+	}
+
+	// 名字和附加信息是标识符或者字面量，只需要转义引号、反斜杠和控制字符
+	static void writeString(std::ostream& output, const char* s) {
+		output << '"';
+		for (; *s != '\0'; s++) {
+			auto c = (unsigned char)*s;
+			if (c == '"' || c == '\\')
+				output << '\\' << (char)c;
+			else if (c < 0x20)
+				output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+			else
+				output << (char)c;
+		}
+		output << '"';
+	}
+
+	void Tracer::WriteChrome(std::ostream& output) {
+		output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		for (auto it = buffers.load(std::memory_order_acquire); it != nullptr; it = it->_next) {
+			auto head = it->_head.load(std::memory_order_acquire);
+			if (head == 0)
+				continue;
+			output << (first ? "\n" : ",\n");
+			first = false;
+			output << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->_tid
+				<< ",\"args\":{\"name\":\"thread " << it->_tid << "\"}}";
+			for (auto i = head - std::min(head, TRACE_BUFFER_SIZE); i < head; i++) {
+				auto& event = it->_events[i % TRACE_BUFFER_SIZE];
+				output << ",\n{\"name\":";
+				writeString(output, event._name);
+				output << ",\"cat\":\"cc0\",\"ph\":\"X\",\"pid\":1,\"tid\":" << it->_tid << ",\"ts\":";
+				writeMicroseconds(output, event._begin);
+				output << ",\"dur\":";
+				writeMicroseconds(output, event._end - event._begin);
+				if (event._detail[0] != '\0') {
+					output << ",\"args\":{\"detail\":";
+					writeString(output, event._detail);
+					output << '}';
+				}
+				output << '}';
+			}
+		}
+		output << "\n]}\n" << std::flush;
+	}
+}
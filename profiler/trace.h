@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	// 编译器自身的时间线，导出为 Chrome trace（chrome://tracing、Perfetto 可以直接打开）
+	// TraceScope 记下作用域的起止时间，结束时写进当前线程的环形缓冲区
+	// 每个线程第一次写事件时分配自己的缓冲区，挂到全局的链表上，写事件时不加锁，只有所属线程会写
+	// 缓冲区写满后覆盖最旧的事件
+	// 没有 Tracer::Start 时 TraceScope 只读一次原子变量
+
+	// 每个线程的缓冲区能放的事件数
+	const std::size_t TRACE_BUFFER_SIZE = 1 << 14;
+	// 附加信息（例如函数名）最多保留的字节数，包括结尾的 0
+	const std::size_t TRACE_DETAIL_SIZE = 32;
+
+	class traceEvent {
+	public:
+		const char* _name;
+		char _detail[TRACE_DETAIL_SIZE];    //空串表示没有
+		std::uint64_t _begin;               //相对 Tracer::Start 的纳秒数
+		std::uint64_t _end;
+	};
+
+	class traceBuffer {
+	public:
+		traceEvent _events[TRACE_BUFFER_SIZE];
+		std::atomic<std::size_t> _head;     //写过的事件总数，下一个事件写在 _head % TRACE_BUFFER_SIZE
+		std::uint32_t _tid;                 //按第一次写事件的顺序从 1 开始编号
+		traceBuffer* _next;
+	};
+
+	// 在作用域内记录一个事件，name 必须是静态存储期的字符串
+	class TraceScope final {
+	public:
+		explicit TraceScope(const char* name);
+		// detail 在作用域结束时才复制，必须活到那时，超过 TRACE_DETAIL_SIZE - 1 个字节的部分截断
+		TraceScope(const char* name, const std::string& detail);
+		~TraceScope();
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+	private:
+		const char* _name;
+		const std::string* _detail;
+		std::uint64_t _begin;
+		bool _active;
+	};
+
+	class Tracer final {
+	public:
+		// 开始记录，清空之前的事件
+		static void Start();
+		static void Stop();
+		static bool IsEnabled() { return _enabled.load(std::memory_order_relaxed); }
+		// 输出 Chrome trace 的 JSON，调用时被记录的线程都必须已经结束或者不在 TraceScope 中
+		static void WriteChrome(std::ostream& output);
+	private:
+		static std::atomic<bool> _enabled;
+	};
+}
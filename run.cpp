@@ -0,0 +1,82 @@
+#include "argparse.hpp"
+#include "fmt/core.h"
+
+#include "object/loader.h"
+#include "vm/vm.h"
+#include "fmts.hpp"
+#include "profile.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+// 加载 .o0 并在虚拟机上执行，程序的输入输出是标准输入输出
+int main(int argc, char** argv) {
+	argparse::ArgumentParser program("cc0-run");
+	program.add_argument("input")
+		.help("specify the .o0 file to be executed.");
+	program.add_argument("--profile")
+		.default_value(std::string(""))
+		.help("count executed instructions per opcode, function and offset, time every call, and write the report to this file.");
+
+	try {
+		program.parse_args(argc, argv);
+	}
+	catch (const std::runtime_error& err) {
+		fmt::print(stderr, "{}\n\n", err.what());
+		program.print_help();
+		exit(2);
+	}
+
+	auto input_file = program.get<std::string>("input");
+	auto profile_file = program.get<std::string>("--profile");
+
+	miniplc0::Loader loader;
+	auto err = loader.Load(input_file);
+	if (!err.has_value())
+		err = loader.DecodeAll();
+	if (err.has_value()) {
+		fmt::print(stderr, "Fail to load {}: {}\n", input_file, err.value());
+		exit(2);
+	}
+
+	auto fun = loader.GetFunctionTable();
+	auto bodies = loader.GetFunctionBodies();
+	miniplc0::VM vm(fun, loader.GetStartCode(), loader.GetStartFrame(), bodies, loader.GetGlobalData());
+	miniplc0::ExecutionProfile profile;
+	if (!profile_file.empty())
+		vm.SetProfile(&profile);
+
+	int status = 0;
+	try {
+		status = vm.Run(std::cin, std::cout);
+	}
+	catch (const std::runtime_error& e) {
+		std::cout << std::flush;
+		auto location = vm.GetLocation();
+		auto pos = loader.GetLineTable(location.first).Lookup(location.second);
+		auto where = location.first == -1 ? std::string(".start") : fmt::format(".F{}", location.first);
+		if (pos.has_value())
+			fmt::print(stderr, "Runtime error: {} at {}:{} (Line: {} Column: {})\n", e.what(), where, location.second,
+				pos.value().first, pos.value().second);
+		else
+			fmt::print(stderr, "Runtime error: {} at {}:{}\n", e.what(), where, location.second);
+		status = 1;
+	}
+
+	// 出错时也输出报告，还没返回的调用算到出错为止
+	if (!profile_file.empty()) {
+		profile.Finish();
+		std::ofstream outf(profile_file, std::ios::out | std::ios::trunc);
+		if (!outf) {
+			fmt::print(stderr, "Fail to open {} for writing.\n", profile_file);
+			exit(2);
+		}
+		miniplc0::WriteProfileReport(outf, profile, fun, loader.GetStartCode(), bodies, loader.GetLineTables());
+		if (!outf) {
+			fmt::print(stderr, "Fail to write {}.\n", profile_file);
+			exit(2);
+		}
+	}
+	exit(status);
+}
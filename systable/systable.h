@@ -39,7 +39,7 @@ namespace miniplc0 {
     class functionsTable{//函数表和常量表合二为一
     public:
         functionsTable(string type,int32_t params_size,int32_t level,string value):
-            _type(type),_params_size(params_size),_level(level),_value(value),_haveReturnValue(-1){}
+            _type(type),_params_size(params_size),_level(level),_value(value),_haveReturnValue(-1),_slots(0){}
     public:
 //        int32_t name_index;     // 函数名在.constants中的下标
         string _type;
@@ -47,15 +47,40 @@ namespace miniplc0 {
         int32_t _level;          //函数嵌套的层级
         string _value;
         int32_t _haveReturnValue;
+        int32_t _slots;          //参数和局部变量占用的slot数
     };
 
 
 
 
 
+    class frameInfo{//栈帧信息，-1 表示未知
+    public:
+        frameInfo(int32_t max_stack,int32_t locals):_max_stack(max_stack),_locals(locals){}
+        frameInfo():frameInfo(-1,-1){}
+
+        bool isKnown() const { return _max_stack>=0 && _locals>=0;}
+    public:
+        int32_t _max_stack;     //操作数栈的最大深度（不含局部变量）
+        int32_t _locals;        //参数和局部变量（.start 中为全局变量）占用的slot数
+    };
+
+    class globalData{//预先计算好的全局变量，_resume 为 -1 表示没有
+    public:
+        globalData(int32_t resume,std::vector<int32_t> values):_resume(resume),_values(std::move(values)){}
+        globalData():globalData(-1,{}){}
+
+        bool isKnown() const { return _resume>=0;}
+    public:
+        int32_t _resume;                //执行完 .start 的前 _resume 条指令后
+        std::vector<int32_t> _values;   //栈上恰好是这些 slot
+    };
+
     class functionBodyTable{
     public:
         std::vector<Instruction> _funins;
+        frameInfo _frame;
+        std::vector<int32_t> _origins;  //每条指令是分析到哪个 token（下标）时生成的，为空表示没有记录
     };
 
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "catch2/catch.hpp"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace miniplc0 {
+	// 测试中分析一段程序时的设置，默认值和 Analyser 自己的默认值相同
+	class analyseSettings {
+	public:
+		optimizeOptions _options;
+		unsigned int _threads = 0;          //0 表示按硬件线程数
+		FunctionCache* _cache = nullptr;
+	};
+
+	// 分析的结果，_analyser 用来取函数表、.start、行号表等
+	class analyseResult {
+	public:
+		std::unique_ptr<Analyser> _analyser;
+		std::vector<functionBodyTable> _bodies;
+		std::optional<CompilationError> _error;
+	};
+
+	// 词法分析必须成功，语法和语义错误放在 _error 中由调用者检查
+	inline analyseResult analyseSource(const std::string& input, const analyseSettings& settings = {}) {
+		std::stringstream ss;
+		ss.str(input);
+		Tokenizer tkz(ss);
+		auto tks = tkz.AllTokens();
+		REQUIRE_FALSE(tks.second.has_value());
+		analyseResult result;
+		result._analyser = std::make_unique<Analyser>(tks.first);
+		result._analyser->SetOptions(settings._options);
+		result._analyser->SetThreads(settings._threads);
+		result._analyser->SetCache(settings._cache);
+		auto p = result._analyser->Analyse();
+		result._bodies = std::move(p.first);
+		result._error = std::move(p.second);
+		return result;
+	}
+
+	// 整个分析必须成功
+	inline analyseResult compileSource(const std::string& input, const analyseSettings& settings = {}) {
+		auto result = analyseSource(input, settings);
+		REQUIRE_FALSE(result._error.has_value());
+		return result;
+	}
+
+	// 分析必须失败，返回错误码
+	inline ErrorCode analyseError(const std::string& input, const analyseSettings& settings = {}) {
+		auto result = analyseSource(input, settings);
+		REQUIRE(result._error.has_value());
+		return result._error.value().GetCode();
+	}
+}
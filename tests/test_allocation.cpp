@@ -0,0 +1,78 @@
+#include "catch2/catch.hpp"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "object/writer.h"
+#include "profiler/allocation.h"
+#include "listing.hpp"
+
+#include <sstream>
+#include <string>
+
+// 只链接进 cc0_alloc_test，和替换了 operator new/delete 的 allocation_hooks.cpp 一起
+
+// functions 个形状相同的函数，每个都有局部变量、循环、分支、调用和输出
+static std::string makeSource(int32_t functions) {
+	std::string source = "const int limit = 100;\nint total;\n";
+	for (int32_t i = 0; i < functions; i++) {
+		auto name = "f" + std::to_string(i);
+		source += "int " + name + "(int a, int b) {\n";
+		source += "\tint i = 0, s = a * 2 + b;\n";
+		source += "\twhile (i < limit) {\n";
+		source += "\t\tif (s > b) s = s - (a + i) / 3; else s = s + b * (i - 1);\n";
+		source += "\t\ti = i + 1;\n\t}\n";
+		if (i > 0)
+			source += "\ts = s + f" + std::to_string(i - 1) + "(s, b);\n";
+		source += "\tprint(s, a, b);\n\treturn s;\n}\n";
+	}
+	source += "int main() {\n\ttotal = f" + std::to_string(functions - 1) + "(1, 2);\n\treturn 0;\n}\n";
+	return source;
+}
+
+// 每个阶段每 KB 源代码允许的分配次数
+// 大约是写下这些预算时实测值的 1.5 倍，分配行为明显变差时失败，优化之后应该相应调低
+static const double TOKENIZE_BUDGET = 850;
+static const double ANALYSE_BUDGET = 160;
+static const double OPTIMIZE_BUDGET = 400;
+static const double EMIT_BUDGET = 4;
+
+static double perKilobyte(miniplc0::AllocationPhase phase, std::size_t size) {
+	return miniplc0::AllocationTracker::Get(phase)._allocations * 1024.0 / size;
+}
+
+TEST_CASE("Allocations per KB of input stay within the budget of each phase.") {
+	REQUIRE(miniplc0::AllocationTracker::IsInstalled());
+	auto source = makeSource(200);
+	std::stringstream input(source);
+
+	miniplc0::AllocationTracker::Reset();
+	miniplc0::Tokenizer tkz(input);
+	auto tks = tkz.AllTokensParallel(1);
+	REQUIRE_FALSE(tks.second.has_value());
+	miniplc0::Analyser analyser(tks.first);
+	analyser.SetThreads(1);
+	auto p = analyser.Analyse();
+	REQUIRE_FALSE(p.second.has_value());
+	std::stringstream binary, listing;
+	miniplc0::WriteBinary(binary, analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(),
+		analyser.getGlobalData(), p.first, analyser.getLineTables(), true);
+	std::vector<miniplc0::constantInfo> constants;
+	std::vector<miniplc0::functionInfo> functions;
+	for (auto& it : analyser.getFunctionTable()) {
+		constants.push_back({ it._type, it._value });
+		functions.push_back({ (int32_t)functions.size(), it._params_size, it._level, 0, 0 });
+	}
+	miniplc0::WriteListing(listing, constants, analyser.getStartCode(), functions,
+		[&p](std::size_t i) -> const std::vector<miniplc0::Instruction>& { return p.first[i]._funins; });
+
+	for (int phase = 0; phase < miniplc0::ALLOCATION_PHASES; phase++) {
+		auto stats = miniplc0::AllocationTracker::Get((miniplc0::AllocationPhase)phase);
+		WARN(miniplc0::AllocationTracker::GetPhaseName((miniplc0::AllocationPhase)phase) << ": " << stats._allocations
+			<< " allocations, " << stats._bytes << " bytes, "
+			<< perKilobyte((miniplc0::AllocationPhase)phase, source.size()) << " allocations/KB");
+	}
+	CHECK(perKilobyte(miniplc0::AllocTokenize, source.size()) <= TOKENIZE_BUDGET);
+	CHECK(perKilobyte(miniplc0::AllocAnalyse, source.size()) <= ANALYSE_BUDGET);
+	CHECK(perKilobyte(miniplc0::AllocOptimize, source.size()) <= OPTIMIZE_BUDGET);
+	CHECK(perKilobyte(miniplc0::AllocEmit, source.size()) <= EMIT_BUDGET);
+}
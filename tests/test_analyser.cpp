@@ -1,9 +1,281 @@
 #include "catch2/catch.hpp"
 
 #include "instruction/instruction.h"
-#include "tokenizer/tokenizer.h"
-#include "analyser/analyser.h"
+#include "optimizer/optimizer.h"
+#include "tests/analyse.hpp"
+
+#include <algorithm>
+#include <sstream>
 
 /*
 	不要忘记写测试用例喔。
-*/
\ No newline at end of file
+*/
+
+TEST_CASE("Dead code elimination removes unreachable code and no-op jumps.") {
+	std::string input =
+		"int f(int n) {\n"
+		"	if (n <= 0) return 0;\n"
+		"	return n;\n"
+		"}\n"
+		"int main() {\n"
+		"	return f(1);\n"
+		"}\n";
+	auto v = miniplc0::compileSource(input)._bodies;
+	REQUIRE(v.size() == 2);
+	using miniplc0::Instruction;
+	std::vector<Instruction> f = {
+		Instruction(miniplc0::LOADA, 0, 0),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::IPUSH, 0, 0),
+		Instruction(miniplc0::ISUB, 0, 0),
+		Instruction(miniplc0::JG, 7, 0),
+		Instruction(miniplc0::IPUSH, 0, 0),
+		Instruction(miniplc0::IRET, 0, 0),
+		Instruction(miniplc0::LOADA, 0, 0),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::IRET, 0, 0),
+	};
+	REQUIRE(v[0]._funins == f);
+}
+
+TEST_CASE("Dead code elimination remaps backward jumps.") {
+	using miniplc0::Instruction;
+	std::vector<Instruction> ins = {
+		Instruction(miniplc0::IPUSH, 1, 0),
+		Instruction(miniplc0::JE, 4, 0),
+		Instruction(miniplc0::JMP, 3, 0),
+		Instruction(miniplc0::JMP, 0, 0),
+		Instruction(miniplc0::RET, 0, 0),
+		Instruction(miniplc0::RET, 0, 0),
+	};
+	miniplc0::eliminateDeadCode(ins);
+	std::vector<Instruction> expected = {
+		Instruction(miniplc0::IPUSH, 1, 0),
+		Instruction(miniplc0::JE, 3, 0),
+		Instruction(miniplc0::JMP, 0, 0),
+		Instruction(miniplc0::RET, 0, 0),
+	};
+	REQUIRE(ins == expected);
+}
+
+TEST_CASE("Switch dispatch depends on how dense the case values are.") {
+	auto count = [](const std::vector<miniplc0::Instruction>& ins, miniplc0::Operation op) {
+		return std::count_if(ins.begin(), ins.end(), [op](const miniplc0::Instruction& it) { return it.GetOperation() == op; });
+	};
+	std::string input =
+		"int dense(int x) { switch (x) { case 1: return 1; case 2: return 2; case 4: return 4; } return 0; }\n"
+		"int chain(int x) { switch (x) { case 1: return 1; case 1000: return 2; } return 0; }\n"
+		"int tree(int x) { switch (x) { case 1: return 1; case 10: return 2; case 100: return 3; case 1000: return 4; } return 0; }\n"
+		"int main() { return dense(1) + chain(1) + tree(1); }\n";
+	auto v = miniplc0::compileSource(input)._bodies;
+	// 1, 2, 4：一条 tableswitch，后面是默认分支和 4 项
+	REQUIRE(v[0]._funins[2] == miniplc0::Instruction(miniplc0::TABLESWITCH, 1, 4));
+	REQUIRE(count(v[0]._funins, miniplc0::JMP) == 5);
+	REQUIRE(count(v[1]._funins, miniplc0::TABLESWITCH) == 0);
+	REQUIRE(count(v[1]._funins, miniplc0::JNE) == 2);
+	REQUIRE(count(v[2]._funins, miniplc0::TABLESWITCH) == 0);
+	REQUIRE(count(v[2]._funins, miniplc0::JL) == 1);
+	REQUIRE(count(v[2]._funins, miniplc0::JNE) == 4);
+
+	using miniplc0::analyseError;
+	REQUIRE(analyseError("int main() { switch (1) { case 1: case +1: ; } return 0; }") == miniplc0::ErrDuplicateCaseLabel);
+	REQUIRE(analyseError("int main() { switch (1) { default: default: ; } return 0; }") == miniplc0::ErrDuplicateCaseLabel);
+	REQUIRE(analyseError("int main() { int a = 1; switch (1) { case a: ; } return 0; }") == miniplc0::ErrInvalidCaseLabel);
+	REQUIRE(analyseError("int main() { switch (1) { case 1 ; } return 0; }") == miniplc0::ErrNoColon);
+	REQUIRE(analyseError("int main() { break; return 0; }") == miniplc0::ErrInvalidBreak);
+}
+
+TEST_CASE("For loops test the condition once per iteration at the bottom.") {
+	std::string input =
+		"int main() {\n"
+		"	int i; int s = 0;\n"
+		"	for (i = 0; i < 10; i = i + 1) s = s + i;\n"
+		"	return s;\n"
+		"}\n";
+	auto v = miniplc0::compileSource(input)._bodies;
+	auto& ins = v[0]._funins;
+	// 初始化之后跳到条件，条件成立时跳回循环体，循环中没有其他跳转
+	std::vector<std::size_t> jumps;
+	for (std::size_t i = 0; i < ins.size(); i++)
+		if (miniplc0::opcodeOf(ins[i].GetOperation())._branch)
+			jumps.push_back(i);
+	REQUIRE(jumps.size() == 2);
+	REQUIRE(ins[jumps[0]].GetOperation() == miniplc0::JMP);
+	REQUIRE(ins[jumps[1]] == miniplc0::Instruction(miniplc0::JL, jumps[0] + 1, 0));
+	REQUIRE(ins[jumps[0]].GetX() < (int32_t)jumps[1]);
+	REQUIRE(ins[jumps[0]].GetX() > (int32_t)jumps[0] + 1);
+
+	using miniplc0::analyseError;
+	REQUIRE(analyseError("int main() { continue; return 0; }") == miniplc0::ErrInvalidContinue);
+	REQUIRE(analyseError("int main() { switch (1) { default: continue; } return 0; }") == miniplc0::ErrInvalidContinue);
+	REQUIRE(analyseError("int main() { int i; for (i = 0; i < 1) ; return 0; }") == miniplc0::ErrNoSemicolon);
+	// 更新在循环体之后执行，它赋值的变量在循环体中还没有初始化
+	REQUIRE(analyseError("int main() { int x, i; for (i = 0; i < 2; x = 1) { print(x); i = i + 1; } return 0; }") == miniplc0::ErrNotInitialized);
+	REQUIRE_FALSE(miniplc0::analyseSource("int main() { int x, i; for (i = 0; i < 2; i = i + x) x = 1; return 0; }")._error.has_value());
+	REQUIRE(analyseError("int main() { int i; for (i = 0; i < 2; i = (i + 1) ; return 0; }") == miniplc0::ErrNoRightBracket);
+	REQUIRE(analyseError("int main() { int i = 0; do i = 1; (i < 1); return 0; }") == miniplc0::ErrIncompleteStatement);
+}
+
+TEST_CASE("Small leaf functions are inlined at their call sites.") {
+	std::string input =
+		"int g = 7;\n"
+		"int sq(int x) { return x*x; }\n"
+		"int fib(int n) { if (n <= 1) return n; return fib(n-1) + fib(n-2); }\n"
+		"int main() {\n"
+		"	int i = 2;\n"
+		"	print(sq(i), fib(i));\n"
+		"	return 0;\n"
+		"}\n";
+	auto v = miniplc0::compileSource(input)._bodies;
+	REQUIRE(v.size() == 3);
+	using miniplc0::Instruction;
+	std::vector<Instruction> head = {
+		Instruction(miniplc0::IPUSH, 2, 0),
+		Instruction(miniplc0::LOADA, 0, 0),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::LOADA, 0, 1),
+		Instruction(miniplc0::LOADA, 0, 1),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::LOADA, 0, 1),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::IMUL, 0, 0),
+		Instruction(miniplc0::ISTORE, 0, 0),
+	};
+	auto& main = v[2]._funins;
+	REQUIRE(main.size() > head.size());
+	REQUIRE(std::vector<Instruction>(main.begin(), main.begin() + head.size()) == head);
+	// 递归函数不会被内联
+	REQUIRE(std::count(main.begin(), main.end(), Instruction(miniplc0::CALL, 1, 0)) == 1);
+}
+
+TEST_CASE("Self tail calls are turned into jumps to the function entry.") {
+	std::string input =
+		"int sum(int n, int acc) {\n"
+		"	if (n == 0) return acc;\n"
+		"	return sum(n - 1, acc + n);\n"
+		"}\n"
+		"int main() {\n"
+		"	print(sum(10, 0));\n"
+		"	return 0;\n"
+		"}\n";
+	auto v = miniplc0::compileSource(input)._bodies;
+	REQUIRE(v.size() == 2);
+	using miniplc0::Instruction;
+	auto& sum = v[0]._funins;
+	REQUIRE(std::count_if(sum.begin(), sum.end(), [](const Instruction& it) { return it.GetOperation() == miniplc0::CALL; }) == 0);
+	std::vector<Instruction> tail = {
+		Instruction(miniplc0::LOADA, 0, 0),
+		Instruction(miniplc0::LOADA, 0, 2),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::ISTORE, 0, 0),
+		Instruction(miniplc0::LOADA, 0, 1),
+		Instruction(miniplc0::LOADA, 0, 3),
+		Instruction(miniplc0::ILOAD, 0, 0),
+		Instruction(miniplc0::ISTORE, 0, 0),
+		Instruction(miniplc0::POPN, 2, 0),
+		Instruction(miniplc0::JMP, 0, 0),
+	};
+	REQUIRE(sum.size() > tail.size());
+	REQUIRE(std::vector<Instruction>(sum.end() - tail.size(), sum.end()) == tail);
+}
+
+// 用 threads 个线程分析
+static miniplc0::analyseResult analyseWithThreads(const std::string& input, unsigned int threads) {
+	miniplc0::analyseSettings settings;
+	settings._threads = threads;
+	return miniplc0::analyseSource(input, settings);
+}
+
+TEST_CASE("Function bodies analysed in parallel give the same result.") {
+	std::string input = "int g;\n";
+	for (int i = 0; i < 64; i++)
+		input += "int f" + std::to_string(i) + "(int a) { int b = a * " + std::to_string(i) + "; while (b > 10) b = b - 3; return b" +
+			(i > 0 ? " + f" + std::to_string(i - 1) + "(a)" : "") + "; }\n";
+	input += "void init() { g = 1; }\n";
+	input += "int main() { init(); print(f63(g)); return 0; }\n";
+
+	auto serial = analyseWithThreads(input, 1);
+	REQUIRE_FALSE(serial._error.has_value());
+	auto parallel = analyseWithThreads(input, 8);
+	REQUIRE_FALSE(parallel._error.has_value());
+	REQUIRE(serial._bodies.size() == parallel._bodies.size());
+	for (std::size_t i = 0; i < serial._bodies.size(); i++)
+		REQUIRE(serial._bodies[i]._funins == parallel._bodies[i]._funins);
+}
+
+TEST_CASE("Parallel analysis reports the first error in declaration order.") {
+	std::string input =
+		"int g;\n"
+		"int a() { return 1; }\n"
+		"int b() { return g; }\n"     // g 在这里还没有被赋值
+		"void c() { g = 1; }\n"
+		"int d() { return 1 + ; }\n"
+		"int main() { return g; }\n"; // c 已经给 g 赋值
+	for (unsigned int threads : { 1u, 4u }) {
+		auto p = analyseWithThreads(input, threads);
+		REQUIRE(p._error.has_value());
+		REQUIRE(p._error.value().GetCode() == miniplc0::ErrNotInitialized);
+		REQUIRE(p._error.value().GetPos().first == 2);
+	}
+	// 去掉 b 之后，第一个错误在 d 中
+	input = input.substr(0, input.find("int b()")) + input.substr(input.find("void c()"));
+	for (unsigned int threads : { 1u, 4u }) {
+		auto p = analyseWithThreads(input, threads);
+		REQUIRE(p._error.has_value());
+		REQUIRE(p._error.value().GetCode() == miniplc0::ErrIncompleteExpression);
+	}
+}
+
+namespace miniplc0 {
+	// 直接检查 Analyser 的 token 缓冲区
+	class AnalyserTest {
+	public:
+		static const Token& peek(Analyser& analyser, std::size_t k) { return analyser.peek(k); }
+		static const Token& consume(Analyser& analyser) { return analyser.consume(); }
+		static std::size_t offset(const Analyser& analyser) { return analyser._offset; }
+	};
+}
+
+TEST_CASE("Looking past the last token returns the sentinel without moving.") {
+	using miniplc0::AnalyserTest;
+	std::stringstream ss;
+	ss.str("int x;");
+	miniplc0::Tokenizer tkz(ss);
+	auto tks = tkz.AllTokens();
+	REQUIRE_FALSE(tks.second.has_value());
+	REQUIRE(tks.first.size() == 3);
+	miniplc0::Analyser analyser(tks.first);
+
+	REQUIRE(AnalyserTest::peek(analyser, 2).GetType() == miniplc0::SEMICOLON);
+	REQUIRE(AnalyserTest::peek(analyser, 3).GetType() == miniplc0::NULL_TOKEN);
+	REQUIRE(AnalyserTest::peek(analyser, 100).GetType() == miniplc0::NULL_TOKEN);
+	REQUIRE(AnalyserTest::offset(analyser) == 0);
+
+	REQUIRE(AnalyserTest::consume(analyser).GetType() == miniplc0::INT);
+	REQUIRE(AnalyserTest::peek(analyser, 2).GetType() == miniplc0::NULL_TOKEN);
+	REQUIRE(AnalyserTest::offset(analyser) == 1);
+	AnalyserTest::consume(analyser);
+	AnalyserTest::consume(analyser);
+	// 到末尾之后向前看和读入都停在原地
+	REQUIRE(AnalyserTest::peek(analyser, 0).GetType() == miniplc0::NULL_TOKEN);
+	REQUIRE(AnalyserTest::consume(analyser).GetType() == miniplc0::NULL_TOKEN);
+	REQUIRE(AnalyserTest::offset(analyser) == 3);
+}
+
+TEST_CASE("Programs cut off in the middle are rejected.") {
+	for (auto input : {
+			"int main() { return 1",
+			"int main(",
+			"const int",
+			"const int a =",
+			"int g = 1; int main() { g = g +",
+			"int main() { if (1",
+			"int main() { while (1) {",
+			"int main() { print(1,",
+			"int f(int a, int",
+		}) {
+		auto p = miniplc0::analyseSource(input);
+		INFO(input);
+		REQUIRE(p._error.has_value());
+	}
+}
@@ -0,0 +1,70 @@
+#include "catch2/catch.hpp"
+
+#include "cache/cache.h"
+#include "tests/analyse.hpp"
+
+#include <sstream>
+
+static std::vector<miniplc0::functionBodyTable> analyseWithCache(const std::string& input, miniplc0::FunctionCache* cache) {
+	miniplc0::analyseSettings settings;
+	settings._cache = cache;
+	return miniplc0::compileSource(input, settings)._bodies;
+}
+
+static bool sameCode(const std::vector<miniplc0::functionBodyTable>& lhs, const std::vector<miniplc0::functionBodyTable>& rhs) {
+	if (lhs.size() != rhs.size())
+		return false;
+	for (std::size_t i = 0; i < lhs.size(); i++)
+		if (!(lhs[i]._funins == rhs[i]._funins) || lhs[i]._frame._max_stack != rhs[i]._frame._max_stack
+				|| lhs[i]._frame._locals != rhs[i]._frame._locals)
+			return false;
+	return true;
+}
+
+static std::string program(const std::string& twice, const std::string& show) {
+	return
+		"int g;\n"
+		"int twice(int x) {" + twice + "}\n"
+		"void show(int x) {" + show + "}\n"
+		"int init() { g = 3; return g; }\n"
+		"int main() {\n"
+		"	init();\n"
+		"	show(twice(g));\n"
+		"	return 0;\n"
+		"}\n";
+}
+
+TEST_CASE("Incremental compilation reuses the bytecode of unchanged functions.") {
+	auto original = program(" return x * 2; ", " print(x); ");
+	miniplc0::FunctionCache cache;
+	analyseWithCache(original, &cache);
+	REQUIRE(cache.GetHits() == 0);
+
+	// 缓存写出再读回来之后仍然全部命中，结果和不用缓存时一样
+	std::stringstream file;
+	cache.Save(file);
+	miniplc0::FunctionCache reloaded;
+	REQUIRE(reloaded.Load(file));
+	REQUIRE(sameCode(analyseWithCache(original, &reloaded), analyseWithCache(original, nullptr)));
+	REQUIRE(reloaded.GetHits() == 4);
+
+	// 只改一个函数体，只有它需要重新分析；行号变化不影响其他函数
+	auto edited = program(" return x * 2; ", "\n\tprint(x + 1);\n");
+	miniplc0::FunctionCache cache2;
+	analyseWithCache(original, &cache2);
+	REQUIRE(sameCode(analyseWithCache(edited, &cache2), analyseWithCache(edited, nullptr)));
+	REQUIRE(cache2.GetHits() == 3);
+
+	// 被调用的函数的签名变了，调用它的函数也要重新分析
+	auto signature = program(" return x * 2; ", " print(x); ");
+	signature.replace(signature.find("void show"), 4, "int ");
+	signature.replace(signature.find("print(x); "), 10, "print(x); return 0;");
+	miniplc0::FunctionCache cache3;
+	analyseWithCache(original, &cache3);
+	REQUIRE(sameCode(analyseWithCache(signature, &cache3), analyseWithCache(signature, nullptr)));
+	REQUIRE(cache3.GetHits() == 2);
+
+	std::stringstream bad;
+	bad.str("not a cache\n");
+	REQUIRE_FALSE(reloaded.Load(bad));
+}
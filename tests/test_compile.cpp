@@ -0,0 +1,66 @@
+#include "catch2/catch.hpp"
+
+#include "compile.h"
+
+#include <filesystem>
+#include <sstream>
+
+static std::string program(const std::string& show) {
+	return
+		"int g;\n"
+		"int twice(int x) { return x * 2; }\n"
+		"void show(int x) {" + show + "}\n"
+		"int init() { g = 3; return g; }\n"
+		"int main() {\n"
+		"	init();\n"
+		"	show(twice(g));\n"
+		"	return 0;\n"
+		"}\n";
+}
+
+static std::string contents(const std::string& path) {
+	auto s = ReadFile(path);
+	REQUIRE(s.has_value());
+	return s.value();
+}
+
+TEST_CASE("Watch mode rebuilds incrementally and keeps the last good output.") {
+	auto dir = std::filesystem::temp_directory_path() / "cc0_watch_test";
+	std::filesystem::create_directories(dir);
+	auto out = (dir / "out.s").string();
+	auto cacheFile = (dir / "cache").string();
+	miniplc0::FunctionCache cache;
+	miniplc0::optimizeOptions options;
+
+	std::stringstream log;
+	REQUIRE(WatchRebuild(program(" print(x); "), out, false, options, 1, cache, cacheFile, true, log));
+	REQUIRE(log.str().rfind("Rebuilt " + out + " in ", 0) == 0);
+	REQUIRE(log.str().find(" ms, reused 0 functions.\n") != std::string::npos);
+	auto first = contents(out);
+	REQUIRE_FALSE(first.empty());
+	REQUIRE(std::filesystem::exists(cacheFile));
+	REQUIRE_FALSE(std::filesystem::exists(out + ".tmp"));
+
+	// 只改了 show，其他三个函数直接使用缓存
+	log.str("");
+	REQUIRE(WatchRebuild(program(" print(x + 1); "), out, false, options, 1, cache, cacheFile, true, log));
+	REQUIRE(cache.GetHits() == 3);
+	REQUIRE(log.str().find(" ms, reused 3 functions.\n") != std::string::npos);
+	auto second = contents(out);
+	REQUIRE(second != first);
+
+	// 编译失败时输出保持上一次的结果，也不留下临时文件
+	log.str("");
+	REQUIRE_FALSE(WatchRebuild(program(" print(x + ); "), out, false, options, 1, cache, cacheFile, true, log));
+	REQUIRE(log.str().rfind("Build failed in ", 0) == 0);
+	REQUIRE(log.str().find(out + " is unchanged.\n") != std::string::npos);
+	REQUIRE(contents(out) == second);
+	REQUIRE_FALSE(std::filesystem::exists(out + ".tmp"));
+
+	// 改回去之后同样的输入得到同样的输出
+	log.str("");
+	REQUIRE(WatchRebuild(program(" print(x); "), out, false, options, 1, cache, "", true, log));
+	REQUIRE(contents(out) == first);
+
+	std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,94 @@
+#include "catch2/catch.hpp"
+
+#include "debug/linetable.h"
+#include "tests/analyse.hpp"
+
+using position = miniplc0::LineTable::position;
+
+TEST_CASE("Line tables map every instruction offset to its source position.") {
+	// 行号忽上忽下，跨过很多个检查点
+	std::vector<std::optional<position>> positions;
+	std::vector<position> expected;
+	position current(0, 0);
+	for (int32_t i = 0; i < 1000; i++) {
+		if (i % 3 == 0)
+			current = position((i * 7919) % 503, i % 41);
+		// 没有位置的指令沿用上一条的位置
+		bool known = i % 5 != 4;
+		positions.emplace_back(known ? std::optional<position>(current) : std::nullopt);
+		expected.emplace_back(known ? current : expected.back());
+	}
+	auto table = miniplc0::LineTable::Build(positions);
+	auto encoded = table.GetEncoded();
+	auto decoded = miniplc0::LineTable::Decode((const unsigned char*)encoded.data(), encoded.size());
+	REQUIRE(decoded.has_value());
+	for (int32_t i = 0; i < 1000; i++) {
+		REQUIRE(table.Lookup(i) == expected[i]);
+		REQUIRE(decoded.value().Lookup(i) == expected[i]);
+	}
+	REQUIRE(table.Lookup(5000) == expected.back());
+	REQUIRE_FALSE(table.Lookup(-1).has_value());
+	REQUIRE_FALSE(miniplc0::LineTable().Lookup(0).has_value());
+
+	// 截断的编码
+	REQUIRE_FALSE(miniplc0::LineTable::Decode((const unsigned char*)"\x01\x80", 2).has_value());
+}
+
+TEST_CASE("Source positions survive dead code elimination, inlining and tail calls.") {
+	std::string source =
+		"int g = 4;\n"
+		"int div(int a, int b) {\n"
+		"	return a / b;\n"
+		"}\n"
+		"int sum(int n, int acc) {\n"
+		"	if (n == 0) return acc;\n"
+		"	return sum(n - 1, acc + n);\n"
+		"}\n"
+		"int main() {\n"
+		"	while (0) { print(1); }\n"
+		"	print(div(g, 2), sum(3, 0));\n"
+		"	return 0;\n"
+		"}\n";
+	auto result = miniplc0::compileSource(source);
+	auto& bodies = result._bodies;
+	auto lines = result._analyser->getLineTables();
+	REQUIRE(lines.size() == bodies.size() + 1);
+
+	// 函数中最后一条 op 所在的行
+	auto lineOf = [&](int32_t function, miniplc0::Operation op) {
+		auto& code = bodies[function]._funins;
+		for (int32_t i = code.size() - 1; i >= 0; i--)
+			if (code[i].GetOperation() == op)
+				return lines[function + 1].Lookup(i).value().first;
+		FAIL("no such instruction");
+		return (uint64_t)0;
+	};
+	REQUIRE(lines[0].Lookup(0).value().first == 0);
+	REQUIRE(lineOf(0, miniplc0::IDIV) == 2);
+	// 尾递归改写成的跳转在 return 所在的行
+	REQUIRE(lineOf(1, miniplc0::JMP) == 6);
+	// 内联到 main 的 idiv 仍然指向 div 的函数体
+	REQUIRE(lineOf(2, miniplc0::IDIV) == 2);
+	REQUIRE(lineOf(2, miniplc0::IPRINT) == 10);
+	for (std::size_t f = 0; f < bodies.size(); f++)
+		for (std::size_t i = 0; i < bodies[f]._funins.size(); i++)
+			REQUIRE(lines[f + 1].Lookup(i).has_value());
+}
+
+TEST_CASE("Functions reused from the cache get the positions of the current source.") {
+	std::string source =
+		"int twice(int x) {\n"
+		"	return x * 2;\n"
+		"}\n"
+		"int main() { print(twice(3)); return 0; }\n";
+	miniplc0::FunctionCache cache;
+	miniplc0::analyseSettings settings;
+	settings._options._inline = false;
+	settings._cache = &cache;
+	auto first = miniplc0::compileSource(source, settings);
+	REQUIRE(first._analyser->getLineTables()[1].Lookup(0).value().first == 1);
+
+	auto shifted = miniplc0::compileSource("\n\n" + source, settings);
+	REQUIRE(cache.GetHits() == 2);
+	REQUIRE(shifted._analyser->getLineTables()[1].Lookup(0).value().first == 3);
+}
@@ -0,0 +1,174 @@
+#include "catch2/catch.hpp"
+
+#include "object/writer.h"
+#include "object/loader.h"
+#include "vm/vm.h"
+#include "tests/analyse.hpp"
+
+#include <sstream>
+
+static const std::string source =
+	"int g = 2;\n"
+	"int twice(int x) { return x * g; }\n"
+	"void show(int x) { print(x); }\n"
+	"int main() {\n"
+	"	int i = 0;\n"
+	"	while (i < 3) {\n"
+	"		show(twice(i) - 70000);\n"
+	"		i = i + 1;\n"
+	"	}\n"
+	"	return 0;\n"
+	"}\n";
+
+// 把 tag 段原样再放一份，紧接在它后面，返回新的文件和重复的段的位置
+static std::pair<std::string, std::size_t> repeatSection(const std::string& image, const char* tag) {
+	std::size_t at = image.find(tag);
+	REQUIRE(at != std::string::npos);
+	std::size_t length = 0;
+	for (std::size_t i = 4; i < 8; i++)
+		length = (length << 8) | (unsigned char)image[at + i];
+	return { image.substr(0, at + 8 + length) + image.substr(at), at + 8 + length };
+}
+
+TEST_CASE("Loader reads back what the writer wrote.") {
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+	auto fun = analyser.getFunctionTable();
+
+	std::stringstream bin;
+	miniplc0::WriteBinary(bin, fun, analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p._bodies, analyser.getLineTables(), true);
+	std::string image = bin.str();
+
+	miniplc0::Loader loader;
+	auto err = loader.LoadFromMemory((const unsigned char*)image.data(), image.size());
+	REQUIRE_FALSE(err.has_value());
+	REQUIRE(loader.HasIndex());
+	REQUIRE_FALSE(loader.DecodeAll(4).has_value());
+	REQUIRE(loader.GetConstants().size() == fun.size());
+	REQUIRE(loader.GetFunctions().size() == fun.size());
+	REQUIRE(loader.GetStartCode() == analyser.getStartCode());
+	for (std::size_t i = 0; i < fun.size(); i++) {
+		REQUIRE(loader.GetConstants()[i]._value == fun[i]._value);
+		REQUIRE(loader.GetFunction(i) == p._bodies[i]._funins);
+	}
+
+	auto loaded = loader.GetFunctionTable();
+	for (std::size_t i = 0; i < fun.size(); i++)
+		REQUIRE(loaded[i]._haveReturnValue == fun[i]._haveReturnValue);
+
+	REQUIRE(loader.GetGlobalData()._resume == 1);
+	REQUIRE(loader.GetGlobalData()._values == std::vector<int32_t>{ 2 });
+	auto lines = analyser.getLineTables();
+	REQUIRE(loader.GetLineTables().size() == fun.size() + 1);
+	for (int32_t i = -1; i < (int32_t)fun.size(); i++)
+		REQUIRE(loader.GetLineTable(i).GetEncoded() == lines[i + 1].GetEncoded());
+	miniplc0::VM vm(loaded, loader.GetStartCode(), loader.GetStartFrame(), loader.GetFunctionBodies(), loader.GetGlobalData());
+	REQUIRE(vm.IsVerified());
+	REQUIRE(vm.IsPreallocated());
+	std::stringstream in, out;
+	vm.Run(in, out);
+	REQUIRE(out.str() == "-70000\n-69998\n-69996\n");
+
+	// 截断的文件
+	err = loader.LoadFromMemory((const unsigned char*)image.data(), image.size() - 3);
+	REQUIRE(err.has_value());
+	REQUIRE(err.value().GetCode() == miniplc0::ErrTruncated);
+	image[0] = 0;
+	err = loader.LoadFromMemory((const unsigned char*)image.data(), image.size());
+	REQUIRE(err.has_value());
+	REQUIRE(err.value().GetCode() == miniplc0::ErrBadMagic);
+}
+
+TEST_CASE("Loader finds functions through the offset index.") {
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+	auto fun = analyser.getFunctionTable();
+
+	std::stringstream plain, indexed;
+	miniplc0::WriteBinary(plain, fun, analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p._bodies, analyser.getLineTables(), false);
+	miniplc0::WriteBinary(indexed, fun, analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p._bodies, analyser.getLineTables(), true);
+	std::string a = plain.str(), b = indexed.str();
+	// 基础部分不变
+	REQUIRE(b.compare(0, a.size(), a) == 0);
+
+	miniplc0::Loader scanned, seeked;
+	REQUIRE_FALSE(scanned.LoadFromMemory((const unsigned char*)a.data(), a.size()).has_value());
+	REQUIRE_FALSE(seeked.LoadFromMemory((const unsigned char*)b.data(), b.size()).has_value());
+	REQUIRE_FALSE(scanned.HasIndex());
+	REQUIRE(seeked.HasIndex());
+	REQUIRE(scanned.GetStartOffset() == seeked.GetStartOffset());
+	for (std::size_t i = 0; i < fun.size(); i++) {
+		REQUIRE(scanned.GetFunctions()[i]._offset == seeked.GetFunctions()[i]._offset);
+		REQUIRE(scanned.GetFunction(i) == seeked.GetFunction(i));
+	}
+
+	// 有索引时指令到解码时才检查
+	b[seeked.GetFunctions()[1]._offset] = (char)0xff;
+	miniplc0::Loader broken;
+	REQUIRE_FALSE(broken.LoadFromMemory((const unsigned char*)b.data(), b.size()).has_value());
+	auto err = broken.DecodeAll(2);
+	REQUIRE(err.has_value());
+	REQUIRE(err.value().GetCode() == miniplc0::ErrBadInstruction);
+	REQUIRE(err.value().GetOffset() == seeked.GetFunctions()[1]._offset);
+}
+
+TEST_CASE("Writer saturates frames that do not fit in u2.") {
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+	auto fun = analyser.getFunctionTable();
+
+	// 70000 截断成 u2 是 4464，加载后必须是未知而不是一个偏小的栈帧
+	auto bodies = p._bodies;
+	auto kept = bodies[1]._frame;
+	REQUIRE(kept.isKnown());
+	bodies[0]._frame = miniplc0::frameInfo(3, 70000);
+	std::stringstream bin;
+	miniplc0::WriteBinary(bin, fun, analyser.getStartCode(), miniplc0::frameInfo(70000, 1), analyser.getGlobalData(), bodies, analyser.getLineTables(), true);
+	std::string image = bin.str();
+
+	miniplc0::Loader loader;
+	REQUIRE_FALSE(loader.LoadFromMemory((const unsigned char*)image.data(), image.size()).has_value());
+	REQUIRE_FALSE(loader.GetStartFrame().isKnown());
+	REQUIRE_FALSE(loader.GetFrame(0).isKnown());
+	REQUIRE(loader.GetFrame(1)._max_stack == kept._max_stack);
+	REQUIRE(loader.GetFrame(1)._locals == kept._locals);
+}
+
+TEST_CASE("Loader rejects repeated extension sections.") {
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+	std::stringstream bin;
+	miniplc0::WriteBinary(bin, analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p._bodies, analyser.getLineTables(), true);
+	std::string image = bin.str();
+
+	miniplc0::Loader loader;
+	for (auto tag : { "FRAM", "DATA", "LINE" }) {
+		INFO(tag);
+		auto twice = repeatSection(image, tag);
+		auto err = loader.LoadFromMemory((const unsigned char*)twice.first.data(), twice.first.size());
+		REQUIRE(err.has_value());
+		REQUIRE(err.value().GetCode() == miniplc0::ErrBadExtension);
+		REQUIRE(err.value().GetOffset() == twice.second);
+	}
+}
+
+TEST_CASE("Out-of-range function indices get empty results.") {
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+	int32_t count = analyser.getFunctionTable().size();
+	std::stringstream bin;
+	miniplc0::WriteBinary(bin, analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), analyser.getGlobalData(), p._bodies, analyser.getLineTables(), true);
+	std::string image = bin.str();
+
+	miniplc0::Loader loader;
+	REQUIRE_FALSE(loader.LoadFromMemory((const unsigned char*)image.data(), image.size()).has_value());
+	REQUIRE_FALSE(loader.GetFunction(count - 1).empty());
+	REQUIRE(loader.GetFrame(count - 1).isKnown());
+	for (int32_t index : { -2, -1, count, count + 100 })
+		REQUIRE(loader.GetFunction(index).empty());
+	for (int32_t index : { -2, count, count + 100 }) {
+		REQUIRE_FALSE(loader.GetFrame(index).isKnown());
+		REQUIRE(loader.GetLineTable(index).IsEmpty());
+	}
+	REQUIRE_FALSE(loader.GetLineTable(-1).IsEmpty());
+}
@@ -1,2 +1,4 @@
 #define CATCH_CONFIG_MAIN
+// 新版 glibc 的 MINSIGSTKSZ 不再是常量，catch2 的信号处理无法编译
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 #include "catch2/catch.hpp"
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "catch2/catch.hpp"
+
+#include "profiler/sampler.h"
+
+#include <sstream>
+#include <chrono>
+#include <ctime>
+
+#ifdef __linux__
+// 在 burn 作用域里消耗 ms 毫秒的 CPU 时间
+static volatile unsigned long sink;
+static void burn(long ms) {
+	miniplc0::SampleScope scope("burn");
+	miniplc0::SetSampleLine(41);
+	auto start = std::clock();
+	while ((std::clock() - start) * 1000 / CLOCKS_PER_SEC < ms)
+		for (int i = 0; i < 10000; i++)
+			sink = sink * 31 + i;
+}
+
+TEST_CASE("The sampler records the shadow stack and the current line.") {
+	REQUIRE(miniplc0::Sampler::Start());
+	{
+		miniplc0::SampleScope scope("phase");
+		burn(200);
+	}
+	miniplc0::Sampler::Stop();
+	REQUIRE(miniplc0::Sampler::GetSamples() > 0);
+	REQUIRE(miniplc0::Sampler::GetDropped() == 0);
+	std::stringstream ss;
+	miniplc0::Sampler::WriteFolded(ss, "test");
+	REQUIRE(ss.str().find("test;phase;burn;line 41 ") != std::string::npos);
+	REQUIRE(miniplc0::CurrentSampleStack().empty());
+}
+#endif
@@ -24,4 +24,87 @@ TEST_CASE("Test hello world.") {
 	}
 	REQUIRE( (result.first == output) );
 	*/
-}
\ No newline at end of file
+}
+// 足够长的源代码才会被切块，块的边界附近放上跨行的块注释和各种注释写法
+static std::string longSource(const std::string& tail) {
+	std::string unit =
+		"int f(int a) { return a / 2; } // line comment /* not a block\n"
+		"/* block comment\n"
+		"   int x = 1; spanning lines **/ still inside\n"
+		"   // still inside */ int g = 0x1F;\n"
+		"int h = a//b\r/* starts after a carriage return\n"
+		"*/ ;\n"
+		"const int k = 10 >= 9 != 8 <= 7 == 6;\n";
+	std::string s;
+	while (s.size() < 512 * 1024)
+		s += unit;
+	return s + tail;
+}
+
+static std::pair<std::vector<miniplc0::Token>, std::optional<miniplc0::CompilationError>> tokenize(const std::string& input, unsigned int threads) {
+	std::stringstream ss;
+	ss.str(input);
+	miniplc0::Tokenizer tkz(ss);
+	return threads == 1 ? tkz.AllTokens() : tkz.AllTokensParallel(threads);
+}
+
+TEST_CASE("Parallel tokenization produces the same tokens as the serial tokenizer.") {
+	auto input = longSource("int main() { return 0; }\n");
+	auto serial = tokenize(input, 1);
+	REQUIRE_FALSE(serial.second.has_value());
+	for (unsigned int threads : { 2u, 3u, 8u }) {
+		auto parallel = tokenize(input, threads);
+		REQUIRE_FALSE(parallel.second.has_value());
+		REQUIRE(parallel.first == serial.first);
+	}
+
+	// 第一个错误与串行分析的相同，包括位置
+	for (auto tail : { "int a = 01;\n$\n", "/* unmatched\n" }) {
+		auto input = longSource("") + longSource(tail);
+		auto serial = tokenize(input, 1);
+		REQUIRE(serial.second.has_value());
+		auto parallel = tokenize(input, 4);
+		REQUIRE(parallel.second.has_value());
+		REQUIRE(parallel.second.value() == serial.second.value());
+		REQUIRE(parallel.first.empty());
+	}
+}
+
+TEST_CASE("The table-driven tokenizer keeps the token values, positions and comment rules.") {
+	// 单个字符的运算符的值为 char，两个字符的为 string，十六进制转换为十进制
+	auto result = tokenize("int a1=0x1F<=b!=c;// x\r{ /* **/ } */ 0\n", 1);
+	REQUIRE_FALSE(result.second.has_value());
+	auto& tokens = result.first;
+	std::vector<miniplc0::TokenType> types = {
+		miniplc0::INT, miniplc0::IDENTIFIER, miniplc0::ASSIGNMENT_SIGN, miniplc0::INT_LITERAL,
+		miniplc0::LESS_EQUAL_SIGN, miniplc0::IDENTIFIER, miniplc0::NOT_EQUAL_SIGN, miniplc0::IDENTIFIER,
+		miniplc0::SEMICOLON, miniplc0::LEFT_BRACE, miniplc0::INT_LITERAL
+	};
+	REQUIRE(tokens.size() == types.size());
+	for (std::size_t i = 0; i < types.size(); i++)
+		REQUIRE(tokens[i].GetType() == types[i]);
+	REQUIRE(tokens[1].GetValueString() == "a1");
+	REQUIRE(tokens[2].GetValue().type() == typeid(char));
+	REQUIRE(tokens[3].GetValueString() == "31");
+	REQUIRE(tokens[4].GetValue().type() == typeid(std::string));
+	REQUIRE(tokens[4].GetStartPos() == std::make_pair<std::uint64_t, std::uint64_t>(0, 11));
+	REQUIRE(tokens[4].GetEndPos() == std::make_pair<std::uint64_t, std::uint64_t>(0, 13));
+	REQUIRE(tokens[10].GetStartPos() == std::make_pair<std::uint64_t, std::uint64_t>(0, 37));
+
+	// 错误的位置：不合法的字符在它自己的位置，其余的在 token 或注释的开头
+	std::vector<std::pair<std::string, miniplc0::CompilationError>> errors = {
+		{ "int a;\n  $", miniplc0::CompilationError(1, 2, miniplc0::ErrInvalidInput) },
+		{ "a = !b", miniplc0::CompilationError(0, 4, miniplc0::ErrInvalidOperator) },
+		{ "a /* **/", miniplc0::CompilationError(0, 2, miniplc0::ErrAnnotationUnmatched) },
+		{ "x = 2147483648", miniplc0::CompilationError(0, 4, miniplc0::ErrIntegerOverflow) },
+		{ "x = 0x80000000", miniplc0::CompilationError(0, 4, miniplc0::ErrIntegerOverflow) },
+		{ "x = 0xg", miniplc0::CompilationError(0, 4, miniplc0::ErrInvalidIntegerLiteral) },
+		{ "x = 012", miniplc0::CompilationError(0, 4, miniplc0::ErrInvalidIntegerLiteral) },
+		{ "x = 1a", miniplc0::CompilationError(0, 4, miniplc0::ErrInvalidIdentifier) },
+	};
+	for (auto& e : errors) {
+		auto r = tokenize(e.first, 1);
+		REQUIRE(r.second.has_value());
+		REQUIRE(r.second.value() == e.second);
+	}
+}
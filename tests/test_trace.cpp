@@ -0,0 +1,47 @@
+#include "catch2/catch.hpp"
+
+#include "profiler/trace.h"
+
+#include <sstream>
+#include <thread>
+#include <string>
+
+static std::size_t occurrences(const std::string& s, const std::string& pattern) {
+	std::size_t n = 0;
+	for (auto pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1))
+		n++;
+	return n;
+}
+
+TEST_CASE("The tracer writes complete events from every thread.") {
+	miniplc0::Tracer::Start();
+	{
+		miniplc0::TraceScope outer("outer");
+		std::thread worker([]() {
+			std::string name = "a\"very_long_function_name_that_is_truncated";
+			miniplc0::TraceScope scope("inner", name);
+		});
+		worker.join();
+	}
+	miniplc0::Tracer::Stop();
+	{
+		// 停止之后不再记录
+		miniplc0::TraceScope ignored("ignored");
+	}
+
+	std::stringstream ss;
+	miniplc0::Tracer::WriteChrome(ss);
+	auto json = ss.str();
+	REQUIRE(occurrences(json, "\"ph\":\"X\"") == 2);
+	REQUIRE(occurrences(json, "\"thread_name\"") == 2);
+	REQUIRE(json.find("\"name\":\"outer\"") != std::string::npos);
+	REQUIRE(json.find("\"detail\":\"a\\\"very_long_function_name_that_\"") != std::string::npos);
+	REQUIRE(json.find("ignored") == std::string::npos);
+
+	// 重新开始时清空之前的事件
+	miniplc0::Tracer::Start();
+	miniplc0::Tracer::Stop();
+	ss.str("");
+	miniplc0::Tracer::WriteChrome(ss);
+	REQUIRE(occurrences(ss.str(), "\"ph\":\"X\"") == 0);
+}
@@ -0,0 +1,82 @@
+#include "catch2/catch.hpp"
+
+#include "verifier/verifier.h"
+#include "tests/analyse.hpp"
+
+using miniplc0::Instruction;
+
+// 只有一个 int main() 的程序
+static std::optional<miniplc0::VerificationError> verifyMain(std::vector<Instruction> ins, miniplc0::frameInfo frame = {}) {
+	miniplc0::functionsTable f("S", 0, 1, "main");
+	f._haveReturnValue = 1;
+	miniplc0::functionBodyTable body;
+	body._funins = std::move(ins);
+	body._frame = frame;
+	return miniplc0::Verify({ f }, {}, miniplc0::frameInfo(), { body });
+}
+
+TEST_CASE("Compiled programs pass verification.") {
+	std::string input =
+		"int g = 1;\n"
+		"int fib(int n) { if (n <= 1) return n; return fib(n-1) + fib(n-2); }\n"
+		"int main() {\n"
+		"	int i = 0;\n"
+		"	while (i < 10) { print(fib(i)); i = i + 1; }\n"
+		"	return g;\n"
+		"}\n";
+	auto p = miniplc0::compileSource(input);
+	auto& analyser = *p._analyser;
+	REQUIRE_FALSE(miniplc0::Verify(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies).has_value());
+}
+
+TEST_CASE("Verifier rejects invalid bytecode.") {
+	auto err = verifyMain({ Instruction(miniplc0::JMP, 5, 0) });
+	REQUIRE(err.has_value());
+	REQUIRE(err.value().GetCode() == miniplc0::ErrJumpOutOfRange);
+
+	err = verifyMain({ Instruction(miniplc0::CALL, 1, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrInvalidCall);
+
+	err = verifyMain({ Instruction(miniplc0::LOADA, 2, 0), Instruction(miniplc0::IRET, 0, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrInvalidLevel);
+
+	err = verifyMain({ Instruction(miniplc0::IADD, 0, 0), Instruction(miniplc0::IRET, 0, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrStackUnderflow);
+
+	err = verifyMain({ Instruction(miniplc0::IPUSH, 0, 0), Instruction(miniplc0::ILOAD, 0, 0), Instruction(miniplc0::IRET, 0, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrNotAddress);
+
+	// 两条路径到达 3 时栈高度不同
+	err = verifyMain({
+		Instruction(miniplc0::ISCAN, 0, 0),
+		Instruction(miniplc0::JE, 3, 0),
+		Instruction(miniplc0::IPUSH, 1, 0),
+		Instruction(miniplc0::IPUSH, 2, 0),
+		Instruction(miniplc0::IRET, 0, 0),
+	});
+	REQUIRE(err.value().GetCode() == miniplc0::ErrStackMismatch);
+	REQUIRE(err.value().GetOffset() == 3);
+
+	err = verifyMain({ Instruction(miniplc0::IPUSH, 1, 0), Instruction(miniplc0::IPUSH, 2, 0), Instruction(miniplc0::IRET, 0, 0) },
+		miniplc0::frameInfo(1, 0));
+	REQUIRE(err.value().GetCode() == miniplc0::ErrStackOverflow);
+
+	err = verifyMain({ Instruction(miniplc0::IPUSH, 1, 0), Instruction(miniplc0::RET, 0, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrInvalidReturn);
+
+	err = verifyMain({ Instruction(miniplc0::IPUSH, 1, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrFallOffEnd);
+
+	// 跳转表超出了函数，或者其中有不是 jmp 的指令
+	err = verifyMain({ Instruction(miniplc0::ISCAN, 0, 0), Instruction(miniplc0::TABLESWITCH, 0, 2), Instruction(miniplc0::JMP, 3, 0) });
+	REQUIRE(err.value().GetCode() == miniplc0::ErrJumpOutOfRange);
+	err = verifyMain({
+		Instruction(miniplc0::ISCAN, 0, 0),
+		Instruction(miniplc0::TABLESWITCH, 0, 1),
+		Instruction(miniplc0::JMP, 4, 0),
+		Instruction(miniplc0::RET, 0, 0),
+		Instruction(miniplc0::IPUSH, 0, 0),
+		Instruction(miniplc0::IRET, 0, 0),
+	});
+	REQUIRE(err.value().GetCode() == miniplc0::ErrInvalidSwitchTable);
+}
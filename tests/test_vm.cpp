@@ -0,0 +1,228 @@
+#include "catch2/catch.hpp"
+
+#include "vm/vm.h"
+#include "tests/analyse.hpp"
+
+#include <sstream>
+
+// 编译并运行一段 C0 程序，返回输出
+static std::string runSource(const std::string& source, const std::string& input, const miniplc0::analyseSettings& settings = {}) {
+	auto p = miniplc0::compileSource(source, settings);
+	auto& analyser = *p._analyser;
+
+	miniplc0::VM vm(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies, analyser.getGlobalData());
+	REQUIRE(vm.IsPreallocated());
+	REQUIRE(vm.IsVerified());
+	std::stringstream in(input), out;
+	vm.Run(in, out);
+
+	// 栈顶缓存和逐条读写内存的解释器结果必须一致
+	miniplc0::VM plain(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies, analyser.getGlobalData());
+	plain.SetStackCaching(false);
+	std::stringstream plainIn(input), plainOut;
+	plain.Run(plainIn, plainOut);
+	REQUIRE(plainOut.str() == out.str());
+	return out.str();
+}
+
+static const std::string c3 =
+	"int pi = 3;\n"
+	"int N = 0xbabe;\n"
+	"int max;\n"
+	"int fib(int n) {\n"
+	"	if (n <= 0) return 0;\n"
+	"	if (n == 1) return 1;\n"
+	"	else return fib(n-2) + fib(n-1);\n"
+	"}\n"
+	"int main() {\n"
+	"	int i = 0;\n"
+	"	int f;\n"
+	"	scan(max);\n"
+	"	pi = pi * 3;\n"
+	"	scan(pi);\n"
+	"	if (pi < max) {\n"
+	"		max = pi;\n"
+	"	}\n"
+	"	while(i < max) {\n"
+	"		f = fib(i);\n"
+	"		if (f < N) {\n"
+	"			print(i,0,N,f);\n"
+	"		}\n"
+	"		else {\n"
+	"			print(i,1,N,f);\n"
+	"		}\n"
+	"		i = i+1;\n"
+	"	}\n"
+	"	return 0;\n"
+	"}\n";
+
+TEST_CASE("VM runs a recursive program.") {
+	std::string expected =
+		"0 0 47806 0\n"
+		"1 0 47806 1\n"
+		"2 0 47806 1\n"
+		"3 0 47806 2\n"
+		"4 0 47806 3\n";
+	REQUIRE(runSource(c3, "5 10") == expected);
+}
+
+TEST_CASE("Inlined and tail-recursive functions keep their results.") {
+	std::string source =
+		"int g = 7;\n"
+		"int get() { return g; }\n"
+		"int sq(int x) { return x*x; }\n"
+		"int add3(int a, int b, int c) { return a+b+c; }\n"
+		"int sum(int n, int acc) {\n"
+		"	int t = 1;\n"
+		"	if (n == 0) return acc;\n"
+		"	return sum(n - t, acc + n);\n"
+		"}\n"
+		"int main() {\n"
+		"	int i = 2;\n"
+		"	print(get(), sq(i), add3(i, sq(3), get()));\n"
+		"	while (get() < 9) { g = g + 1; }\n"
+		"	print(g, sum(100000, 0));\n"
+		"	return 0;\n"
+		"}\n";
+	std::string expected = "7 4 18\n9 705082704\n";
+	REQUIRE(runSource(source, "") == expected);
+	miniplc0::analyseSettings settings;
+	settings._options._inline = false;
+	REQUIRE(runSource(source, "", settings) == expected);
+}
+
+TEST_CASE("Switch statements reach the same labels through every kind of dispatch.") {
+	std::string source =
+		"int dense(int x) {\n"
+		"	switch (x) { case 1: return 10; case 2: return 20; case 3: case 4: return 34; case 6: return 60; default: return -1; }\n"
+		"}\n"
+		"int sparse(int x) {\n"
+		"	int r = 0;\n"
+		"	switch (x) {\n"
+		"		case -1000: r = 1; break;\n"
+		"		case 5: r = 2; break;\n"
+		"		case 700: r = 3;\n"
+		"		case 9000: r = r + 4; break;\n"
+		"		case 0: r = 5; break;\n"
+		"		case 123456: r = 6; break;\n"
+		"		case 2147483647: r = 7; break;\n"
+		"		case -2147483647: r = 8; break;\n"
+		"	}\n"
+		"	return r;\n"
+		"}\n"
+		"int main() {\n"
+		"	int i = -1;\n"
+		"	while (i < 8) { print(dense(i)); i = i + 1; }\n"
+		"	print(sparse(-1000), sparse(5), sparse(700), sparse(9000), sparse(0), sparse(123456));\n"
+		"	print(sparse(2147483647), sparse(-2147483647), sparse(-2147483647-1), sparse(3));\n"
+		"	switch (i) { case 0: print(0); case 8: { print(8); break; } }\n"
+		"	switch (i) { }\n"
+		"	return 0;\n"
+		"}\n";
+	std::string expected =
+		"-1\n-1\n10\n20\n34\n34\n-1\n60\n-1\n"
+		"1 2 7 4 5 6\n"
+		"7 8 0 0\n"
+		"8\n";
+	REQUIRE(runSource(source, "") == expected);
+}
+
+TEST_CASE("For, do-while, break and continue follow C semantics.") {
+	std::string source =
+		"int g = 0;\n"
+		"void tick() { g = g + 1; }\n"
+		"int main() {\n"
+		"	int i; int j; int s = 0;\n"
+		"	for (i = 0, j = 10; i < j; i = i + 1, tick()) {\n"
+		"		if (i == 2) continue;\n"
+		"		if (i == 7) break;\n"
+		"		s = s + i;\n"
+		"	}\n"
+		"	print(i, j, s, g);\n"
+		"	i = 0;\n"
+		"	do { i = i + 1; if (i == 3) continue; print(i); } while (i < 5);\n"
+		"	do i = i + 10; while (i < 0);\n"
+		"	for (;;) { i = i - 1; if (i < 10) break; }\n"
+		"	print(i);\n"
+		"	for (i = 0; i < 4; i = i + 1)\n"
+		"		switch (i) { case 1: continue; case 2: print(20); break; default: print(i); }\n"
+		"	i = 0;\n"
+		"	while (1) { i = i + 1; if (i < 3) continue; for (j = 0; ; j = j + 1) if (j == 2) break; if (i > 5) break; }\n"
+		"	print(i, j);\n"
+		"	return 0;\n"
+		"}\n";
+	std::string expected = "7 10 19 7\n1\n2\n4\n5\n9\n0\n20\n3\n6 2\n";
+	REQUIRE(runSource(source, "") == expected);
+}
+
+TEST_CASE("Constant global initializers are evaluated at compile time.") {
+	auto globals = [](const std::string& divisor) {
+		return
+			"int a = 1;\n"
+			"const int c = -0x10;\n"
+			"int b = a * 2 + c;\n"
+			"int d;\n"
+			"int e = b / (c + " + divisor + ");\n"
+			"int main() { d = 3; print(a, b, c, d, e); return 0; }\n";
+	};
+	REQUIRE(runSource(globals("18"), "") == "1 -14 -16 3 -7\n");
+
+	// 停在除零的 idiv 之前，栈上的临时值也一起保存，除零留到运行时报错
+	auto p = miniplc0::compileSource(globals("16"));
+	auto& analyser = *p._analyser;
+	auto data = analyser.getGlobalData();
+	REQUIRE(data._resume == 17);
+	REQUIRE(data._values == std::vector<int32_t>{ 1, -16, -14, 0, -14, 0 });
+	miniplc0::VM vm(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies, data);
+	REQUIRE(vm.IsVerified());
+	std::stringstream in, out;
+	REQUIRE_THROWS_AS(vm.Run(in, out), std::runtime_error);
+
+	// 和 .start 对不上的数据不能通过校验
+	data._values.pop_back();
+	miniplc0::VM bad(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies, data);
+	REQUIRE_FALSE(bad.IsVerified());
+}
+
+TEST_CASE("The profiler counts every executed instruction and call.") {
+	std::string source =
+		"int fib(int n) {\n"
+		"	if (n <= 1) return n;\n"
+		"	return fib(n - 1) + fib(n - 2);\n"
+		"}\n"
+		"int main() { print(fib(10)); return 0; }\n";
+	auto p = miniplc0::compileSource(source);
+	auto& analyser = *p._analyser;
+
+	miniplc0::VM vm(analyser.getFunctionTable(), analyser.getStartCode(), analyser.getStartFrame(), p._bodies, analyser.getGlobalData());
+	miniplc0::ExecutionProfile profile;
+	vm.SetProfile(&profile);
+	std::stringstream in, out;
+	vm.Run(in, out);
+	REQUIRE(out.str() == "55\n");
+
+	// fib(10) 一共调用 177 次，每次执行一条返回指令
+	auto& fib = profile.GetFunction(0);
+	REQUIRE(fib._calls == 177);
+	REQUIRE(profile.GetFunction(1)._calls == 1);
+	REQUIRE(profile.GetOpcodeCount(miniplc0::CALL) == 177);
+	REQUIRE(profile.GetOpcodeCount(miniplc0::IRET) == 178);
+	REQUIRE(fib._counts[0] == 177);
+	REQUIRE(fib._inclusive >= fib._exclusive);
+
+	// 按操作码、函数和偏移统计的总数相同
+	std::uint64_t byFunction = 0, byOffset = 0;
+	for (int32_t i = -1; i < (int32_t)profile.GetFunctionsCount(); i++) {
+		auto& f = profile.GetFunction(i);
+		byFunction += f._instructions;
+		for (auto it : f._counts)
+			byOffset += it;
+	}
+	REQUIRE(byFunction == profile.GetTotalInstructions());
+	REQUIRE(byOffset == profile.GetTotalInstructions());
+
+	// 重新运行时从头统计
+	std::stringstream in2, out2;
+	vm.Run(in2, out2);
+	REQUIRE(profile.GetFunction(0)._calls == 177);
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "tokenizer/token.h"
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	// 词法分析的状态机
+	// 下面的 DFA_RULES 和 DFA_ACCEPTS 是状态机的全部规格，转移表和接受动作表在编译期由它们生成
+	// 转移表每个状态一行，直接用字节索引，一行 256 个 uint8_t，全部状态加起来只有几 KB
+	// 查到 DFA_STOP 表示这个字符不属于当前 token：不读入它，按当前状态的接受动作结束
+
+	// 状态机的所有状态
+	enum DFAState : std::uint8_t {
+		INITIAL_STATE,
+		IDENTIFIER_STATE,
+		INT_DECIMAL_STATE,
+		INT_HEXADECIMAL_STATE,
+		ZERO_STATE,
+
+		PLUS_SIGN_STATE,
+		MINUS_SIGN_STATE,
+		DIVISION_SIGN_STATE,
+		MULTIPLICATION_SIGN_STATE,
+		ASSIGNMENT_SIGN_STATE,      //'='
+		LESS_SIGN_STATE,
+		LESS_EQUAL_SIGN_STATE,
+		GREATER_SIGN_STATE,
+		GREATER_EQUAL_SIGN_STATE,
+		NOT_EQUAL_SIGN_STATE,
+		EQUAL_SIGN_STATE,           //'=='
+
+		SEMICOLON_STATE,
+		COMMA_STATE,
+		LEFT_BRACKET_STATE,
+		RIGHT_BRACKET_STATE,
+		EXCLAMATION_SIGN_STATE,     //'!'
+		LEFT_BRACE_STATE,           //'{'
+		RIGHT_BRACE_STATE,          //'}'
+		COLON_STATE,                //':'
+
+		ANNOTATION_1_STATE,         //  //...
+		ANNOTATION_2_STATE,         //  /*...
+		ANNOTATION_3_STATE,         //  /*...*
+
+		DFA_STATES
+	};
+
+	const std::uint8_t DFA_STOP = 0xFF;
+
+	// 状态机停下时的动作
+	enum DFAAction : std::uint8_t {
+		DFA_NO_ACTION,              // 规格中遗漏的状态，编译期检查
+		DFA_END,                    // 文件尾返回 ErrEOF，否则当前字符不合法
+		DFA_UNMATCHED_ANNOTATION,   // 块注释没有结束
+		DFA_INVALID_OPERATOR,       // 单独的 '!'
+		DFA_IDENTIFIER,             // 标识符或者关键字
+		DFA_DECIMAL,
+		DFA_HEXADECIMAL,
+		DFA_OPERATOR                // 单个字符的值为 char，两个字符的为 string
+	};
+
+	// 转移规则，按顺序生效，后面的覆盖前面的
+	// _chars 中形如 a-z 的三个字符表示范围，nullptr 表示所有字节，没有规则的字节为 DFA_STOP
+	class dfaRule {
+	public:
+		DFAState _from;
+		const char* _chars;
+		DFAState _to;
+	};
+
+	class dfaAccept {
+	public:
+		DFAState _state;
+		DFAAction _action;
+		TokenType _type;            // 只用于 DFA_OPERATOR
+	};
+
+	constexpr dfaRule DFA_RULES[] = {
+		{ INITIAL_STATE, " \t\n\v\f\r", INITIAL_STATE },
+		{ INITIAL_STATE, "0", ZERO_STATE },
+		{ INITIAL_STATE, "1-9", INT_DECIMAL_STATE },
+		{ INITIAL_STATE, "a-zA-Z", IDENTIFIER_STATE },
+		{ INITIAL_STATE, "+", PLUS_SIGN_STATE },
+		{ INITIAL_STATE, "-", MINUS_SIGN_STATE },
+		{ INITIAL_STATE, "*", MULTIPLICATION_SIGN_STATE },
+		{ INITIAL_STATE, "/", DIVISION_SIGN_STATE },
+		{ INITIAL_STATE, "=", ASSIGNMENT_SIGN_STATE },
+		{ INITIAL_STATE, "<", LESS_SIGN_STATE },
+		{ INITIAL_STATE, ">", GREATER_SIGN_STATE },
+		{ INITIAL_STATE, "!", EXCLAMATION_SIGN_STATE },
+		{ INITIAL_STATE, ";", SEMICOLON_STATE },
+		{ INITIAL_STATE, ",", COMMA_STATE },
+		{ INITIAL_STATE, "(", LEFT_BRACKET_STATE },
+		{ INITIAL_STATE, ")", RIGHT_BRACKET_STATE },
+		{ INITIAL_STATE, "{", LEFT_BRACE_STATE },
+		{ INITIAL_STATE, "}", RIGHT_BRACE_STATE },
+		{ INITIAL_STATE, ":", COLON_STATE },
+
+		// 以数字开头、后面有字母的是不合法的标识符，由 checkToken 报错
+		{ IDENTIFIER_STATE, "0-9a-zA-Z", IDENTIFIER_STATE },
+		{ ZERO_STATE, "0-9", INT_DECIMAL_STATE },
+		{ ZERO_STATE, "a-zA-Z", IDENTIFIER_STATE },
+		{ ZERO_STATE, "xX", INT_HEXADECIMAL_STATE },
+		{ INT_DECIMAL_STATE, "0-9", INT_DECIMAL_STATE },
+		{ INT_DECIMAL_STATE, "a-zA-Z", IDENTIFIER_STATE },
+		{ INT_HEXADECIMAL_STATE, "0-9a-zA-Z", INT_HEXADECIMAL_STATE },
+
+		{ ASSIGNMENT_SIGN_STATE, "=", EQUAL_SIGN_STATE },
+		{ LESS_SIGN_STATE, "=", LESS_EQUAL_SIGN_STATE },
+		{ GREATER_SIGN_STATE, "=", GREATER_EQUAL_SIGN_STATE },
+		{ EXCLAMATION_SIGN_STATE, "=", NOT_EQUAL_SIGN_STATE },
+
+		{ DIVISION_SIGN_STATE, "/", ANNOTATION_1_STATE },
+		{ DIVISION_SIGN_STATE, "*", ANNOTATION_2_STATE },
+		// 行注释遇到 \n 或 \r 就结束
+		{ ANNOTATION_1_STATE, nullptr, ANNOTATION_1_STATE },
+		{ ANNOTATION_1_STATE, "\n\r", INITIAL_STATE },
+		// 块注释中 '*' 后面紧跟 '/' 才结束，否则回到块注释中，所以 "**/" 并不结束注释
+		{ ANNOTATION_2_STATE, nullptr, ANNOTATION_2_STATE },
+		{ ANNOTATION_2_STATE, "*", ANNOTATION_3_STATE },
+		{ ANNOTATION_3_STATE, nullptr, ANNOTATION_2_STATE },
+		{ ANNOTATION_3_STATE, "/", INITIAL_STATE },
+	};
+
+	constexpr dfaAccept DFA_ACCEPTS[] = {
+		{ INITIAL_STATE, DFA_END, NULL_TOKEN },
+		{ IDENTIFIER_STATE, DFA_IDENTIFIER, NULL_TOKEN },
+		{ INT_DECIMAL_STATE, DFA_DECIMAL, NULL_TOKEN },
+		{ INT_HEXADECIMAL_STATE, DFA_HEXADECIMAL, NULL_TOKEN },
+		{ ZERO_STATE, DFA_DECIMAL, NULL_TOKEN },
+
+		{ PLUS_SIGN_STATE, DFA_OPERATOR, PLUS_SIGN },
+		{ MINUS_SIGN_STATE, DFA_OPERATOR, MINUS_SIGN },
+		{ DIVISION_SIGN_STATE, DFA_OPERATOR, DIVISION_SIGN },
+		{ MULTIPLICATION_SIGN_STATE, DFA_OPERATOR, MULTIPLICATION_SIGN },
+		{ ASSIGNMENT_SIGN_STATE, DFA_OPERATOR, ASSIGNMENT_SIGN },
+		{ LESS_SIGN_STATE, DFA_OPERATOR, LESS_SIGN },
+		{ LESS_EQUAL_SIGN_STATE, DFA_OPERATOR, LESS_EQUAL_SIGN },
+		{ GREATER_SIGN_STATE, DFA_OPERATOR, GREATER_SIGN },
+		{ GREATER_EQUAL_SIGN_STATE, DFA_OPERATOR, GREATER_EQUAL_SIGN },
+		{ NOT_EQUAL_SIGN_STATE, DFA_OPERATOR, NOT_EQUAL_SIGN },
+		{ EQUAL_SIGN_STATE, DFA_OPERATOR, EQUAL_SIGN },
+
+		{ SEMICOLON_STATE, DFA_OPERATOR, SEMICOLON },
+		{ COMMA_STATE, DFA_OPERATOR, COMMA },
+		{ LEFT_BRACKET_STATE, DFA_OPERATOR, LEFT_BRACKET },
+		{ RIGHT_BRACKET_STATE, DFA_OPERATOR, RIGHT_BRACKET },
+		{ EXCLAMATION_SIGN_STATE, DFA_INVALID_OPERATOR, NULL_TOKEN },
+		{ LEFT_BRACE_STATE, DFA_OPERATOR, LEFT_BRACE },
+		{ RIGHT_BRACE_STATE, DFA_OPERATOR, RIGHT_BRACE },
+		{ COLON_STATE, DFA_OPERATOR, COLON },
+
+		// 行注释只会在文件尾停下，和初始状态一样
+		{ ANNOTATION_1_STATE, DFA_END, NULL_TOKEN },
+		{ ANNOTATION_2_STATE, DFA_UNMATCHED_ANNOTATION, NULL_TOKEN },
+		{ ANNOTATION_3_STATE, DFA_UNMATCHED_ANNOTATION, NULL_TOKEN },
+	};
+
+	using dfaTransitions = std::array<std::array<std::uint8_t, 256>, DFA_STATES>;
+	using dfaActions = std::array<dfaAccept, DFA_STATES>;
+
+	constexpr dfaTransitions makeDFATransitions() {
+		dfaTransitions table{};
+		for (auto& row : table)
+			for (auto& next : row)
+				next = DFA_STOP;
+		for (auto& rule : DFA_RULES) {
+			auto& row = table[rule._from];
+			if (rule._chars == nullptr) {
+				for (auto& next : row)
+					next = rule._to;
+				continue;
+			}
+			for (std::size_t i = 0; rule._chars[i] != 0; i++) {
+				auto first = static_cast<unsigned char>(rule._chars[i]), last = first;
+				if (rule._chars[i + 1] == '-' && rule._chars[i + 2] != 0) {
+					last = static_cast<unsigned char>(rule._chars[i + 2]);
+					i += 2;
+				}
+				for (unsigned int ch = first; ch <= last; ch++)
+					row[ch] = rule._to;
+			}
+		}
+		return table;
+	}
+
+	constexpr dfaActions makeDFAActions() {
+		dfaActions actions{};
+		for (std::size_t i = 0; i < actions.size(); i++)
+			actions[i] = { static_cast<DFAState>(i), DFA_NO_ACTION, NULL_TOKEN };
+		for (auto& accept : DFA_ACCEPTS)
+			actions[accept._state] = accept;
+		return actions;
+	}
+
+	// 每个状态都必须有接受动作
+	constexpr bool isDFAComplete(const dfaActions& actions) {
+		for (auto& accept : actions)
+			if (accept._action == DFA_NO_ACTION)
+				return false;
+		return true;
+	}
+
+	constexpr dfaTransitions DFA_TRANSITIONS = makeDFATransitions();
+	constexpr dfaActions DFA_ACTIONS = makeDFAActions();
+	static_assert(isDFAComplete(DFA_ACTIONS), "every DFA state needs an accept action");
+}
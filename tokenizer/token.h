@@ -55,7 +55,8 @@ namespace miniplc0 {
 		LEFT_BRACKET,       //'('
 		RIGHT_BRACKET,      //')'
 		LEFT_BRACE,         //'{'
-		RIGHT_BRACE         //'}'
+		RIGHT_BRACE,        //'}'
+		COLON               //':'
 	};
 
 	class Token final {
@@ -73,7 +74,7 @@ namespace miniplc0 {
 		Token(TokenType type, std::any value, std::pair<uint64_t, uint64_t> start, std::pair<uint64_t, uint64_t> end)
 			: Token(type, value, start.first, start.second, end.first, end.second) {}
 		Token(const Token& t) { _type = t._type;  _value = t._value; _start_pos = t._start_pos; _end_pos = t._end_pos; }
-		Token(Token&& t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) { swap(*this, t); }
+		Token(Token&& t) noexcept : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) { swap(*this, t); }
 		Token& operator=(Token t) { swap(*this, t); return *this; }
 		bool operator==(const Token& rhs) const { 
 			return _type == rhs._type 
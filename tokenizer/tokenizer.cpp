@@ -1,7 +1,13 @@
 #include "tokenizer/tokenizer.h"
+#include "tokenizer/dfa.hpp"
+#include "profiler/sampler.h"
+#include "profiler/trace.h"
+#include "profiler/allocation.h"
 
-#include <cctype>
-#include <sstream>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 namespace miniplc0 {
 
@@ -14,660 +20,226 @@ namespace miniplc0 {
             return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(0, 0, ErrorCode::ErrEOF));
         auto p = nextToken();
         if (p.second.has_value())
-            return std::make_pair(p.first, p.second);
+            return p;
         auto err = checkToken(p.first.value());
         if (err.has_value())
             return std::make_pair(p.first, err.value());
-        return std::make_pair(p.first, std::optional<CompilationError>());
+        return p;
     }
 
     std::pair<std::vector<Token>, std::optional<CompilationError>> Tokenizer::AllTokens() {
+        SampleScope scope(__func__);
+        TraceScope trace(__func__);
+        AllocationScope allocation(AllocTokenize);
         std::vector<Token> result;
         while (true) {
+            SetSampleLine(_ptr.first);
             auto p = NextToken();
             if (p.second.has_value()) {
                 if (p.second.value().GetCode() == ErrorCode::ErrEOF)
-                    return std::make_pair(result, std::optional<CompilationError>());
+                    return std::make_pair(std::move(result), std::optional<CompilationError>());
                 else
                     return std::make_pair(std::vector<Token>(), p.second);
             }
-            result.emplace_back(p.first.value());
+            result.emplace_back(std::move(p.first.value()));
         }
     }
 
-    // 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
-    std::pair<std::optional<Token>, std::optional<CompilationError>> Tokenizer::nextToken() {
-        // 用于存储已经读到的组成当前token字符
-        std::stringstream ss;
-        // 分析token的结果，作为此函数的返回值
-        std::pair<std::optional<Token>, std::optional<CompilationError>> result;
-        // <行号，列号>，表示当前token的第一个字符在源代码中的位置
-        std::pair<int64_t, int64_t> pos;
-        // 记录当前自动机的状态，进入此函数时是初始状态
-        DFAState current_state = DFAState::INITIAL_STATE;
-        // 这是一个死循环，除非主动跳出
-        // 每一次执行while内的代码，都可能导致状态的变更
-        while (true) {
-            // 读一个字符，请注意auto推导得出的类型是std::optional<char>
-            // 这里其实有两种写法
-            // 1. 每次循环前立即读入一个 char
-            // 2. 只有在可能会转移的状态读入一个 char
-            // 因为我们实现了 unread，为了省事我们选择第一种
-            auto current_char = nextChar();
-            // 针对当前的状态进行不同的操作
-            switch (current_state) {
-
-                // 初始状态
-                // 这个 case 我们给出了核心逻辑，但是后面的 case 不用照搬。
-                case INITIAL_STATE: {
-                    // 已经读到了文件尾
-                    if (!current_char.has_value())
-                        // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(0, 0, ErrEOF));
-
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    // 标记是否读到了不合法的字符，初始化为否
-                    auto invalid = false;
-
-                    // 使用了自己封装的判断字符类型的函数，定义于 tokenizer/utils.hpp
-                    // see https://en.cppreference.com/w/cpp/string/byte/isblank
-                    if (miniplc0::isspace(ch)) // 读到的字符是空白字符（空格、换行、制表符等）
-                        current_state = DFAState::INITIAL_STATE; // 保留当前状态为初始状态，此处直接break也是可以的
-                    else if (!miniplc0::isprint(ch)) // control codes and backspace
-                        invalid = true;
-                    else if (miniplc0::isdigit(ch)){
-                        if(ch=='0'){
-                            current_state = DFAState::ZERO_STATE; // 切换到首字母为0的整数的状态
-                        }
-                        else{
-                            current_state = DFAState::INT_DECIMAL_STATE; // 切换到十进制整数的状态
-                        }
-                    } // 读到的字符是数字
-                    else if (miniplc0::isalpha(ch)) // 读到的字符是英文字母
-                        current_state = DFAState::IDENTIFIER_STATE; // 切换到标识符的状态
-                    else {
-                        switch (ch) {
-
-                            case '=': // 如果读到的字符是`=`，则切换到等于号的状态
-                                current_state = DFAState::ASSIGNMENT_SIGN_STATE;
-                                break;
-                            case '-':
-                                current_state = DFAState::MINUS_SIGN_STATE;
-                                break;
-                                // 请填空：切换到减号的状态
-                            case '+':
-                                // 请填空：切换到加号的状态
-                                current_state = DFAState::PLUS_SIGN_STATE;
-                                break;
-                            case '*':
-                                // 请填空：切换状态
-                                current_state = DFAState::MULTIPLICATION_SIGN_STATE;
-                                break;
-                            case '/':
-                                // 请填空：切换状态
-                                current_state = DFAState::DIVISION_SIGN_STATE;
-                                break;
-                            case ';':
-                                current_state = DFAState::SEMICOLON_STATE;
-                                break;
-                            case ',':
-                                current_state = DFAState::COMMA_STATE;
-                                break;
-                            case '(':
-                                current_state = DFAState::LEFT_BRACKET_STATE;
-                                break;
-                            case ')':
-                                current_state = DFAState::RIGHT_BRACKET_STATE;
-                                break;
-                            case '{':
-                                current_state = DFAState::LEFT_BRACE_STATE;
-                                break;
-                            case '}':
-                                current_state = DFAState::RIGHT_BRACE_STATE;
-                                break;
-                            case '!':
-                                current_state = DFAState::EXCLAMATION_SIGN_STATE;
-                                break;
-                            case '<':
-                                current_state = DFAState::LESS_SIGN_STATE;
-                                break;
-                            case '>':
-                                current_state = DFAState::GREATER_SIGN_STATE;
-                                break;
-
-                                ///// 请填空：
-                                ///// 对于其他的可接受字符
-                                ///// 切换到对应的状态
-
-                                // 不接受的字符导致的不合法的状态
-                            default:
-                                invalid = true;
-                                break;
-                        }
-                    }
-                    // 如果读到的字符导致了状态的转移，说明它是一个token的第一个字符
-                    if (current_state != DFAState::INITIAL_STATE)
-                        pos = previousPos(); // 记录该字符的的位置为token的开始位置
-                    // 读到了不合法的字符
-                    if (invalid) {
-                        // 回退这个字符
-                        unreadLast();
-                        // 返回编译错误：非法的输入
-                        pos=currentPos();
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-                    }
-                    // 如果读到的字符导致了状态的转移，说明它是一个token的第一个字符
-                    if (current_state != DFAState::INITIAL_STATE) // ignore white spaces
-                        ss << ch; // 存储读到的字符
-                    break;
-                }
-
-                //当前状态是以0为首的整数
-                case ZERO_STATE:{
-                    if(!current_char.has_value()){
-                        std::string token_string;
-                        ss>>token_string;
-                        return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    auto ch=current_char.value();
-                    if(miniplc0::isdigit(ch)){
-                        ss<<ch;
-                        current_state=DFAState::INT_DECIMAL_STATE;
-                    }
-                    else if(ch=='x'||ch=='X'){
-                        ss<<ch;
-                        current_state=DFAState::INT_HEXADECIMAL_STATE;
-                    }
-                    else if(miniplc0::isalpha(ch)){
-                        ss<<ch;
-                        current_state=DFAState::IDENTIFIER_STATE;
-                    }
-                    else{
-                        //返回整数'0'
-                        unreadLast();
-                        std::string token_string;
-                        ss>>token_string;
-                        return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    break;
-                }
-
-                //当前状态是十六进制整数
-                case INT_HEXADECIMAL_STATE: {
-                    // 已经读到了文件尾
-                    if (!current_char.has_value()){
-                        std::string token_string,token_string_dec;
-                        int sum=0,len=0,index=0;
-                        ss>>token_string;
-                        token_string_dec=token_string;
-                        auto ct=checkToken(Token(INT_HEXADECIMAL,token_string,pos,currentPos()));//检查十六进制整数是否合法
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);
-                        }
-                        len=token_string.length();
-                        for(index=2;index<len;index++){
-                            if(token_string.at(index)!='0')
-                                break;
-                        }
-                        len=token_string.length()-index;
-                        if(len>8||(len==8&&token_string[index]>'7'))//检查是否溢出:
-                            return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                        len=token_string.length();
-                        for(int i=index;i<len;i++){
-                            sum=sum*16+Hex2Dec(token_string[i]);
-                        }
-                        token_string_dec=std::to_string(sum);
-
-                        return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string_dec,pos,currentPos()), std::optional<CompilationError>());
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (miniplc0::isdigit(ch)) // 读到的字符是数字
-                        ss<<ch;
-                    else if (miniplc0::isalpha(ch)) {
-                        ss<<ch;
-                    }// 读到的字符是英文字母
-                    else{ // 如果读到的字符不是上述情况之一
-                        unreadLast();
-                        std::string token_string,token_string_dec;
-                        int sum=0,len=0,index=0;
-                        ss>>token_string;
-                        token_string_dec=token_string;
-//                        std::cout<<"here,token!"<<token_string<<std::endl;
-
-                        auto ct=checkToken(Token(INT_HEXADECIMAL,token_string,pos,currentPos()));//检查十六进制整数是否合法
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);
-                        }
-                        len=token_string.length();
-                        for(index=2;index<len;index++){
-                            if(token_string.at(index)!='0')
-                                break;
-                        }
-                        len=token_string.length()-index;
-                        if(len>8||(len==8&&token_string[index]>'7'))//检查是否溢出
-                            return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                        len=token_string.length();
-                        for(int i=index;i<len;i++){
-                            sum=sum*16+Hex2Dec(token_string[i]);
-                        }
-                        token_string_dec=std::to_string(sum);
-
-                        return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string_dec,pos,currentPos()), std::optional<CompilationError>());
-                    }
-
-                    break;
-                }
-
-                    // 当前状态是十进制整数
-                case INT_DECIMAL_STATE: {
-                    // 如果当前已经读到了文件尾，则解析已经读到的字符串为整数,解析成功则返回无符号整数类型的token，否则返回编译错误
-                    // 如果读到的字符是数字，则存储读到的字符;如果读到的是字母，则存储读到的字符，并切换状态到标识符
-                    // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串为整数,解析成功则返回无符号整数类型的token，否则返回编译错误
-
-                    // 已经读到了文件尾
-                    if (!current_char.has_value()){
-                        std::string token_string;
-                        ss>>token_string;
-                        unsigned int len=token_string.length();
-                        unsigned int index=0;
-                        int32_t token_integer;
-                        auto ct=checkToken(Token(INT_DECIMAL,token_string,pos,currentPos()));
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);
-                        }
-//                        for(index=0;index<len;index++){
-//                            if(token_string.at(index)!='0')
-//                                break;
-//                        }
-//                        len=len-index;
-                        if(len>10||(len==10&&token_string.at(index)>'2'))//checkToken已经判断了前导为0的情况
-                            return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                        else{
-                            token_integer=atoi(token_string.c_str());
-                            if(token_integer<0)
-                                return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                            else
-                                return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-
-                        return std::make_pair(std::make_optional<Token>(TokenType::INT_DECIMAL,token_string,pos,currentPos()), std::optional<CompilationError>());
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (miniplc0::isdigit(ch)) // 读到的字符是数字
-                        ss<<ch;
-                    else if (miniplc0::isalpha(ch)) {
-                        ss<<ch;
-                        current_state = DFAState::IDENTIFIER_STATE;
-                    }// 读到的字符是英文字母
-                    else{ // 如果读到的字符不是上述情况之一
-                        unreadLast();
-                        std::string token_string;
-                        ss>>token_string;
-                        unsigned int len=token_string.length();
-                        unsigned int index=0;
-                        int32_t token_integer;
-                        auto ct=checkToken(Token(INT_DECIMAL,token_string,pos,currentPos()));
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);
-                        }
-                        if(len>10||(len==10&&token_string.at(index)>'2'))
-                            return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                        else{
-                            token_integer=atoi(token_string.c_str());
-                            if(token_integer<0)
-                                return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrIntegerOverflow));
-                            else
-                                return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                    }
-
-                    break;
-                }
-                case IDENTIFIER_STATE: {
-                    // 请填空：
-                    // 如果当前已经读到了文件尾，则解析已经读到的字符串
-                    //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-                    // 如果读到的是字符或字母，则存储读到的字符
-                    // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串
-                    //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-
-                    // 已经读到了文件尾
-                    if (!current_char.has_value()){
-                        std::string token_string;
-                        ss>>token_string;
+    // 每块至少这么多字节才值得单独交给一个线程
+    static const std::size_t MIN_CHUNK_SIZE = 64 * 1024;
 
-                        auto ct=checkToken(Token(IDENTIFIER,token_string,pos,currentPos()));
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);
-                        }
-
-                        if(token_string=="const"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CONST,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="void"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::VOID,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="int"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::INT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="char"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CHAR,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="double"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DOUBLE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="struct"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::STRUCT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="if"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::IF,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="else"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::ELSE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="switch"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::SWITCH,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="case"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CASE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="default"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DEFAULT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="while"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::WHILE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="for"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::FOR,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="do"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DO,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="return"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::RETURN,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="break"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::BREAK,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="continue"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CONTINUE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="print"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::PRINT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="scan"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::SCAN,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else{
-                            return std::make_pair(std::make_optional<Token>(TokenType::IDENTIFIER,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (miniplc0::isdigit(ch)) // 读到的字符是数字
-                        ss<<ch;
-                    else if (miniplc0::isalpha(ch)) {
-                        ss<<ch;
-                    }// 读到的字符是英文字母
-
-                    else{ // 如果读到的字符不是上述情况之一
-                        unreadLast();
-                        std::string token_string;
-                        ss>>token_string;
-
-                        auto ct=checkToken(Token(IDENTIFIER,token_string,pos,currentPos()));
-                        if(ct.has_value()){
-                            return std::make_pair(std::optional<Token>(), ct);;
-                        }
-                        if(token_string=="const"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CONST,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="void"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::VOID,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="int"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::INT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="char"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CHAR,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="double"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DOUBLE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="struct"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::STRUCT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="if"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::IF,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="else"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::ELSE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="switch"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::SWITCH,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="case"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CASE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="default"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DEFAULT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="while"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::WHILE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="for"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::FOR,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="do"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::DO,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="return"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::RETURN,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="break"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::BREAK,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="continue"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::CONTINUE,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="print"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::PRINT,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else if(token_string=="scan"){
-                            return std::make_pair(std::make_optional<Token>(TokenType::SCAN,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                        else{
-                            return std::make_pair(std::make_optional<Token>(TokenType::IDENTIFIER,token_string,pos,currentPos()), std::optional<CompilationError>());
-                        }
-                    }
+    std::pair<std::vector<Token>, std::optional<CompilationError>> Tokenizer::AllTokensParallel(unsigned int threads) {
+        SampleScope scope(__func__);
+        TraceScope trace(__func__);
+        AllocationScope allocation(AllocTokenize);
+        if (!_initialized)
+            readAll();
+        if (_rdr.bad())
+            return std::make_pair(std::vector<Token>(), std::make_optional<CompilationError>(0, 0, ErrorCode::ErrStreamError));
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // offset[i] 为第 i 行行首在源代码中的字节偏移
+        std::vector<std::size_t> offset(_end + 1, 0);
+        for (uint64_t i = _ptr.first; i < _end; i++)
+            offset[i + 1] = offset[i] + (*_lines)[i].size();
+        std::size_t total = offset[_end];
+        std::size_t chunks = std::min<std::size_t>(threads, total / MIN_CHUNK_SIZE);
+        if (chunks <= 1 || _ptr.second != 0)
+            return AllTokens();
+
+        // 每块大约 total / chunks 个字节，在目标位置之后的第一个安全行首切开
+        std::vector<uint64_t> bounds = { _ptr.first };
+        for (auto line : safeBoundaries()) {
+            if (bounds.size() == chunks)
+                break;
+            if (offset[line] >= total / chunks * bounds.size())
+                bounds.push_back(line);
+        }
+        bounds.push_back(_end);
+        chunks = bounds.size() - 1;
+
+        std::vector<std::pair<std::vector<Token>, std::optional<CompilationError>>> results(chunks);
+        std::atomic<std::size_t> next(0);
+        auto stack = CurrentSampleStack();
+        auto worker = [this, chunks, &bounds, &results, &next, &stack]() {
+            SampleScope inherited(stack);
+            for (std::size_t i = next++; i < chunks; i = next++) {
+                Tokenizer tkz(this, bounds[i], bounds[i + 1]);
+                results[i] = tkz.AllTokens();
+            }
+        };
+        std::vector<std::thread> pool;
+        for (std::size_t i = 1; i < chunks; i++)
+            pool.emplace_back(worker);
+        worker();
+        for (auto& t : pool)
+            t.join();
+        _ptr = std::make_pair(_end, 0);
+
+        // 串行分析在第一个错误处停止，因此按顺序返回第一块出错的结果
+        std::size_t count = 0;
+        for (auto& r : results) {
+            if (r.second.has_value())
+                return std::make_pair(std::vector<Token>(), r.second);
+            count += r.first.size();
+        }
+        std::vector<Token> result;
+        result.reserve(count);
+        for (auto& r : results)
+            std::move(r.first.begin(), r.first.end(), std::back_inserter(result));
+        return std::make_pair(std::move(result), std::optional<CompilationError>());
+    }
 
-                    break;
-                }
+    // 用 nextToken 的转移表扫描：状态机停下时，当前字符从初始状态重新读一遍，初始状态也不接受的字符直接跳过
+    // 行注释和其他 token 都在行尾的 \n 处结束，所以只要行尾回到了初始状态（不在块注释中），下一行行首就是安全的
+    std::vector<std::uint64_t> Tokenizer::safeBoundaries() const {
+        std::uint8_t state = INITIAL_STATE;
+        std::vector<uint64_t> result;
+        for (uint64_t i = _ptr.first; i < _end; i++) {
+            if (i != _ptr.first && state == INITIAL_STATE)
+                result.push_back(i);
+            for (unsigned char ch : (*_lines)[i]) {
+                auto next = DFA_TRANSITIONS[state][ch];
+                if (next == DFA_STOP)
+                    next = DFA_TRANSITIONS[INITIAL_STATE][ch];
+                state = next == DFA_STOP ? static_cast<std::uint8_t>(INITIAL_STATE) : next;
+            }
+        }
+        return result;
+    }
 
-                    // 如果当前状态是加号
-                case PLUS_SIGN_STATE: {
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::PLUS_SIGN, '+', pos, currentPos()), std::optional<CompilationError>());
-                }
-                    // 当前状态为减号的状态
-                case MINUS_SIGN_STATE: {
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::MINUS_SIGN,'-',pos,currentPos()),std::optional<CompilationError>());
+    // 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
+    std::pair<std::optional<Token>, std::optional<CompilationError>> Tokenizer::nextToken() {
+        // <行号，列号>，表示当前token的第一个字符在源代码中的位置，在初始状态下随着跳过的空白字符前进
+        auto pos = _ptr;
+        std::uint8_t state = INITIAL_STATE;
+        for (; _ptr.first < _end; _ptr = std::make_pair(_ptr.first + 1, 0)) {
+            auto& line = (*_lines)[_ptr.first];
+            auto chars = reinterpret_cast<const unsigned char*>(line.data());
+            for (auto column = _ptr.second; column < line.size(); column++) {
+                if (state == INITIAL_STATE)
+                    pos = std::make_pair(_ptr.first, column);
+                auto next = DFA_TRANSITIONS[state][chars[column]];
+                // 这个字符不属于当前 token，指针停在它上面
+                if (next == DFA_STOP) {
+                    _ptr.second = column;
+                    return accept(state, pos);
                 }
+                state = next;
+            }
+        }
+        return accept(state, pos);
+    }
 
-                    // 请填空：
-                    // 对于其他的合法状态，进行合适的操作
-                    // 比如进行解析、返回token、返回编译错误
-                case DIVISION_SIGN_STATE:{
-//                    unreadLast();
-//                    return std::make_pair(std::make_optional<Token>(TokenType::DIVISION_SIGN,'/',pos,currentPos()),std::optional<CompilationError>());
-                    if (!current_char.has_value()){
-                        return std::make_pair(std::make_optional<Token>(TokenType::DIVISION_SIGN,'/',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    auto ch = current_char.value();
-                    if(ch=='/'){
-
-                        ss.str("");
+    // 关键字，其余的都是标识符
+    static const std::pair<const char*, TokenType> KEYWORDS[] = {
+        { "const", CONST }, { "void", VOID }, { "int", INT }, { "char", CHAR }, { "double", DOUBLE },
+        { "struct", STRUCT }, { "if", IF }, { "else", ELSE }, { "switch", SWITCH }, { "case", CASE },
+        { "default", DEFAULT }, { "while", WHILE }, { "for", FOR }, { "do", DO }, { "return", RETURN },
+        { "break", BREAK }, { "continue", CONTINUE }, { "print", PRINT }, { "scan", SCAN },
+    };
+
+    std::pair<std::optional<Token>, std::optional<CompilationError>> Tokenizer::accept(std::uint8_t state, std::pair<uint64_t, uint64_t> pos) {
+        auto error = [](std::pair<uint64_t, uint64_t> p, ErrorCode code) {
+            return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(p, code));
+        };
+        auto& action = DFA_ACTIONS[state];
+        switch (action._action) {
+            case DFA_END:
+                // 已经读到了文件尾，返回一个空的token，和编译错误ErrEOF：遇到了文件尾
+                if (isEOF())
+                    return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(0, 0, ErrEOF));
+                // 不接受的字符，指针停在它上面
+                return error(currentPos(), ErrorCode::ErrInvalidInput);
+            case DFA_UNMATCHED_ANNOTATION:
+                return error(pos, ErrorCode::ErrAnnotationUnmatched);
+            case DFA_INVALID_OPERATOR:
+                // 读到'!'时已经到文件结尾
+                return error(pos, isEOF() ? ErrorCode::ErrEOF : ErrorCode::ErrInvalidOperator);
+            default:
+                break;
+        }
 
-                        current_state=DFAState::ANNOTATION_1_STATE;
-                        break;
-                    }
-                    else if(ch=='*'){
-                        ss.str("");
-                        current_state=DFAState::ANNOTATION_2_STATE;
+        // token 不会跨行，只有文件尾没有 \n 时才会停在下一行
+        auto& line = (*_lines)[pos.first];
+        auto end = _ptr.first == pos.first ? _ptr.second : line.size();
+        auto token_string = line.substr(pos.second, end - pos.second);
+        switch (action._action) {
+            case DFA_IDENTIFIER: {
+                auto type = IDENTIFIER;
+                for (auto& keyword : KEYWORDS)
+                    if (token_string == keyword.first) {
+                        type = keyword.second;
                         break;
                     }
-                    else{
-                        unreadLast();
-                        return std::make_pair(std::make_optional<Token>(TokenType::DIVISION_SIGN,'/',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                }
-                case ANNOTATION_1_STATE:{//  //
-                    if(!current_char.has_value()){
-                        current_state=DFAState ::INITIAL_STATE;
-                        break;
-                    }
-                    auto ch=current_char.value();
-                    if(ch==10||ch==13){
-                        unreadLast();
-                        current_state=DFAState ::INITIAL_STATE;
-                    }
-                    break;
-                }
-                case ANNOTATION_2_STATE:{//  /*
-                    if(!current_char.has_value()){
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrAnnotationUnmatched));
-                    }
-                    auto ch=current_char.value();
-                    if(ch=='*'){
-                        current_state=DFAState ::ANNOTATION_3_STATE;
-                    }
-                    break;
-                }
-                case ANNOTATION_3_STATE:{//  /*...*
-                    if(!current_char.has_value()){
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrAnnotationUnmatched));
-                    }
-                    auto ch=current_char.value();
-                    if(ch=='/'){
-                        current_state=DFAState ::INITIAL_STATE;
-                    }
-                    else{
-                        current_state=DFAState::ANNOTATION_2_STATE;
-                    }
-                    break;
-                }
-
-                case MULTIPLICATION_SIGN_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::MULTIPLICATION_SIGN,'*',pos,currentPos()),std::optional<CompilationError>());
-                }
-
-                case ASSIGNMENT_SIGN_STATE:{
-                    if (!current_char.has_value()){
-                        return std::make_pair(std::make_optional<Token>(TokenType::ASSIGNMENT_SIGN,'=',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    auto ch = current_char.value();
-                    if(ch=='='){
-                        std::string string_token;
-                        ss<<ch;
-                        ss>>string_token;
-                        return std::make_pair(std::make_optional<Token>(TokenType::EQUAL_SIGN,string_token,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    else{
-                        unreadLast();
-                        return std::make_pair(std::make_optional<Token>(TokenType::ASSIGNMENT_SIGN,'=',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                }
-
-                case SEMICOLON_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::SEMICOLON,';',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case COMMA_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::COMMA,',',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case LEFT_BRACKET_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::LEFT_BRACKET,'(',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case RIGHT_BRACKET_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::RIGHT_BRACKET,')',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case LEFT_BRACE_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::LEFT_BRACE,'{',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case RIGHT_BRACE_STATE:{
-                    unreadLast();
-                    return std::make_pair(std::make_optional<Token>(TokenType::RIGHT_BRACE,'}',pos,currentPos()),std::optional<CompilationError>());
-                }
-                case LESS_SIGN_STATE:{
-                    if (!current_char.has_value()){
-                        return std::make_pair(std::make_optional<Token>(TokenType::LESS_SIGN,'<',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    auto ch = current_char.value();
-                    if(ch=='='){
-                        std::string string_token;
-                        ss<<ch;
-                        ss>>string_token;
-                        return std::make_pair(std::make_optional<Token>(TokenType::LESS_EQUAL_SIGN,string_token,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    else{
-                        unreadLast();
-                        return std::make_pair(std::make_optional<Token>(TokenType::LESS_SIGN,'<',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                }
-                case GREATER_SIGN_STATE:{
-                    if (!current_char.has_value()){
-                        return std::make_pair(std::make_optional<Token>(TokenType::GREATER_SIGN,'>',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    auto ch = current_char.value();
-                    if(ch=='='){
-                        std::string string_token;
-                        ss<<ch;
-                        ss>>string_token;
-                        return std::make_pair(std::make_optional<Token>(TokenType::GREATER_EQUAL_SIGN,string_token,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    else{
-                        unreadLast();
-                        return std::make_pair(std::make_optional<Token>(TokenType::GREATER_SIGN,'>',pos,currentPos()),std::optional<CompilationError>());
-                    }
-                }
-                case EXCLAMATION_SIGN_STATE:{
-                    if (!current_char.has_value()){
-                        //读到'!'时已经到文件结尾
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrEOF));
-                    }
-                    auto ch = current_char.value();
-                    if(ch=='='){
-                        std::string string_token;
-                        ss<<ch;
-                        ss>>string_token;
-                        return std::make_pair(std::make_optional<Token>(TokenType::NOT_EQUAL_SIGN,string_token,pos,currentPos()),std::optional<CompilationError>());
-                    }
-                    else{
-                        unreadLast();
-                        return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos,ErrorCode::ErrInvalidOperator));
-                    }
-                }
-
-                    // 预料之外的状态，如果执行到了这里，说明程序异常
-                default:
-                    DieAndPrint("unhandled state.");
-                    break;
+                Token token(type, std::move(token_string), pos, currentPos());
+                // 关键字不会以数字开头，checkToken 只检查标识符
+                auto ct = checkToken(token);
+                if (ct.has_value())
+                    return std::make_pair(std::optional<Token>(), ct);
+                return std::make_pair(std::make_optional<Token>(std::move(token)), std::optional<CompilationError>());
+            }
+            case DFA_DECIMAL: {
+                auto ct = checkToken(Token(INT_DECIMAL, token_string, pos, currentPos()));
+                if (ct.has_value())
+                    return std::make_pair(std::optional<Token>(), ct);
+                //checkToken已经判断了前导为0的情况
+                auto len = token_string.length();
+                if (len > 10 || (len == 10 && token_string[0] > '2') || atoi(token_string.c_str()) < 0)
+                    return error(pos, ErrorCode::ErrIntegerOverflow);
+                return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL, token_string, pos, currentPos()), std::optional<CompilationError>());
+            }
+            case DFA_HEXADECIMAL: {
+                auto ct = checkToken(Token(INT_HEXADECIMAL, token_string, pos, currentPos()));//检查十六进制整数是否合法
+                if (ct.has_value())
+                    return std::make_pair(std::optional<Token>(), ct);
+                std::size_t index = 2;
+                while (index < token_string.length() && token_string[index] == '0')
+                    index++;
+                auto len = token_string.length() - index;
+                if (len > 8 || (len == 8 && token_string[index] > '7'))//检查是否溢出
+                    return error(pos, ErrorCode::ErrIntegerOverflow);
+                int sum = 0;
+                for (auto i = index; i < token_string.length(); i++)
+                    sum = sum * 16 + Hex2Dec(token_string[i]);
+                return std::make_pair(std::make_optional<Token>(TokenType::INT_LITERAL, std::to_string(sum), pos, currentPos()), std::optional<CompilationError>());
             }
+            case DFA_OPERATOR:
+                if (token_string.length() == 1)
+                    return std::make_pair(std::make_optional<Token>(action._type, token_string[0], pos, currentPos()), std::optional<CompilationError>());
+                return std::make_pair(std::make_optional<Token>(action._type, token_string, pos, currentPos()), std::optional<CompilationError>());
+            default:
+                // 预料之外的状态，如果执行到了这里，说明程序异常
+                DieAndPrint("unhandled state.");
+                return std::make_pair(std::optional<Token>(), std::optional<CompilationError>());
         }
-        // 预料之外的状态，如果执行到了这里，说明程序异常
-        return std::make_pair(std::optional<Token>(), std::optional<CompilationError>());
     }
 
     std::optional<CompilationError> Tokenizer::checkToken(const Token& t) {
+        // 只有下面三种 token 需要检查，其余的不必取值（值为 char 的 token 取值时要先抛出一次 bad_any_cast）
+        if (t.GetType() != IDENTIFIER && t.GetType() != INT_DECIMAL && t.GetType() != INT_HEXADECIMAL)
+            return {};
         auto val = t.GetValueString();
 //        std::cout<<"here,error!val=="<<val<<std::endl;
         switch (t.GetType()) {
@@ -712,44 +284,20 @@ namespace miniplc0 {
     void Tokenizer::readAll() {
         if (_initialized)
             return;
+        SampleScope scope(__func__);
+        TraceScope trace(__func__);
         for (std::string tp; std::getline(_rdr, tp);)
             _lines_buffer.emplace_back(std::move(tp + "\n"));
         _initialized = true;
+        _end = _lines_buffer.size();
         _ptr = std::make_pair<int64_t, int64_t>(0, 0);
         return;
     }
 
-    // Note: We allow this function to return a postion which is out of bound according to the design like std::vector::end().
-    std::pair<uint64_t, uint64_t> Tokenizer::nextPos() {
-        if (_ptr.first >= _lines_buffer.size())
-            DieAndPrint("advance after EOF");
-        if (_ptr.second == _lines_buffer[_ptr.first].size() - 1)
-            return std::make_pair(_ptr.first + 1, 0);
-        else
-            return std::make_pair(_ptr.first, _ptr.second + 1);
-    }
-
     std::pair<uint64_t, uint64_t> Tokenizer::currentPos() {
         return _ptr;
     }
 
-    std::pair<uint64_t, uint64_t> Tokenizer::previousPos() {
-        if (_ptr.first == 0 && _ptr.second == 0)
-            DieAndPrint("previous position from beginning");
-        if (_ptr.second == 0)
-            return std::make_pair(_ptr.first - 1, _lines_buffer[_ptr.first - 1].size() - 1);
-        else
-            return std::make_pair(_ptr.first, _ptr.second - 1);
-    }
-
-    std::optional<char> Tokenizer::nextChar() {
-        if (isEOF())
-            return {}; // EOF
-        auto result = _lines_buffer[_ptr.first][_ptr.second];
-        _ptr = nextPos();
-        return result;
-    }
-
     int Tokenizer::Hex2Dec(char ch){
         int ans=0;
         if(ch>='0'&&ch<='9'){
@@ -765,11 +313,6 @@ namespace miniplc0 {
     }
 
     bool Tokenizer::isEOF() {
-        return _ptr.first >= _lines_buffer.size();
-    }
-
-    // Note: Is it evil to unread a buffer?
-    void Tokenizer::unreadLast() {
-        _ptr = previousPos();
+        return _ptr.first >= _end;
     }
-}
+}
\ No newline at end of file
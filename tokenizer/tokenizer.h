@@ -17,43 +17,9 @@ namespace miniplc0 {
 	class Tokenizer final {
 	private:
 		using uint64_t = std::uint64_t;
-
-		// 状态机的所有状态
-		enum DFAState {
-			INITIAL_STATE,
-            IDENTIFIER_STATE,
-            INT_DECIMAL_STATE,
-            INT_HEXADECIMAL_STATE,
-            ZERO_STATE,
-
-
-			PLUS_SIGN_STATE,
-			MINUS_SIGN_STATE,
-			DIVISION_SIGN_STATE,
-			MULTIPLICATION_SIGN_STATE,
-			ASSIGNMENT_SIGN_STATE,      //'='
-            LESS_SIGN_STATE,
-//            LESS_EQUAL_SIGN_STATE,
-            GREATER_SIGN_STATE,
-//            GREATER_EQUAL_STATE,
-//            NOT_EQUAL_SIGN_STATE,
-//            EQUAL_SIGN_STATE,           //'=='
-
-			SEMICOLON_STATE,
-			COMMA_STATE,
-			LEFT_BRACKET_STATE,
-			RIGHT_BRACKET_STATE,
-            EXCLAMATION_SIGN_STATE,   //'!'
-            LEFT_BRACE_STATE,         //'{'
-            RIGHT_BRACE_STATE,           //'}'
-
-            ANNOTATION_1_STATE,
-            ANNOTATION_2_STATE,
-            ANNOTATION_3_STATE,
-		};
 	public:
 		Tokenizer(std::istream& ifs)
-			: _rdr(ifs), _initialized(false), _ptr(0, 0),_lines_buffer() {}
+			: _rdr(ifs), _initialized(false), _ptr(0, 0),_lines_buffer(), _lines(&_lines_buffer), _end(0) {}
 		Tokenizer(Tokenizer&& tkz) = delete;
 		Tokenizer(const Tokenizer&) = delete;
 		Tokenizer& operator=(const Tokenizer&) = delete;
@@ -62,14 +28,24 @@ namespace miniplc0 {
 		std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
 		// 一次返回所有 token
 		std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
+		// 并行版本的 AllTokens，结果（包括出错时的错误）与 AllTokens 完全相同
+		// 在不处于 /* */ 注释中的行首把源代码切成若干块，每块由一个线程分析，最后按顺序拼接
+		// threads 为 0 表示使用硬件线程数，源代码太短时直接串行分析
+		std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokensParallel(unsigned int threads);
 	private:
+		// 分析 parent 的缓冲区中 [begin, end) 行的子分析器，位置仍然是在整个源代码中的行号和列号
+		Tokenizer(const Tokenizer* parent, uint64_t begin, uint64_t end)
+			: _rdr(parent->_rdr), _initialized(true), _ptr(begin, 0), _lines_buffer(), _lines(parent->_lines), _end(end) {}
+		// 预扫描，返回可以安全切分的行号（不含 0），即上一行结束时不在 /* */ 注释中的行
+		// 和 nextToken 使用同一张转移表，所以注释的识别方式完全一致
+		std::vector<uint64_t> safeBoundaries() const;
 		// 检查 Token 的合法性
 		std::optional<CompilationError> checkToken(const Token&);
-		// 
-		// ** 你需要完成这个函数 **
-		//
 		// 返回下一个 token，是 NextToken 实际实现部分
+		// 按 tokenizer/dfa.hpp 中生成的转移表逐字节转移，停下时执行当前状态的接受动作
 		std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
+		// 状态机在 state 停下时的接受动作，token 从 pos 开始，到 _ptr 之前结束
+		std::pair<std::optional<Token>, std::optional<CompilationError>> accept(std::uint8_t state, std::pair<uint64_t, uint64_t> pos);
 
 		// 从这里开始其实是一个基于行号的缓冲区的实现
 		// 为了简单起见，我们没有单独拿出一个类实现
@@ -86,18 +62,11 @@ namespace miniplc0 {
 		//        | = | = | = | = | = | = | = | = | = | = | =  |
 		// 缓冲区 | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | 7 | \n |（第0行）
 		//        | 1 | 1 | 4 | 5 | 1 | 4 |                     （第1行）
-		// 这里假设指针指向第一行的 \n，那么有
-		// nextPos() = (1, 0)
-		// currentPos() = (0, 9)
-		// previousPos() = (0, 8)
-		// nextChar() = '\n' 并且指针移动到 (1, 0)
-		// unreadLast() 指针移动到 (0, 8)
-		std::pair<uint64_t, uint64_t> nextPos();
+		// 这里假设指针指向第一行的 \n，那么 currentPos() = (0, 9)，读入 \n 之后指针移动到 (1, 0)
+		// nextToken 直接在当前行的 string 上转移，一行读完才移动到下一行
+		// 每行都以 \n 结尾，而 \n 不属于任何 token，所以除了块注释，没有东西会跨行
 		std::pair<uint64_t, uint64_t> currentPos();
-		std::pair<uint64_t, uint64_t> previousPos();
-		std::optional<char> nextChar();
 		bool isEOF();
-		void unreadLast();
 		int Hex2Dec(char ch);
 	private:
 		std::istream& _rdr;
@@ -107,5 +76,8 @@ namespace miniplc0 {
 		std::pair<uint64_t, uint64_t> _ptr;
 		// 以行为基础的缓冲区
 		std::vector<std::string> _lines_buffer;
+		// 实际读取的缓冲区和行数上限，子分析器指向父分析器的缓冲区
+		const std::vector<std::string>* _lines;
+		uint64_t _end;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "verifier/verifier.h"
+#include "optimizer/optimizer.h"
+#include "instruction/opcode.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace miniplc0 {
+
+	// slot 的类型
+	const char INT_SLOT = 'i';
+	const char ADDRESS_SLOT = 'a';
+
+	// 校验一段代码
+	// function 为函数下标，.start 为 -1；returns 为 1 表示只能 iret，0 表示只能 ret，-1 表示不能返回
+	// globals 为全局变量占用的 slot 数，end 返回执行到代码末尾时的栈高度（.start 才允许执行到末尾）
+	// mark 不为 -1 时，marked 返回执行到第 mark 条指令之前的栈（不可达时为空）
+	static std::optional<VerificationError> verifyCode(int32_t function, const std::vector<Instruction>& ins,
+			const std::vector<functionsTable>& fun, int32_t params, int32_t level, const frameInfo& frame,
+			int32_t globals, int32_t returns, int32_t& end, int32_t mark, std::optional<std::vector<char>>& marked) {
+		int32_t n = ins.size();
+		int32_t limit = frame.isKnown() ? frame._locals + frame._max_stack : INT_MAX;
+		if (frame.isKnown() && frame._locals < params)
+			return VerificationError(function, 0, ErrInvalidFunction);
+
+		// 跳转目标就是合流点，只在这里记录栈的状态
+		std::vector<bool> isTarget(n + 1, false);
+		for (int32_t pc = 0; pc < n; pc++) {
+			// 跳转表必须完整地在函数内，并且全部是 jmp，每一项都是合流点
+			if (ins[pc].GetOperation() == TABLESWITCH) {
+				int32_t cases = ins[pc].GetY();
+				if (cases < 0 || pc + 1 + cases >= n)
+					return VerificationError(function, pc, ErrJumpOutOfRange);
+				for (int32_t k = 0; k <= cases; k++) {
+					if (ins[pc + 1 + k].GetOperation() != JMP)
+						return VerificationError(function, pc, ErrInvalidSwitchTable);
+					isTarget[pc + 1 + k] = true;
+				}
+			}
+			if (!isJump(ins[pc].GetOperation()))
+				continue;
+			int32_t target = ins[pc].GetX();
+			if (target < 0 || target > n || (function != -1 && target == n))
+				return VerificationError(function, pc, ErrJumpOutOfRange);
+			isTarget[target] = true;
+		}
+		if (mark >= 0 && mark <= n)
+			isTarget[mark] = true;
+		std::vector<std::optional<std::vector<char>>> states(n + 1);
+
+		int32_t maxOffset = -1, maxOffsetPc = 0;
+		end = -1;
+		std::vector<std::pair<int32_t, std::vector<char>>> work;
+		work.emplace_back(0, std::vector<char>(params, INT_SLOT));
+		while (!work.empty()) {
+			int32_t pc = work.back().first;
+			auto stack = std::move(work.back().second);
+			work.pop_back();
+			while (true) {
+				if (isTarget[pc]) {
+					if (states[pc].has_value()) {
+						if (states[pc].value() != stack)
+							return VerificationError(function, pc, ErrStackMismatch);
+						break;
+					}
+					states[pc] = stack;
+				}
+				if (pc == n) {
+					if (function != -1)
+						return VerificationError(function, n - 1, ErrFallOffEnd);
+					if (end != -1 && end != (int32_t)stack.size())
+						return VerificationError(function, n, ErrStackMismatch);
+					end = stack.size();
+					break;
+				}
+
+				auto& it = ins[pc];
+				int32_t x = it.GetX();
+				int32_t size = stack.size();
+				auto underflow = VerificationError(function, pc, ErrStackUnderflow);
+				auto& info = opcodeOf(it.GetOperation());
+				if (!info._supported)
+					return VerificationError(function, pc, ErrUnsupportedInstruction);
+				// 需要检查操作数或者 slot 类型的指令单独处理，其余的按 OPCODES 中的 pop/push 处理
+				switch (it.GetOperation()) {
+					case POPN:
+						if (x < 0 || size < x)
+							return underflow;
+						stack.resize(size - x);
+						break;
+					case DUP:
+						if (size < 1)
+							return underflow;
+						stack.push_back(stack[size - 1]);
+						break;
+					case DUP2:
+						if (size < 2)
+							return underflow;
+						stack.push_back(stack[size - 2]);
+						stack.push_back(stack[size - 1]);
+						break;
+					case LOADA: {
+						int32_t offset = it.GetY();
+						if (x < 0 || x > level)
+							return VerificationError(function, pc, ErrInvalidLevel);
+						// 只有 0 和 1 两层：本栈帧和 .start 的全局变量
+						if (offset < 0 || (x == 1 && offset >= globals))
+							return VerificationError(function, pc, ErrInvalidAddress);
+						if (x == 0 && offset > maxOffset) {
+							maxOffset = offset;
+							maxOffsetPc = pc;
+						}
+						stack.push_back(ADDRESS_SLOT);
+						break;
+					}
+					case SNEW:
+						if (x < 0)
+							return underflow;
+						stack.resize(size + x, INT_SLOT);
+						break;
+					case ILOAD:
+						if (size < 1)
+							return underflow;
+						if (stack[size - 1] != ADDRESS_SLOT)
+							return VerificationError(function, pc, ErrNotAddress);
+						stack[size - 1] = INT_SLOT;
+						break;
+					case ISTORE:
+						if (size < 2)
+							return underflow;
+						if (stack[size - 2] != ADDRESS_SLOT)
+							return VerificationError(function, pc, ErrNotAddress);
+						stack.resize(size - 2);
+						break;
+					case TABLESWITCH:
+						if (size < 1)
+							return underflow;
+						stack.resize(size - 1);
+						for (int32_t k = 1; k <= it.GetY(); k++)
+							work.emplace_back(pc + 1 + k, stack);
+						break;
+					case CALL: {
+						if (x < 0 || x >= (int32_t)fun.size() || (fun[x]._haveReturnValue != 0 && fun[x]._haveReturnValue != 1))
+							return VerificationError(function, pc, ErrInvalidCall);
+						if (size < fun[x]._params_size)
+							return underflow;
+						stack.resize(size - fun[x]._params_size);
+						if (fun[x]._haveReturnValue == 1)
+							stack.push_back(INT_SLOT);
+						break;
+					}
+					default:
+						if ((it.GetOperation() == RET && returns != 0) || (it.GetOperation() == IRET && returns != 1))
+							return VerificationError(function, pc, ErrInvalidReturn);
+						if (size < info._pop)
+							return underflow;
+						stack.resize(size - info._pop);
+						stack.resize(size - info._pop + info._push, INT_SLOT);
+						if (info._branch)
+							work.emplace_back(x, stack);
+						break;
+				}
+				if ((int32_t)stack.size() > limit)
+					return VerificationError(function, pc, ErrStackOverflow);
+				if (info._terminator)
+					break;
+				pc++;
+			}
+		}
+		// loada 0 的偏移必须落在栈帧内，虚拟机只为栈帧分配这么多空间
+		if (maxOffset >= 0 && frame.isKnown() && maxOffset >= limit)
+			return VerificationError(function, maxOffsetPc, ErrInvalidAddress);
+		if (mark >= 0 && mark <= n)
+			marked = states[mark];
+		return {};
+	}
+
+	std::optional<VerificationError> Verify(const std::vector<functionsTable>& fun, const std::vector<Instruction>& start,
+			const frameInfo& startFrame, const std::vector<functionBodyTable>& bodies, const globalData& data) {
+		if (bodies.size() != fun.size())
+			return VerificationError(-1, 0, ErrInvalidFunction);
+
+		int32_t globals;
+		std::optional<std::vector<char>> marked;
+		auto err = verifyCode(-1, start, fun, 0, 0, startFrame, 0, -1, globals, data._resume, marked);
+		if (err.has_value())
+			return err;
+		if (data.isKnown() && (!marked.has_value() || marked.value() != std::vector<char>(data._values.size(), INT_SLOT)))
+			return VerificationError(-1, data._resume, ErrInvalidData);
+		globals = std::max(globals, 0);
+		if (startFrame.isKnown() && startFrame._locals != globals)
+			return VerificationError(-1, start.size(), ErrInvalidFunction);
+
+		for (std::size_t i = 0; i < fun.size(); i++) {
+			if (fun[i]._level != 1)
+				return VerificationError(i, 0, ErrInvalidLevel);
+			if (fun[i]._haveReturnValue != 0 && fun[i]._haveReturnValue != 1)
+				return VerificationError(i, 0, ErrInvalidFunction);
+			int32_t end;
+			err = verifyCode(i, bodies[i]._funins, fun, fun[i]._params_size, fun[i]._level, bodies[i]._frame,
+				globals, fun[i]._haveReturnValue, end, -1, marked);
+			if (err.has_value())
+				return err;
+		}
+		return {};
+	}
+}
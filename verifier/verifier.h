@@ -0,0 +1,57 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "systable/systable.h"
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+namespace miniplc0 {
+
+	enum VerifyErrorCode {
+		ErrInvalidFunction,         // 函数表、函数体和栈帧信息不一致
+		ErrUnsupportedInstruction,
+		ErrJumpOutOfRange,
+		ErrInvalidCall,
+		ErrInvalidLevel,            // loada 的层级差超出了静态链
+		ErrInvalidAddress,          // loada 的偏移超出了栈帧
+		ErrStackUnderflow,
+		ErrStackOverflow,           // 超过了栈帧信息中声明的大小
+		ErrStackMismatch,           // 合流点的栈高度或 slot 类型不一致
+		ErrNotAddress,              // iload/istore 使用的不是 loada 得到的地址
+		ErrInvalidReturn,           // 返回指令和函数是否有返回值不符
+		ErrFallOffEnd,              // 函数末尾没有返回
+		ErrInvalidData,             // 预先算好的全局变量和执行 .start 得到的栈不一致
+		ErrInvalidSwitchTable       // tableswitch 后面的跳转表中有不是 jmp 的指令
+	};
+
+	class VerificationError final {
+	private:
+		using int32_t = std::int32_t;
+	public:
+		VerificationError(int32_t function, int32_t offset, VerifyErrorCode err) : _function(function), _offset(offset), _err(err) {}
+
+		// 出错的函数下标，.start 为 -1
+		int32_t GetFunction() const { return _function; }
+		// 出错的指令下标
+		int32_t GetOffset() const { return _offset; }
+		VerifyErrorCode GetCode() const { return _err; }
+	private:
+		int32_t _function;
+		int32_t _offset;
+		VerifyErrorCode _err;
+	};
+
+	// 字节码校验
+	// 在加载时一次性证明：
+	// 1.跳转目标和跳转表都在函数内，call 的函数都存在，loada 的层级差合法且偏移在栈帧内
+	// 2.每条指令执行前的栈高度和 slot 类型（整数/地址）与路径无关，并且不会下溢
+	// 3.iload/istore 的地址都来自 loada，返回指令与函数的返回值一致，函数不会从末尾掉出去
+	// 4.如果带有栈帧信息，栈高度不超过声明的大小
+	// 5.如果有预先算好的全局变量，执行到 .start 的第 _resume 条指令时栈上恰好是这么多整数
+	// 通过校验且带有栈帧信息的程序，虚拟机可以不做任何运行时检查
+	// 全局变量的值本身不影响安全性，因此不检查
+	std::optional<VerificationError> Verify(const std::vector<functionsTable>& fun, const std::vector<Instruction>& start,
+		const frameInfo& startFrame, const std::vector<functionBodyTable>& bodies, const globalData& data = globalData());
+}
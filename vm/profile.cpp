@@ -0,0 +1,49 @@
+#include "vm/profile.h"
+
+namespace miniplc0 {
+
+	ExecutionProfile::ExecutionProfile() : _opcodes(), _functions(), _active(), _depth() {}
+
+	void ExecutionProfile::Reset(std::size_t startSize, const std::vector<std::size_t>& sizes) {
+		_opcodes.fill(0);
+		_functions.assign(sizes.size() + 1, functionProfile{ 0, 0, 0, 0, {} });
+		_functions[0]._counts.assign(startSize, 0);
+		for (std::size_t i = 0; i < sizes.size(); i++)
+			_functions[i + 1]._counts.assign(sizes[i], 0);
+		_active.clear();
+		_depth.assign(sizes.size() + 1, 0);
+	}
+
+	void ExecutionProfile::Enter(int32_t function) {
+		_functions[function + 1]._calls++;
+		_depth[function + 1]++;
+		_active.push_back(activation{ function, clock::now(), 0 });
+	}
+
+	void ExecutionProfile::Leave() {
+		if (_active.empty())
+			return;
+		auto a = _active.back();
+		_active.pop_back();
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - a._begin).count();
+		auto& f = _functions[a._function + 1];
+		f._exclusive += elapsed - a._children;
+		// 递归调用的时间已经包含在外层的调用中
+		if (--_depth[a._function + 1] == 0)
+			f._inclusive += elapsed;
+		if (!_active.empty())
+			_active.back()._children += elapsed;
+	}
+
+	void ExecutionProfile::Finish() {
+		while (!_active.empty())
+			Leave();
+	}
+
+	std::uint64_t ExecutionProfile::GetTotalInstructions() const {
+		uint64_t total = 0;
+		for (auto& it : _opcodes)
+			total += it;
+		return total;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace miniplc0 {
+
+	class functionProfile {
+	public:
+		std::uint64_t _calls;               //进入的次数
+		std::uint64_t _instructions;        //执行的指令数（不含调用的函数）
+		std::int64_t _inclusive;            //包含调用的函数在内的时间（纳秒），递归时只算最外层
+		std::int64_t _exclusive;            //除去调用的函数之后的时间（纳秒）
+		std::vector<std::uint64_t> _counts; //每条指令执行的次数，下标为指令在函数中的偏移
+	};
+
+	// 虚拟机的执行剖析
+	// 按操作码、函数和指令偏移统计执行次数，按函数统计每次调用的包含/排除时间
+	// 函数下标 -1 为 .start，.start 当作最外层的一次调用
+	// VM::SetProfile 之后每次 Run 都从头统计，Run 抛出异常时调用 Finish 结束还没返回的调用
+	class ExecutionProfile final {
+	private:
+		using int32_t = std::int32_t;
+		using uint64_t = std::uint64_t;
+		using clock = std::chrono::steady_clock;
+
+		class activation {
+		public:
+			int32_t _function;
+			clock::time_point _begin;
+			std::int64_t _children;     //调用的函数花掉的时间
+		};
+	public:
+		ExecutionProfile();
+
+		// 清空统计，startSize 为 .start 的指令数，sizes[i] 为第 i 个函数的指令数
+		void Reset(std::size_t startSize, const std::vector<std::size_t>& sizes);
+		// 每执行一条指令调用一次
+		void Count(int32_t function, int32_t offset, Operation op) {
+			_opcodes[op & 0xff]++;
+			auto& f = _functions[function + 1];
+			f._instructions++;
+			f._counts[offset]++;
+		}
+		// 进入和离开一次调用
+		void Enter(int32_t function);
+		void Leave();
+		// 结束所有还没有返回的调用
+		void Finish();
+
+		uint64_t GetOpcodeCount(Operation op) const { return _opcodes[op & 0xff]; }
+		// 函数的个数，不含 .start
+		std::size_t GetFunctionsCount() const { return _functions.empty() ? 0 : _functions.size() - 1; }
+		const functionProfile& GetFunction(int32_t index) const { return _functions[index + 1]; }
+		uint64_t GetTotalInstructions() const;
+	private:
+		std::array<uint64_t, 256> _opcodes;
+		std::vector<functionProfile> _functions;    //下标 0 为 .start，i+1 为第 i 个函数
+		std::vector<activation> _active;
+		std::vector<int32_t> _depth;                //每个函数正在进行的调用数，用于识别递归
+	};
+}
@@ -0,0 +1,724 @@
+#include "vm/vm.h"
+#include "verifier/verifier.h"
+#include "optimizer/optimizer.h"
+#include "instruction/opcode.h"
+
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <climits>
+
+namespace miniplc0 {
+
+	VM::VM(std::vector<functionsTable> fun, std::vector<Instruction> start, frameInfo startFrame, std::vector<functionBodyTable> bodies,
+			globalData data)
+		: _fun(std::move(fun)), _start(std::move(start)), _startFrame(startFrame), _bodies(std::move(bodies)), _data(std::move(data)),
+		_preallocated(false), _verified(false), _caching(true), _profile(nullptr), _stack(), _sp(0), _frames() {
+		if (_bodies.size() != _fun.size())
+			throw std::runtime_error("the number of function bodies does not match the function table");
+		_preallocated = _startFrame.isKnown();
+		for (auto& it : _bodies)
+			_preallocated = _preallocated && it._frame.isKnown();
+		_verified = !Verify(_fun, _start, _startFrame, _bodies, _data).has_value();
+	}
+
+	int32_t VM::Run(std::istream& in, std::ostream& out) {
+		_stack.assign(1024, 0);
+		_sp = 0;
+		_frames.clear();
+		_frames.push_back(frame{ &_start, 0, 0, 0, -1, -1 });
+		if (_preallocated)
+			reserve(_startFrame._locals + _startFrame._max_stack);
+		// 校验保证了执行前 _resume 条指令后栈上恰好是这么多整数
+		if (_verified && _data.isKnown()) {
+			int32_t n = _data._values.size();
+			reserve(n);
+			std::copy(_data._values.begin(), _data._values.end(), _stack.begin());
+			_sp = n;
+			_frames.back()._pc = _data._resume;
+		}
+		if (_profile != nullptr) {
+			std::vector<std::size_t> sizes;
+			for (auto& it : _bodies)
+				sizes.push_back(it._funins.size());
+			_profile->Reset(_start.size(), sizes);
+			_profile->Enter(-1);
+		}
+		dispatch(in, out, 1);
+		if (_profile != nullptr)
+			_profile->Leave();
+
+		int32_t main = -1;
+		for (std::size_t i = 0; i < _fun.size(); i++)
+			if (_fun[i]._value == "main")
+				main = i;
+		if (main == -1)
+			throw std::runtime_error("no main function");
+		int32_t sp = _sp;
+		call(main);
+		dispatch(in, out, 2);
+		out.flush();
+		return _sp > sp ? _stack[_sp - 1] : 0;
+	}
+
+	std::pair<int32_t, int32_t> VM::GetLocation() const {
+		if (_frames.empty())
+			return std::make_pair(-1, 0);
+		return std::make_pair(_frames.back()._function, std::max(_frames.back()._pc - 1, 0));
+	}
+
+	void VM::dispatch(std::istream& in, std::ostream& out, std::size_t depth) {
+		bool unchecked = _preallocated && _verified;
+		if (_profile != nullptr) {
+			if (unchecked)
+				execute<false, true>(in, out, depth);
+			else
+				execute<true, true>(in, out, depth);
+		}
+		else if (unchecked && _caching)
+			executeCached(in, out, depth);
+		else if (unchecked)
+			execute<false, false>(in, out, depth);
+		else
+			execute<true, false>(in, out, depth);
+	}
+
+	void VM::reserve(int32_t n) {
+		if (n > (int32_t)_stack.size())
+			_stack.resize(std::max<std::size_t>(n, _stack.size() * 2));
+	}
+
+	void VM::call(int32_t function) {
+		if (function < 0 || function >= (int32_t)_fun.size())
+			throw std::runtime_error("call to an invalid function " + std::to_string(function));
+		auto& f = _fun[function];
+		int32_t bp = _sp - f._params_size;
+		if (bp < 0)
+			throw std::runtime_error("not enough arguments on the stack");
+		if (_preallocated)
+			reserve(bp + _bodies[function]._frame._locals + _bodies[function]._frame._max_stack);
+		// 沿着调用者的静态链找到外层一级的栈帧
+		int32_t link = _frames.size() - 1;
+		while (link >= 0 && _frames[link]._level >= f._level)
+			link = _frames[link]._static;
+		_frames.push_back(frame{ &_bodies[function]._funins, 0, bp, f._level, function, link });
+		if (_profile != nullptr)
+			_profile->Enter(function);
+	}
+
+	int32_t VM::frameBase(int32_t level_diff) {
+		int32_t index = _frames.size() - 1;
+		for (int32_t i = 0; i < level_diff && index >= 0; i++)
+			index = _frames[index]._static;
+		if (index < 0)
+			throw std::runtime_error("invalid level difference " + std::to_string(level_diff));
+		return _frames[index]._bp;
+	}
+
+	static int32_t checkedDiv(int32_t lhs, int32_t rhs) {
+		if (rhs == 0)
+			throw std::runtime_error("divide by zero");
+		if (rhs == -1 && lhs == INT_MIN)
+			return lhs;
+		return lhs / rhs;
+	}
+
+	template <bool Checked, bool Profiled>
+	void VM::execute(std::istream& in, std::ostream& out, std::size_t depth) {
+		// 有符号溢出是未定义行为，算术一律按 uint32_t 回绕
+		using u = uint32_t;
+		while (_frames.size() >= depth) {
+			auto& f = _frames.back();
+			auto& code = *f._code;
+			if (f._pc >= (int32_t)code.size()) {
+				if (f._function == -1)
+					return;
+				throw std::runtime_error("function " + std::to_string(f._function) + " does not return");
+			}
+			auto& ins = code[f._pc++];
+			int32_t x = ins.GetX();
+			if constexpr (Profiled)
+				_profile->Count(f._function, f._pc - 1, ins.GetOperation());
+			if constexpr (Checked) {
+				auto& info = opcodeOf(ins.GetOperation());
+				if (!info._supported)
+					throw std::runtime_error("unsupported instruction " + std::to_string(ins.GetOperation()));
+				reserve(_sp + 4);
+				int32_t pop, push;
+				stackEffect(ins, _fun, pop, push);
+				if (pop < 0 || push < 0 || _sp - pop < f._bp)
+					throw std::runtime_error("stack underflow");
+				if (info._branch && (x < 0 || x > (int32_t)code.size()))
+					throw std::runtime_error("jump out of range");
+				if (ins.GetOperation() == TABLESWITCH && (ins.GetY() < 0 || f._pc + ins.GetY() >= (int32_t)code.size()))
+					throw std::runtime_error("jump out of range");
+				if (ins.GetOperation() == ILOAD && (_stack[_sp - 1] < 0 || _stack[_sp - 1] >= _sp))
+					throw std::runtime_error("invalid address");
+				if (ins.GetOperation() == ISTORE && (_stack[_sp - 2] < 0 || _stack[_sp - 2] >= _sp))
+					throw std::runtime_error("invalid address");
+			}
+			switch (ins.GetOperation()) {
+				case NOP:
+					break;
+				case BIPUSH:
+				case IPUSH:
+					_stack[_sp++] = x;
+					break;
+				case POP:
+					_sp -= 1;
+					break;
+				case POP2:
+					_sp -= 2;
+					break;
+				case POPN:
+					_sp -= x;
+					break;
+				case DUP:
+					_stack[_sp] = _stack[_sp - 1];
+					_sp++;
+					break;
+				case DUP2:
+					_stack[_sp] = _stack[_sp - 2];
+					_stack[_sp + 1] = _stack[_sp - 1];
+					_sp += 2;
+					break;
+				case LOADA:
+					_stack[_sp++] = frameBase(x) + ins.GetY();
+					break;
+				case SNEW:
+					if constexpr (Checked)
+						reserve(_sp + x);
+					std::fill(_stack.begin() + _sp, _stack.begin() + _sp + x, 0);
+					_sp += x;
+					break;
+				case ILOAD:
+					_stack[_sp - 1] = _stack[_stack[_sp - 1]];
+					break;
+				case ISTORE:
+					_stack[_stack[_sp - 2]] = _stack[_sp - 1];
+					_sp -= 2;
+					break;
+				case IADD:
+					_stack[_sp - 2] = (int32_t)((u)_stack[_sp - 2] + (u)_stack[_sp - 1]);
+					_sp--;
+					break;
+				case ISUB:
+					_stack[_sp - 2] = (int32_t)((u)_stack[_sp - 2] - (u)_stack[_sp - 1]);
+					_sp--;
+					break;
+				case IMUL:
+					_stack[_sp - 2] = (int32_t)((u)_stack[_sp - 2] * (u)_stack[_sp - 1]);
+					_sp--;
+					break;
+				case IDIV:
+					_stack[_sp - 2] = checkedDiv(_stack[_sp - 2], _stack[_sp - 1]);
+					_sp--;
+					break;
+				case INEG:
+					_stack[_sp - 1] = (int32_t)(0u - (u)_stack[_sp - 1]);
+					break;
+				case ICMP: {
+					int32_t lhs = _stack[_sp - 2], rhs = _stack[_sp - 1];
+					_stack[_sp - 2] = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+					_sp--;
+					break;
+				}
+				case I2C:
+					_stack[_sp - 1] = (char)_stack[_sp - 1];
+					break;
+				case JMP:
+					f._pc = x;
+					break;
+				case JE:
+					if (_stack[--_sp] == 0)
+						f._pc = x;
+					break;
+				case JNE:
+					if (_stack[--_sp] != 0)
+						f._pc = x;
+					break;
+				case JL:
+					if (_stack[--_sp] < 0)
+						f._pc = x;
+					break;
+				case JGE:
+					if (_stack[--_sp] >= 0)
+						f._pc = x;
+					break;
+				case JG:
+					if (_stack[--_sp] > 0)
+						f._pc = x;
+					break;
+				case JLE:
+					if (_stack[--_sp] <= 0)
+						f._pc = x;
+					break;
+				case TABLESWITCH: {
+					// f._pc 已经指向跳转表的默认分支，case 在它后面
+					u index = (u)_stack[--_sp] - (u)x;
+					if (index < (u)ins.GetY())
+						f._pc += index + 1;
+					break;
+				}
+				case CALL:
+					call(x);
+					break;
+				case RET:
+					_sp = f._bp;
+					_frames.pop_back();
+					if constexpr (Profiled)
+						_profile->Leave();
+					break;
+				case IRET: {
+					int32_t value = _stack[_sp - 1];
+					_sp = f._bp;
+					_stack[_sp++] = value;
+					_frames.pop_back();
+					if constexpr (Profiled)
+						_profile->Leave();
+					break;
+				}
+				case IPRINT:
+					out << _stack[--_sp];
+					break;
+				case CPRINT:
+					out << (char)_stack[--_sp];
+					break;
+				case PRINTL:
+					out << '\n';
+					break;
+				case ISCAN: {
+					int32_t value;
+					if (!(in >> value))
+						throw std::runtime_error("fail to scan an integer");
+					_stack[_sp++] = value;
+					break;
+				}
+				case CSCAN: {
+					char value;
+					if (!in.get(value))
+						throw std::runtime_error("fail to scan a char");
+					_stack[_sp++] = value;
+					break;
+				}
+				default:
+					throw std::runtime_error("unsupported instruction " + std::to_string(ins.GetOperation()));
+			}
+		}
+	}
+
+	// 栈顶缓存：state 为缓存的 slot 数，t0 是栈顶，t1 是次栈顶，其余的 slot 在 _stack[0, _sp) 中
+	// 逻辑上的栈高度是 _sp + state，iload/istore 的地址都在缓存的 slot 之下（除了 state 为 2 时 t1 本身）
+	// 栈顶之上的 slot 的内容未定义，缓存的 slot 没有写回内存，读到的值可能和 execute<false, false> 不同
+	// 热点指令在每个状态下单独处理，其余指令先把缓存写回内存（state 变为 0），再按内存中的栈执行
+	void VM::executeCached(std::istream& in, std::ostream& out, std::size_t depth) {
+		using u = uint32_t;
+		int32_t t0 = 0, t1 = 0, state = 0;
+		const Instruction* code = nullptr;
+		int32_t size = 0, pc = 0, bp = 0;
+		// 切换栈帧后重新取出当前栈帧的信息
+		auto enter = [&]() {
+			auto& f = _frames.back();
+			code = f._code->data();
+			size = f._code->size();
+			pc = f._pc;
+			bp = f._bp;
+		};
+		// 校验保证了跳转表中都是 jmp，直接取出目标，不再执行一次 jmp
+		auto caseTarget = [&](const Instruction& table, int32_t value) {
+			u index = (u)value - (u)table.GetX();
+			return code[index < (u)table.GetY() ? pc + 1 + index : pc].GetX();
+		};
+		auto spill = [&]() {
+			if (state == 2) {
+				_stack[_sp] = t1;
+				_stack[_sp + 1] = t0;
+				_sp += 2;
+			}
+			else if (state == 1)
+				_stack[_sp++] = t0;
+			state = 0;
+		};
+
+		enter();
+		// 出错时写回 pc，GetLocation 才能找到出错的指令
+		try {
+			while (true) {
+				// 校验保证了只有 .start 会执行到末尾
+				if (pc == size) {
+					spill();
+					_frames.back()._pc = pc;
+					return;
+				}
+				auto& ins = code[pc++];
+				auto op = ins.GetOperation();
+				int32_t x = ins.GetX();
+
+				if (state == 1) {
+					switch (op) {
+						case BIPUSH:
+						case IPUSH:
+							t1 = t0;
+							t0 = x;
+							state = 2;
+							continue;
+						case LOADA:
+							t1 = t0;
+							t0 = (x == 0 ? bp : frameBase(x)) + ins.GetY();
+							state = 2;
+							continue;
+						case DUP:
+							t1 = t0;
+							state = 2;
+							continue;
+						case POP:
+							state = 0;
+							continue;
+						case ILOAD:
+							t0 = _stack[t0];
+							continue;
+						case ISTORE:
+							_stack[_stack[--_sp]] = t0;
+							state = 0;
+							continue;
+						case IADD:
+							t0 = (int32_t)((u)_stack[--_sp] + (u)t0);
+							continue;
+						case ISUB:
+							t0 = (int32_t)((u)_stack[--_sp] - (u)t0);
+							continue;
+						case IMUL:
+							t0 = (int32_t)((u)_stack[--_sp] * (u)t0);
+							continue;
+						case INEG:
+							t0 = (int32_t)(0u - (u)t0);
+							continue;
+						case ICMP: {
+							int32_t lhs = _stack[--_sp];
+							t0 = lhs < t0 ? -1 : (lhs > t0 ? 1 : 0);
+							continue;
+						}
+						case JMP:
+							pc = x;
+							continue;
+						case JE:
+							state = 0;
+							if (t0 == 0)
+								pc = x;
+							continue;
+						case JNE:
+							state = 0;
+							if (t0 != 0)
+								pc = x;
+							continue;
+						case JL:
+							state = 0;
+							if (t0 < 0)
+								pc = x;
+							continue;
+						case JGE:
+							state = 0;
+							if (t0 >= 0)
+								pc = x;
+							continue;
+						case JG:
+							state = 0;
+							if (t0 > 0)
+								pc = x;
+							continue;
+						case JLE:
+							state = 0;
+							if (t0 <= 0)
+								pc = x;
+							continue;
+						case TABLESWITCH:
+							state = 0;
+							pc = caseTarget(ins, t0);
+							continue;
+						case IRET:
+							// 返回值留在缓存中
+							_sp = bp;
+							_frames.pop_back();
+							if (_frames.size() < depth) {
+								spill();
+								return;
+							}
+							enter();
+							continue;
+						default:
+							spill();
+							break;
+					}
+				}
+				else if (state == 2) {
+					switch (op) {
+						case BIPUSH:
+						case IPUSH:
+							_stack[_sp++] = t1;
+							t1 = t0;
+							t0 = x;
+							continue;
+						case LOADA:
+							_stack[_sp++] = t1;
+							t1 = t0;
+							t0 = (x == 0 ? bp : frameBase(x)) + ins.GetY();
+							continue;
+						case DUP:
+							_stack[_sp++] = t1;
+							t1 = t0;
+							continue;
+						case POP:
+							t0 = t1;
+							state = 1;
+							continue;
+						case ILOAD:
+							// 地址可能指向 t1 本身，比如 .start 中紧接着读刚压栈的全局变量
+							t0 = t0 == _sp ? t1 : _stack[t0];
+							continue;
+						case ISTORE:
+							_stack[t1] = t0;
+							state = 0;
+							continue;
+						case IADD:
+							t0 = (int32_t)((u)t1 + (u)t0);
+							state = 1;
+							continue;
+						case ISUB:
+							t0 = (int32_t)((u)t1 - (u)t0);
+							state = 1;
+							continue;
+						case IMUL:
+							t0 = (int32_t)((u)t1 * (u)t0);
+							state = 1;
+							continue;
+						case INEG:
+							t0 = (int32_t)(0u - (u)t0);
+							continue;
+						case ICMP:
+							t0 = t1 < t0 ? -1 : (t1 > t0 ? 1 : 0);
+							state = 1;
+							continue;
+						case JMP:
+							pc = x;
+							continue;
+						case JE:
+							if (t0 == 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case JNE:
+							if (t0 != 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case JL:
+							if (t0 < 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case JGE:
+							if (t0 >= 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case JG:
+							if (t0 > 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case JLE:
+							if (t0 <= 0)
+								pc = x;
+							t0 = t1;
+							state = 1;
+							continue;
+						case TABLESWITCH:
+							pc = caseTarget(ins, t0);
+							t0 = t1;
+							state = 1;
+							continue;
+						case IRET:
+							_sp = bp;
+							_frames.pop_back();
+							state = 1;
+							if (_frames.size() < depth) {
+								spill();
+								return;
+							}
+							enter();
+							continue;
+						default:
+							spill();
+							break;
+					}
+				}
+
+				// state 为 0，栈全部在内存中
+				switch (op) {
+					case NOP:
+						break;
+					case BIPUSH:
+					case IPUSH:
+						t0 = x;
+						state = 1;
+						break;
+					case POP:
+						_sp -= 1;
+						break;
+					case POP2:
+						_sp -= 2;
+						break;
+					case POPN:
+						_sp -= x;
+						break;
+					case DUP:
+						t0 = _stack[_sp - 1];
+						state = 1;
+						break;
+					case DUP2:
+						_stack[_sp] = _stack[_sp - 2];
+						_stack[_sp + 1] = _stack[_sp - 1];
+						_sp += 2;
+						break;
+					case LOADA:
+						t0 = (x == 0 ? bp : frameBase(x)) + ins.GetY();
+						state = 1;
+						break;
+					case SNEW:
+						std::fill(_stack.begin() + _sp, _stack.begin() + _sp + x, 0);
+						_sp += x;
+						break;
+					case ILOAD:
+						t0 = _stack[_stack[--_sp]];
+						state = 1;
+						break;
+					case ISTORE:
+						_stack[_stack[_sp - 2]] = _stack[_sp - 1];
+						_sp -= 2;
+						break;
+					case IADD:
+						t0 = (int32_t)((u)_stack[_sp - 2] + (u)_stack[_sp - 1]);
+						_sp -= 2;
+						state = 1;
+						break;
+					case ISUB:
+						t0 = (int32_t)((u)_stack[_sp - 2] - (u)_stack[_sp - 1]);
+						_sp -= 2;
+						state = 1;
+						break;
+					case IMUL:
+						t0 = (int32_t)((u)_stack[_sp - 2] * (u)_stack[_sp - 1]);
+						_sp -= 2;
+						state = 1;
+						break;
+					case IDIV:
+						_stack[_sp - 2] = checkedDiv(_stack[_sp - 2], _stack[_sp - 1]);
+						_sp--;
+						break;
+					case INEG:
+						t0 = (int32_t)(0u - (u)_stack[--_sp]);
+						state = 1;
+						break;
+					case ICMP: {
+						int32_t lhs = _stack[_sp - 2], rhs = _stack[_sp - 1];
+						t0 = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+						_sp -= 2;
+						state = 1;
+						break;
+					}
+					case I2C:
+						_stack[_sp - 1] = (char)_stack[_sp - 1];
+						break;
+					case JMP:
+						pc = x;
+						break;
+					case JE:
+						if (_stack[--_sp] == 0)
+							pc = x;
+						break;
+					case JNE:
+						if (_stack[--_sp] != 0)
+							pc = x;
+						break;
+					case JL:
+						if (_stack[--_sp] < 0)
+							pc = x;
+						break;
+					case JGE:
+						if (_stack[--_sp] >= 0)
+							pc = x;
+						break;
+					case JG:
+						if (_stack[--_sp] > 0)
+							pc = x;
+						break;
+					case JLE:
+						if (_stack[--_sp] <= 0)
+							pc = x;
+						break;
+					case TABLESWITCH:
+						pc = caseTarget(ins, _stack[--_sp]);
+						break;
+					case CALL:
+						_frames.back()._pc = pc;
+						call(x);
+						enter();
+						break;
+					case RET:
+						_sp = bp;
+						_frames.pop_back();
+						if (_frames.size() < depth)
+							return;
+						enter();
+						break;
+					case IRET:
+						t0 = _stack[_sp - 1];
+						_sp = bp;
+						_frames.pop_back();
+						state = 1;
+						if (_frames.size() < depth) {
+							spill();
+							return;
+						}
+						enter();
+						break;
+					case IPRINT:
+						out << _stack[--_sp];
+						break;
+					case CPRINT:
+						out << (char)_stack[--_sp];
+						break;
+					case PRINTL:
+						out << '\n';
+						break;
+					case ISCAN: {
+						int32_t value;
+						if (!(in >> value))
+							throw std::runtime_error("fail to scan an integer");
+						_stack[_sp++] = value;
+						break;
+					}
+					case CSCAN: {
+						char value;
+						if (!in.get(value))
+							throw std::runtime_error("fail to scan a char");
+						_stack[_sp++] = value;
+						break;
+					}
+					default:
+						throw std::runtime_error("unsupported instruction " + std::to_string(op));
+				}
+			}
+		}
+		catch (...) {
+			if (!_frames.empty())
+				_frames.back()._pc = pc;
+			throw;
+		}
+	}
+}
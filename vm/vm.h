@@ -0,0 +1,85 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "systable/systable.h"
+#include "vm/profile.h"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <iostream>
+
+namespace miniplc0 {
+
+	// C0 虚拟机
+	// 栈以 slot（int32_t）为单位，loada 得到的地址就是 slot 在栈上的下标
+	// 构造时先做字节码校验，如果通过校验并且 .start 和所有函数都带有栈帧信息，
+	// 进入栈帧时一次分配好整个栈帧，之后执行指令不再做任何检查
+	// 否则每条指令执行前都检查栈空间、栈下溢、跳转目标和地址
+	// 带有预先算好的全局变量并且通过校验时，直接把它们复制到栈上，从 .start 的中间开始执行
+	// 不做检查的路径上默认把栈顶的一到两个 slot 放在局部变量中（栈顶缓存），算术、比较和跳转不必读写内存
+	// 设置了 ExecutionProfile 时不使用栈顶缓存，每条指令都计数
+	class VM final {
+	private:
+		using int32_t = std::int32_t;
+		using uint32_t = std::uint32_t;
+
+		class frame {
+		public:
+			const std::vector<Instruction>* _code;
+			int32_t _pc;        //下一条要执行的指令
+			int32_t _bp;        //栈帧起点，参数占据开头的 slot
+			int32_t _level;     //函数的层级，.start 为 0
+			int32_t _function;  //函数下标，.start 为 -1
+			int32_t _static;    //静态链，外层栈帧在 _frames 中的下标
+		};
+	public:
+		VM(std::vector<functionsTable> fun, std::vector<Instruction> start, frameInfo startFrame, std::vector<functionBodyTable> bodies,
+			globalData data = globalData());
+		VM(const VM&) = delete;
+		VM(VM&&) = delete;
+		VM& operator=(VM) = delete;
+
+		// 执行 .start，然后调用 main，返回 main 的返回值
+		// 运行时错误以 std::runtime_error 抛出
+		int32_t Run(std::istream& in, std::ostream& out);
+		// 是否所有栈帧都能预先分配
+		bool IsPreallocated() const { return _preallocated; }
+		// 是否通过了字节码校验
+		bool IsVerified() const { return _verified; }
+		// 不做检查时是否使用栈顶缓存，关掉后是逐条读写内存的 switch 解释器，用于对比
+		void SetStackCaching(bool enable) { _caching = enable; }
+		// 最近一次执行的指令所在的函数（.start 为 -1）和下标，Run 抛出异常后就是出错的指令
+		std::pair<int32_t, int32_t> GetLocation() const;
+		// 执行时统计到 profile 中，nullptr 表示不统计，profile 的生存期由调用者保证
+		void SetProfile(ExecutionProfile* profile) { _profile = profile; }
+	private:
+		// 按是否通过校验、是否预先分配和是否剖析选择解释器
+		void dispatch(std::istream& in, std::ostream& out, std::size_t depth);
+		// 执行到栈帧数少于 depth，或者 .start 执行完毕
+		template <bool Checked, bool Profiled>
+		void execute(std::istream& in, std::ostream& out, std::size_t depth);
+		// 带栈顶缓存的 execute<false, false>，只能用于通过校验并且预先分配了栈帧的程序
+		void executeCached(std::istream& in, std::ostream& out, std::size_t depth);
+
+		void call(int32_t function);
+		// 保证栈上至少有 n 个 slot
+		void reserve(int32_t n);
+		// level_diff 层之外的栈帧的起点
+		int32_t frameBase(int32_t level_diff);
+	private:
+		std::vector<functionsTable> _fun;
+		std::vector<Instruction> _start;
+		frameInfo _startFrame;
+		std::vector<functionBodyTable> _bodies;
+		globalData _data;
+		bool _preallocated;
+		bool _verified;
+		bool _caching;
+		ExecutionProfile* _profile;
+
+		std::vector<int32_t> _stack;
+		int32_t _sp;
+		std::vector<frame> _frames;
+	};
+}